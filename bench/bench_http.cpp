@@ -0,0 +1,91 @@
+#include "benchmark.h"
+#include "http.h"
+#include <list>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace scgi;
+
+SCGI_BENCHMARK(url_decode_plain) {
+    std::string input = "/api/v1/users/profile/settings/notifications";
+    state.set_bytes(input.size());
+    while (state.next()) bench::keep(http::url_decode(input));
+}
+
+SCGI_BENCHMARK(url_decode_escaped) {
+    std::string input = "name=%D0%9F%D1%80%D0%B8%D0%B2%D0%B5%D1%82+world%21&redirect=https%3A%2F%2Fexample.com%2F";
+    state.set_bytes(input.size());
+    while (state.next()) bench::keep(http::url_decode(input));
+}
+
+SCGI_BENCHMARK(parse_http_headers) {
+    std::string input = "Host: example.com\r\n"
+            "User-Agent: Mozilla/5.0 (X11; Linux x86_64)\r\n"
+            "Accept: text/html,application/xhtml+xml,application/xml;q=0.9\r\n"
+            "Accept-Language: en-US,en;q=0.5\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: 128\r\n"
+            "\r\n";
+    state.set_bytes(input.size());
+    std::map<std::string, std::string> headers;
+    while (state.next()) {
+        std::istringstream in(input);
+        headers.clear();
+        http::parse_http_headers(in, headers);
+        bench::keep(headers);
+    }
+}
+
+SCGI_BENCHMARK(parse_http_line) {
+    std::string input = "form-data; name=\"attachment\"; filename=\"report-2016.pdf\"; size=1048576";
+    state.set_bytes(input.size());
+    std::list<std::string> items;
+    std::map<std::string, std::string> params;
+    while (state.next()) {
+        items.clear();
+        params.clear();
+        http::parse_http_line(input, items, params);
+        bench::keep(params);
+    }
+}
+
+SCGI_BENCHMARK(parse_http_urlencoded_form) {
+    std::string input = "login=user%40example.com&password=s3cr3t%21&remember=on&redirect=%2Fhome%3Ftab%3D1&lang=en";
+    state.set_bytes(input.size());
+    std::unordered_map<std::string, std::string> form;
+    while (state.next()) {
+        std::istringstream in(input);
+        form.clear();
+        http::parse_http_urlencoded_form(in, form);
+        bench::keep(form);
+    }
+}
+
+SCGI_BENCHMARK(parse_http_multipart_form) {
+    std::string boundary = "----WebKitFormBoundary7MA4YWxkTrZu0gW";
+    std::string input;
+    for (int i = 0; i < 4; ++i) {
+        input += "--" + boundary + "\r\n"
+                "Content-Disposition: form-data; name=\"field" + std::to_string(i) + "\"\r\n\r\n" +
+                std::string(256, static_cast<char>('a' + i)) + "\r\n";
+    }
+    input += "--" + boundary + "--\r\n";
+    state.set_bytes(input.size());
+    // Function takes boundary line
+    std::string line = "--" + boundary;
+    std::unordered_map<std::string, std::string> form;
+    {
+        // Measured path must be successful parse
+        std::istringstream in(input);
+        http::parse_http_multipart_form(in, form, line);
+        if (form.size() != 4) throw std::runtime_error("multipart form is not parsed");
+    }
+    while (state.next()) {
+        std::istringstream in(input);
+        form.clear();
+        http::parse_http_multipart_form(in, form, line);
+        bench::keep(form);
+    }
+}
@@ -0,0 +1,154 @@
+#include "benchmark.h"
+#include "parser.h"
+#include "scgi.h"
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace scgi;
+
+/**
+ * SCGI netstring of typical GET request
+ */
+static std::string make_request() {
+    static const char *pairs[] = {
+            "CONTENT_LENGTH", "0",
+            "SCGI", "1",
+            "REQUEST_METHOD", "GET",
+            "REQUEST_URI", "/api/v1/users?id=42&fields=name,email",
+            "PATH_INFO", "/api/v1/users",
+            "QUERY_STRING", "id=42&fields=name,email",
+            "SERVER_PROTOCOL", "HTTP/1.1",
+            "REMOTE_ADDR", "10.0.0.1",
+            "HTTP_HOST", "example.com",
+            "HTTP_USER_AGENT", "Mozilla/5.0 (X11; Linux x86_64)",
+            "HTTP_ACCEPT", "application/json",
+    };
+    std::string headers;
+    for (auto pair:pairs) {
+        headers.append(pair);
+        headers.push_back('\0');
+    }
+    return std::to_string(headers.size()) + ":" + headers + ",";
+}
+
+SCGI_BENCHMARK(request_parser_feed) {
+    std::string input = make_request();
+    state.set_bytes(input.size());
+    RequestParser parser;
+    while (state.next()) {
+        parser.reset();
+        parser.feed(input.data(), input.size());
+        bench::keep(parser);
+    }
+}
+
+SCGI_BENCHMARK(request_parser_feed_bytewise) {
+    std::string input = make_request();
+    state.set_bytes(input.size());
+    RequestParser parser;
+    while (state.next()) {
+        parser.reset();
+        for (size_t i = 0; i < input.size(); ++i) parser.feed(&input[i], 1);
+        bench::keep(parser);
+    }
+}
+
+/**
+ * Blocking request (stream reading of netstring) from socket pair. Includes descriptor duplication and write
+ * of request into socket
+ */
+SCGI_BENCHMARK(request_from_socket) {
+    std::string input = make_request();
+    state.set_bytes(input.size());
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) throw std::runtime_error("socketpair failed");
+    while (state.next()) {
+        if (::write(fds[1], input.data(), input.size()) != static_cast<ssize_t>(input.size())) break;
+        Request request(::dup(fds[0]), 1);
+        bench::keep(request.header(header::Slot::path));
+    }
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+SCGI_BENCHMARK(request_query_find) {
+    std::string input = make_request();
+    RequestParser parser;
+    parser.feed(input.data(), input.size());
+    Request request(1, parser, [](std::string &&) { });
+    std::string value;
+    while (state.next()) bench::keep(request.find_query("fields", value));
+}
+
+/**
+ * Temporary file of `size` bytes and socket with draining reader: response of 1 MiB file is sent by copying
+ * through output stream or by sendfile
+ */
+class FileResponse {
+public:
+    static const size_t size = 1024 * 1024;
+
+    FileResponse() {
+        char path[] = "/tmp/scgi-bench-XXXXXX";
+        file_ = ::mkstemp(path);
+        if (file_ < 0) throw std::runtime_error("mkstemp failed");
+        ::unlink(path);
+        std::string content(size, 'x');
+        if (::write(file_, content.data(), size) != static_cast<ssize_t>(size)) throw std::runtime_error("write failed");
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds_) != 0) throw std::runtime_error("socketpair failed");
+        drain_ = std::thread([this] {
+            char buffer[64 * 1024];
+            while (::read(fds_[1], buffer, sizeof(buffer)) > 0) { }
+        });
+    }
+
+    inline int file() const {
+        return file_;
+    }
+
+    inline int socket() const {
+        return fds_[0];
+    }
+
+    ~FileResponse() {
+        ::shutdown(fds_[0], SHUT_RDWR);
+        drain_.join();
+        ::close(fds_[0]);
+        ::close(fds_[1]);
+        ::close(file_);
+    }
+
+private:
+    int file_;
+    int fds_[2];
+    std::thread drain_;
+};
+
+SCGI_BENCHMARK(file_response_copy) {
+    FileResponse response;
+    state.set_bytes(FileResponse::size);
+    std::vector<char> buffer(64 * 1024);
+    while (state.next()) {
+        ResponseWriter writer(response.socket());
+        off_t offset = 0;
+        ssize_t reads;
+        while ((reads = ::pread(response.file(), buffer.data(), buffer.size(), offset)) > 0) {
+            writer.sputn(buffer.data(), reads);
+            offset += reads;
+        }
+        bench::keep(writer.finish());
+    }
+}
+
+SCGI_BENCHMARK(file_response_sendfile) {
+    FileResponse response;
+    state.set_bytes(FileResponse::size);
+    while (state.next()) {
+        ResponseWriter writer(response.socket());
+        bench::keep(writer.send_file(response.file(), 0, FileResponse::size));
+        bench::keep(writer.finish());
+    }
+}
@@ -0,0 +1,162 @@
+#include "benchmark.h"
+#include "service.h"
+#include "pool.h"
+#include <sstream>
+
+using namespace scgi;
+
+static std::string make_request(const std::string &body) {
+    std::string headers("CONTENT_LENGTH", 14);
+    headers.push_back('\0');
+    headers += std::to_string(body.size());
+    headers.push_back('\0');
+    headers += std::string("SCGI\0" "1\0" "PATH_INFO\0" "/rpc\0", 20);
+    return std::to_string(headers.size()) + ":" + headers + "," + body;
+}
+
+SCGI_BENCHMARK(method_validate) {
+    service::ServiceHandler::MethodDescription description;
+    description.name = "create_user";
+    description.set_param("name", Json::stringValue)
+            .set_param("age", Json::uintValue)
+            .set_param("score", Json::realValue)
+            .set_param("tags", Json::arrayValue);
+    Json::Value message;
+    message["method"] = "create_user";
+    message["name"] = "John";
+    message["age"] = 42;
+    message["score"] = 4.5;
+    message["tags"].append("admin");
+    while (state.next()) bench::keep(description.validate(message));
+}
+
+/**
+ * Serialize JSON response into request taken from pool (response goes to sink, without descriptor)
+ */
+SCGI_BENCHMARK(service_send) {
+    std::string input = make_request("");
+    auto pool = RequestPool::create();
+    RequestParser parser;
+    Json::Value value;
+    for (int i = 0; i < 8; ++i) {
+        Json::Value item;
+        item["id"] = i;
+        item["name"] = "user" + std::to_string(i);
+        item["active"] = i % 2 == 0;
+        value["result"].append(item);
+    }
+    size_t sent = 0;
+    ResponseSink sink = [&sent](std::string &&data) { sent = data.size(); };
+    while (state.next()) {
+        parser.reset();
+        parser.feed(input.data(), input.size());
+        service::send(pool->acquire(1, parser, sink), value);
+    }
+    state.set_bytes(sent);
+}
+
+/**
+ * Typical call payload for comparison of wire formats
+ */
+static Json::Value make_call() {
+    Json::Value call;
+    call["method"] = "update";
+    call["key"] = "user:1024:profile";
+    call["value"] = "{\"name\":\"John\",\"age\":42}";
+    call["ttl"] = 3600;
+    call["tags"].append("admin");
+    call["tags"].append("beta");
+    return call;
+}
+
+SCGI_BENCHMARK(json_parse) {
+    std::string input = service::to_json(make_call());
+    state.set_bytes(input.size());
+    Json::Reader reader;
+    Json::Value value;
+    while (state.next()) bench::keep(reader.parse(input.data(), input.data() + input.size(), value));
+}
+
+SCGI_BENCHMARK(json_stream_parse) {
+    std::string input = service::to_json(make_call());
+    state.set_bytes(input.size());
+    Json::Value value;
+    while (state.next()) bench::keep(service::parse_json(input.data(), input.size(), value));
+}
+
+/**
+ * Events only, without building of values (typed handler)
+ */
+SCGI_BENCHMARK(json_stream_events) {
+    std::string input = service::to_json(make_call());
+    state.set_bytes(input.size());
+    service::JsonParser::Handler handler;
+    while (state.next()) {
+        service::JsonParser parser(handler);
+        bench::keep(parser.feed(input.data(), input.size()) && parser.finish());
+    }
+}
+
+SCGI_BENCHMARK(msgpack_read) {
+    std::stringbuf buffer;
+    service::write_value(buffer, make_call(), service::Codec::MessagePack);
+    std::string input = buffer.str();
+    state.set_bytes(input.size());
+    Json::Value value;
+    while (state.next()) bench::keep(service::read_binary(service::Codec::MessagePack, input.data(), input.size(), value));
+}
+
+SCGI_BENCHMARK(cbor_read) {
+    std::stringbuf buffer;
+    service::write_value(buffer, make_call(), service::Codec::Cbor);
+    std::string input = buffer.str();
+    state.set_bytes(input.size());
+    Json::Value value;
+    while (state.next()) bench::keep(service::read_binary(service::Codec::Cbor, input.data(), input.size(), value));
+}
+
+/**
+ * Discards output, counts bytes
+ */
+class NullBuffer : public std::streambuf {
+public:
+    size_t size = 0;
+
+protected:
+    int_type overflow(int_type c) override {
+        ++size;
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char *, std::streamsize count) override {
+        size += static_cast<size_t>(count);
+        return count;
+    }
+};
+
+static const int result_rows = 1000;
+
+SCGI_BENCHMARK(json_rows_build) {
+    NullBuffer out;
+    while (state.next()) {
+        Json::Value rows(Json::arrayValue);
+        for (int i = 0; i < result_rows; ++i) {
+            Json::Value &row = rows.append(Json::Value(Json::objectValue));
+            row["id"] = i;
+            row["name"] = "row";
+        }
+        service::write_json(out, rows);
+    }
+    state.set_bytes(out.size / state.iterations());
+}
+
+SCGI_BENCHMARK(json_rows_stream) {
+    NullBuffer out;
+    while (state.next()) {
+        service::JsonStream stream(out);
+        stream.begin_array();
+        for (int i = 0; i < result_rows; ++i) stream.begin_object().key("id").value(i).key("name").value("row").end();
+        stream.end();
+    }
+    state.set_bytes(out.size / state.iterations());
+}
@@ -0,0 +1,104 @@
+#include "benchmark.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+static std::atomic<uint64_t> allocation_count{0};
+
+void *operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    void *ptr = std::malloc(size > 0 ? size : 1);
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace scgi {
+    namespace bench {
+
+        // Minimal measured time of one benchmark
+        static const std::chrono::milliseconds min_time(200);
+
+        struct Entry {
+            std::string name;
+            Function function;
+        };
+
+        static std::vector<Entry> &registry() {
+            static std::vector<Entry> entries;
+            return entries;
+        }
+
+        uint64_t allocations() {
+            return allocation_count.load(std::memory_order_relaxed);
+        }
+
+        bool add(const std::string &name, const Function &function) {
+            registry().push_back(Entry{name, function});
+            return true;
+        }
+
+        /**
+         * Run benchmark with growing count of iterations till it takes `min_time`
+         */
+        static void run(const Entry &entry) {
+            uint64_t iterations = 1;
+            while (true) {
+                State state(iterations);
+                entry.function(state);
+                auto elapsed = state.elapsed();
+                if (elapsed >= min_time || iterations >= (1ull << 40)) {
+                    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            elapsed).count()) / static_cast<double>(iterations);
+                    double allocs = static_cast<double>(state.total_allocations()) / static_cast<double>(iterations);
+                    std::printf("%-36s %12llu %12.1f", entry.name.c_str(), static_cast<unsigned long long>(iterations),
+                                ns);
+                    if (state.bytes() > 0) std::printf(" %12.1f", static_cast<double>(state.bytes()) / ns * 1e3);
+                    else std::printf(" %12s", "-");
+                    std::printf(" %10.2f\n", allocs);
+                    return;
+                }
+                // Aim at minimal time with margin, but grow at most 100 times per step
+                double scale = elapsed.count() > 0 ? 1.4 * static_cast<double>(min_time.count()) /
+                                                     static_cast<double>(std::chrono::duration_cast<
+                                                             std::chrono::milliseconds>(elapsed).count() + 1)
+                                                   : 100.0;
+                iterations = static_cast<uint64_t>(static_cast<double>(iterations) *
+                                                   (scale > 100.0 ? 100.0 : (scale < 2.0 ? 2.0 : scale)));
+            }
+        }
+    }
+}
+
+/**
+ * Run benchmarks which names contain first argument (all by default)
+ */
+int main(int argc, char **argv) {
+    std::string filter = argc > 1 ? argv[1] : "";
+    std::printf("%-36s %12s %12s %12s %10s\n", "benchmark", "iterations", "ns/op", "MB/s", "allocs/op");
+    for (auto &entry:scgi::bench::registry()) {
+        if (entry.name.find(filter) != std::string::npos) scgi::bench::run(entry);
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+#ifndef SCGI_BENCHMARK_H
+#define SCGI_BENCHMARK_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace scgi {
+    namespace bench {
+
+        /**
+         * Count of heap allocations made by process
+         */
+        uint64_t allocations();
+
+        /**
+         * Iterations of one benchmark run. Time and allocations are measured from first `next` call, so
+         * preparation of inputs before loop is not counted:
+         *
+         *   while (state.next()) { ... }
+         */
+        class State {
+        public:
+            explicit State(uint64_t iterations) : iterations_(iterations), left_(iterations) { }
+
+            inline bool next() {
+                if (left_ == iterations_) {
+                    allocations_ = allocations();
+                    start_ = std::chrono::steady_clock::now();
+                }
+                if (left_ == 0) {
+                    stop_ = std::chrono::steady_clock::now();
+                    allocations_ = allocations() - allocations_;
+                    return false;
+                }
+                --left_;
+                return true;
+            }
+
+            /**
+             * Bytes processed by one iteration (for throughput)
+             */
+            inline void set_bytes(uint64_t bytes) {
+                bytes_ = bytes;
+            }
+
+            inline uint64_t iterations() const {
+                return iterations_;
+            }
+
+            inline uint64_t bytes() const {
+                return bytes_;
+            }
+
+            inline uint64_t total_allocations() const {
+                return allocations_;
+            }
+
+            inline std::chrono::steady_clock::duration elapsed() const {
+                return stop_ - start_;
+            }
+
+        private:
+            uint64_t iterations_, left_;
+            uint64_t bytes_ = 0, allocations_ = 0;
+            std::chrono::steady_clock::time_point start_, stop_;
+        };
+
+        typedef std::function<void(State &)> Function;
+
+        /**
+         * Register benchmark. Returns true (for static registration)
+         */
+        bool add(const std::string &name, const Function &function);
+
+        /**
+         * Keep value computed by benchmark from being optimized out
+         */
+        template<class T>
+        inline void keep(const T &value) {
+            asm volatile("" : : "g"(&value) : "memory");
+        }
+    }
+}
+
+/**
+ * Define and register benchmark function `name` with argument `state`
+ */
+#define SCGI_BENCHMARK(name) \
+    static void benchmark_##name(scgi::bench::State &state); \
+    static bool registered_##name = scgi::bench::add(#name, benchmark_##name); \
+    static void benchmark_##name(scgi::bench::State &state)
+
+#endif //SCGI_BENCHMARK_H
@@ -0,0 +1,108 @@
+#include "acceptor.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <algorithm>
+
+namespace scgi {
+
+    // Size of buffer for one read call
+    static const size_t read_chunk = 64 * 1024;
+
+    AsyncAcceptor::AsyncAcceptor(Reactor &reactor, int listen_fd, const Handler &handler)
+            : reactor_(reactor), listen_fd_(listen_fd), handler_(handler), read_buffer_(read_chunk) {
+        set_non_blocking(listen_fd_);
+        spare_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        Reactor::Callback callback = [this](uint32_t) { on_accept(); };
+#ifdef EPOLLEXCLUSIVE
+        // Listening socket may be shared by several reactors: wake only one of them
+        if (reactor_.add(listen_fd_, EPOLLIN | EPOLLEXCLUSIVE, callback)) return;
+#endif
+        reactor_.add(listen_fd_, EPOLLIN, callback);
+    }
+
+    void AsyncAcceptor::on_accept() {
+        while (true) {
+            int client = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if ((errno == EMFILE || errno == ENFILE) && shed()) continue;
+                break;
+            }
+            connections_[client] = parsers_.take(body_limit_);
+            connections_[client]->mark_accepted();
+            if (!reactor_.add(client, EPOLLIN | EPOLLRDHUP, [this, client](uint32_t events) {
+                on_readable(client, events);
+            })) {
+                connections_.erase(client);
+                close(client);
+                continue;
+            }
+            // Data often arrives together with connection
+            on_readable(client, EPOLLIN);
+        }
+    }
+
+    bool AsyncAcceptor::shed() {
+        if (spare_fd_ < 0) spare_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (spare_fd_ < 0) return false;
+        close(spare_fd_);
+        int client = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client >= 0) close(client);
+        spare_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        return client >= 0;
+    }
+
+    void AsyncAcceptor::on_readable(int fd, uint32_t events) {
+        auto iter = connections_.find(fd);
+        if (iter == connections_.end()) return;
+        RequestParser &parser = *(*iter).second;
+        while (!parser.is_done()) {
+            size_t wanted = std::min(parser.wanted(), read_buffer_.size());
+            ssize_t reads = read(fd, read_buffer_.data(), wanted);
+            if (reads < 0 && errno == EINTR) continue;
+            if (reads < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                // Wait for more data unless peer already gone
+                if (events & (EPOLLHUP | EPOLLERR)) drop(fd);
+                return;
+            }
+            if (reads <= 0 || parser.feed(read_buffer_.data(), static_cast<size_t>(reads)) != (size_t) reads ||
+                parser.is_failed()) {
+                drop(fd);
+                return;
+            }
+        }
+        reactor_.remove(fd);
+        set_non_blocking(fd, false);
+        RequestPtr request;
+        if (parser.is_body_buffered()) request = pool_->acquire(fd, request_id_++, parser);
+        else request = std::make_shared<Request>(fd, request_id_++, parser);
+        release(iter);
+        if (request->is_valid() && handler_) handler_(request);
+    }
+
+    void AsyncAcceptor::release(std::unordered_map<int, std::unique_ptr<RequestParser>>::iterator iter) {
+        parsers_.give(std::move((*iter).second));
+        connections_.erase(iter);
+    }
+
+    void AsyncAcceptor::drop(int fd) {
+        reactor_.remove(fd);
+        auto iter = connections_.find(fd);
+        if (iter != connections_.end()) release(iter);
+        close(fd);
+    }
+
+    AsyncAcceptor::~AsyncAcceptor() {
+        for (auto &kv:connections_) {
+            reactor_.remove(kv.first);
+            close(kv.first);
+        }
+        connections_.clear();
+        reactor_.remove(listen_fd_);
+        close(listen_fd_);
+        if (spare_fd_ >= 0) close(spare_fd_);
+    }
+}
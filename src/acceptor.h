@@ -0,0 +1,108 @@
+#ifndef SCGI_ACCEPTOR_H
+#define SCGI_ACCEPTOR_H
+
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <vector>
+#include "scgi.h"
+#include "reactor.h"
+#include "pool.h"
+
+namespace scgi {
+
+    /**
+     * Non-blocking SCGI acceptor driven by `Reactor`. Connections are accepted and parsed incrementally, so slow
+     * or stalled clients never block the loop. Handler is called only when headers (and body, if it is not
+     * bigger then body limit) are completely received. Descriptor of dispatched request is switched back to
+     * blocking mode, so request streams work as usual. Requests with buffered body and parsers are reused
+     * from pools.
+     */
+    struct AsyncAcceptor {
+
+        /**
+         * Functor which receives completely parsed requests
+         */
+        typedef std::function<void(RequestPtr)> Handler;
+
+        /**
+         * Register listening socket `listen_fd` in `reactor`. Acceptor owns listening descriptor
+         */
+        AsyncAcceptor(Reactor &reactor, int listen_fd, const Handler &handler);
+
+        /**
+         * Bodies bigger then `limit` are not buffered and left in descriptor for handler
+         */
+        inline void set_body_limit(size_t limit) {
+            body_limit_ = limit;
+        }
+
+        inline size_t body_limit() const {
+            return body_limit_;
+        }
+
+        /**
+         * Count of connections with partially received requests
+         */
+        inline size_t pending() const {
+            return connections_.size();
+        }
+
+        /**
+         * Listening descriptor
+         */
+        inline int descriptor() const {
+            return listen_fd_;
+        }
+
+        /**
+         * Unregister and close listening socket and all pending connections
+         */
+        ~AsyncAcceptor();
+
+    private:
+        Reactor &reactor_;
+        int listen_fd_;
+        Handler handler_;
+        size_t body_limit_ = 1024 * 1024;
+        uint64_t request_id_ = 0;
+        std::unordered_map<int, std::unique_ptr<RequestParser>> connections_;
+        std::vector<char> read_buffer_;
+        RequestPool::Ptr pool_ = RequestPool::create();
+        ParserCache parsers_;
+        // Reserved descriptor which is freed to shed connection when process is out of descriptors
+        int spare_fd_ = -1;
+
+        /**
+         * Accept all pending connections
+         */
+        void on_accept();
+
+        /**
+         * Accept pending connection by reserved descriptor and close it at once. Listening socket stays readable
+         * while descriptors are exhausted, so leaving connection in backlog would spin the loop.
+         * Returns false if connection can't be accepted
+         */
+        bool shed();
+
+        /**
+         * Read available data of connection and dispatch request if it is complete
+         */
+        void on_readable(int fd, uint32_t events);
+
+        /**
+         * Forget connection and keep its parser for next connections
+         */
+        void release(std::unordered_map<int, std::unique_ptr<RequestParser>>::iterator iter);
+
+        /**
+         * Unregister and close connection
+         */
+        void drop(int fd);
+
+        AsyncAcceptor(const AsyncAcceptor &) = delete;
+
+        AsyncAcceptor &operator=(const AsyncAcceptor &) = delete;
+    };
+}
+#endif //SCGI_ACCEPTOR_H
@@ -0,0 +1,76 @@
+#include "admission.h"
+#include <algorithm>
+
+namespace scgi {
+
+    // Initial limit of adaptive mode without upper bound
+    static const size_t default_adaptive_limit = 64;
+
+    static const char unavailable[] = "Status: 503 Service Unavailable\r\n"
+            "Content-Type: text/plain\r\n"
+            "Retry-After: 1\r\n"
+            "\r\n"
+            "Service is overloaded\n";
+
+    AdmissionControl::Ptr AdmissionControl::create(const Limits &limits) {
+        return Ptr(new AdmissionControl(limits));
+    }
+
+    AdmissionControl::AdmissionControl(const Limits &limits) : limits_(limits) {
+        size_t limit = limits_.max_in_flight;
+        if (limits_.adaptive && limit == 0) limit = std::max(default_adaptive_limit, limits_.min_in_flight);
+        limit_ = limit;
+    }
+
+    bool AdmissionControl::enqueue(size_t queued) {
+        if (limits_.max_queued == 0 || queued < limits_.max_queued) return true;
+        ++rejected_;
+        return false;
+    }
+
+    bool AdmissionControl::admit(scgi::RequestPtr request) {
+        auto now = std::chrono::steady_clock::now();
+        if (limits_.max_queue_wait.count() > 0 && now - request->received() > limits_.max_queue_wait) {
+            ++rejected_;
+            return false;
+        }
+        size_t limit = limit_;
+        size_t in_flight = ++in_flight_;
+        if (limit > 0 && in_flight > limit) {
+            --in_flight_;
+            ++rejected_;
+            return false;
+        }
+        // Raw pointer keeps callback in place inside std::function (no allocation per request)
+        AdmissionControl *self = this;
+        request->on_complete([self](const Request &done) {
+            self->release(std::chrono::steady_clock::now() - done.received());
+        });
+        return true;
+    }
+
+    void AdmissionControl::release(std::chrono::steady_clock::duration latency) {
+        --in_flight_;
+        if (!limits_.adaptive) return;
+        std::lock_guard<std::mutex> lock(adapt_lock_);
+        size_t limit = limit_;
+        if (latency > limits_.target_latency) {
+            // Multiplicative decrease once per interval: requests started before backoff are slow too
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_backoff_ < limits_.target_latency) return;
+            last_backoff_ = now;
+            growth_ = 0;
+            limit = static_cast<size_t>(static_cast<double>(limit) * limits_.backoff);
+            limit_ = std::max(limit, std::max<size_t>(limits_.min_in_flight, 1));
+            return;
+        }
+        // Additive increase: one per `limit` fast requests
+        if (++growth_ < limit) return;
+        growth_ = 0;
+        if (limits_.max_in_flight == 0 || limit < limits_.max_in_flight) limit_ = limit + 1;
+    }
+
+    StringRef AdmissionControl::unavailable_response() {
+        return StringRef(unavailable, sizeof(unavailable) - 1);
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef SCGI_ADMISSION_H
+#define SCGI_ADMISSION_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include "scgi.h"
+
+namespace scgi {
+
+    /**
+     * Bounds outstanding work of dispatcher: requests waiting for processing in strategy queue and requests
+     * being processed (in-flight, till request is released). Rejected requests should be answered at once by
+     * `unavailable_response`, so clients fail fast instead of waiting in listen backlog.
+     * In adaptive mode in-flight limit is tuned by AIMD from latency of completed requests: it grows by one per
+     * window of `limit` fast requests and is decreased by `backoff` when latency exceeds target (at most once
+     * per target interval). Must outlive requests admitted by it. Thread-safe
+     */
+    class AdmissionControl {
+    public:
+        typedef std::shared_ptr<AdmissionControl> Ptr;
+
+        struct Limits {
+            /**
+             * Maximum requests in processing. Zero means unlimited (initial limit 64 in adaptive mode)
+             */
+            size_t max_in_flight = 0;
+            /**
+             * Maximum requests waiting for processing. Zero means unlimited
+             */
+            size_t max_queued = 0;
+            /**
+             * Requests which waited longer (from receiving) are rejected when processing starts. Zero disables
+             */
+            std::chrono::milliseconds max_queue_wait{0};
+            /**
+             * Tune in-flight limit from observed latency
+             */
+            bool adaptive = false;
+            /**
+             * Latency (from receiving till release) which adaptive mode keeps
+             */
+            std::chrono::milliseconds target_latency{100};
+            /**
+             * Lower bound of adaptive limit
+             */
+            size_t min_in_flight = 1;
+            /**
+             * Multiplier of adaptive limit on slow request
+             */
+            double backoff = 0.9;
+        };
+
+        static Ptr create(const Limits &limits);
+
+        /**
+         * Can new request wait in queue where `queued` requests are already waiting
+         */
+        bool enqueue(size_t queued);
+
+        /**
+         * Start processing of `request`: checks queue wait and in-flight limit. Admitted request is counted
+         * till it is released. Returns false if request should be rejected
+         */
+        bool admit(scgi::RequestPtr request);
+
+        inline size_t in_flight() const {
+            return in_flight_;
+        }
+
+        /**
+         * Current in-flight limit (zero - unlimited)
+         */
+        inline size_t limit() const {
+            return limit_;
+        }
+
+        inline uint64_t rejected() const {
+            return rejected_;
+        }
+
+        inline const Limits &limits() const {
+            return limits_;
+        }
+
+        /**
+         * Pre-built `503 Service Unavailable` response
+         */
+        static StringRef unavailable_response();
+
+    private:
+        Limits limits_;
+        std::atomic<size_t> in_flight_{0}, limit_{0};
+        std::atomic<uint64_t> rejected_{0};
+        std::mutex adapt_lock_;
+        // Fast requests since last change of adaptive limit
+        size_t growth_ = 0;
+        std::chrono::steady_clock::time_point last_backoff_;
+
+        explicit AdmissionControl(const Limits &limits);
+
+        /**
+         * Request is released: update counters and adaptive limit
+         */
+        void release(std::chrono::steady_clock::duration latency);
+
+        AdmissionControl(const AdmissionControl &) = delete;
+
+        AdmissionControl &operator=(const AdmissionControl &) = delete;
+    };
+}
+#endif //SCGI_ADMISSION_H
@@ -0,0 +1,34 @@
+#include "arena.h"
+#include <algorithm>
+#include <cstring>
+
+namespace scgi {
+
+    void *Arena::allocate_slow(size_t size, size_t align) {
+        // Skip to next kept block which is big enough
+        size_t next = blocks_.empty() ? 0 : current_ + 1;
+        for (; next < blocks_.size(); ++next) {
+            if (blocks_[next].size >= size + align) break;
+        }
+        if (next == blocks_.size()) {
+            size_t block_size = std::max(block_size_, size + align);
+            blocks_.push_back(Block{std::unique_ptr<char[]>(new char[block_size]), block_size});
+        }
+        current_ = next;
+        offset_ = 0;
+        return allocate(size, align);
+    }
+
+    char *Arena::copy(const char *data, size_t size) {
+        char *result = static_cast<char *>(allocate(size + 1, 1));
+        if (size > 0) std::memcpy(result, data, size);
+        result[size] = '\0';
+        return result;
+    }
+
+    size_t Arena::capacity() const {
+        size_t total = 0;
+        for (auto &block:blocks_) total += block.size;
+        return total;
+    }
+}
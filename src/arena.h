@@ -0,0 +1,103 @@
+#ifndef SCGI_ARENA_H
+#define SCGI_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <string>
+
+namespace scgi {
+
+    /**
+     * Monotonic allocator: memory is taken from big blocks and is released all at once by `reset`.
+     * Blocks are kept after reset, so reused arena doesn't touch heap in steady state. Not thread-safe
+     */
+    class Arena {
+    public:
+        explicit Arena(size_t block_size = 16 * 1024) : block_size_(block_size) { }
+
+        /**
+         * Allocate `size` bytes aligned by `align` (power of two)
+         */
+        inline void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+            if (current_ < blocks_.size()) {
+                Block &block = blocks_[current_];
+                uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+                size_t offset = static_cast<size_t>(((base + offset_ + align - 1) & ~(uintptr_t) (align - 1)) - base);
+                if (offset + size <= block.size) {
+                    offset_ = offset + size;
+                    return block.data.get() + offset;
+                }
+            }
+            return allocate_slow(size, align);
+        }
+
+        /**
+         * Copy chars to arena. Returned memory is null-terminated
+         */
+        char *copy(const char *data, size_t size);
+
+        /**
+         * Release all allocations in O(1). Memory is kept for next allocations
+         */
+        inline void reset() {
+            current_ = 0;
+            offset_ = 0;
+        }
+
+        /**
+         * Total size of blocks
+         */
+        size_t capacity() const;
+
+    private:
+        struct Block {
+            std::unique_ptr<char[]> data;
+            size_t size;
+        };
+
+        size_t block_size_;
+        std::vector<Block> blocks_;
+        size_t current_ = 0;
+        size_t offset_ = 0;
+
+        void *allocate_slow(size_t size, size_t align);
+
+        Arena(const Arena &) = delete;
+
+        Arena &operator=(const Arena &) = delete;
+    };
+
+    /**
+     * STL allocator over arena. Deallocation does nothing: memory returns on arena reset
+     */
+    template<class T>
+    struct ArenaAllocator {
+        typedef T value_type;
+
+        Arena *arena;
+
+        explicit ArenaAllocator(Arena &arena_) : arena(&arena_) { }
+
+        template<class U>
+        ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) { }
+
+        inline T *allocate(size_t n) {
+            return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+
+        inline void deallocate(T *, size_t) { }
+
+        template<class U>
+        inline bool operator==(const ArenaAllocator<U> &other) const {
+            return arena == other.arena;
+        }
+
+        template<class U>
+        inline bool operator!=(const ArenaAllocator<U> &other) const {
+            return arena != other.arena;
+        }
+    };
+}
+#endif //SCGI_ARENA_H
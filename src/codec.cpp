@@ -0,0 +1,656 @@
+#include "codec.h"
+#include "http.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <strings.h>
+
+namespace scgi {
+    namespace service {
+
+        static const std::string msgpack_type = "application/msgpack";
+        static const std::string cbor_type = "application/cbor";
+
+        /**
+         * Media type of one item of CONTENT_TYPE or HTTP_ACCEPT without parameters and spaces
+         */
+        static inline StringRef media_type(const char *begin, const char *end) {
+            while (begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+            const char *stop = begin;
+            while (stop < end && *stop != ';' && *stop != ' ' && *stop != '\t') ++stop;
+            return StringRef(begin, static_cast<size_t>(stop - begin));
+        }
+
+        static inline bool same_type(const StringRef &type, const char *name) {
+            size_t size = std::strlen(name);
+            return type.size == size && strncasecmp(type.data, name, size) == 0;
+        }
+
+        /**
+         * Codec of media type. Returns false for not supported types
+         */
+        static bool find_codec(const StringRef &type, Codec &codec) {
+            if (same_type(type, "application/json")) {
+                codec = Codec::Json;
+            } else if (same_type(type, "application/msgpack") || same_type(type, "application/x-msgpack") ||
+                       same_type(type, "application/vnd.msgpack")) {
+                codec = Codec::MessagePack;
+            } else if (same_type(type, "application/cbor")) {
+                codec = Codec::Cbor;
+            } else {
+                return false;
+            }
+            return true;
+        }
+
+        Codec request_codec(const StringRef &content_type) {
+            Codec codec = Codec::Json;
+            if (!content_type.empty()) find_codec(media_type(content_type.begin(), content_type.end()), codec);
+            return codec;
+        }
+
+        Codec response_codec(const StringRef &accept) {
+            const char *ptr = accept.begin(), *end = accept.end();
+            while (ptr < end) {
+                auto comma = static_cast<const char *>(std::memchr(ptr, ',', static_cast<size_t>(end - ptr)));
+                if (comma == nullptr) comma = end;
+                Codec codec;
+                StringRef type = media_type(ptr, comma);
+                // Explicitly refused type (q=0)
+                bool refused = false;
+                for (const char *q = type.end(); q + 2 < comma; ++q) {
+                    if (q[0] != 'q' || q[1] != '=') continue;
+                    const char *digit = q + 2;
+                    while (digit < comma && (*digit == '0' || *digit == '.')) ++digit;
+                    refused = digit == comma || *digit == ' ' || *digit == ';';
+                    break;
+                }
+                if (!refused && find_codec(type, codec)) return codec;
+                ptr = comma + 1;
+            }
+            return Codec::Json;
+        }
+
+        const std::string &content_type(Codec codec) {
+            switch (codec) {
+                case Codec::MessagePack:
+                    return msgpack_type;
+                case Codec::Cbor:
+                    return cbor_type;
+                default:
+                    return scgi::http::content_type::application_json;
+            }
+        }
+
+        /**
+         * Big-endian numbers over raw stream buffer
+         */
+        class BinaryWriter {
+        public:
+            explicit BinaryWriter(std::streambuf &out) : out_(out) { }
+
+        protected:
+            std::streambuf &out_;
+
+            inline void put(uint8_t byte) {
+                out_.sputc(static_cast<char>(byte));
+            }
+
+            inline void put(uint8_t byte, uint64_t number, size_t size) {
+                char buffer[9];
+                buffer[0] = static_cast<char>(byte);
+                for (size_t i = 0; i < size; ++i)
+                    buffer[size - i] = static_cast<char>((number >> (8 * i)) & 0xFF);
+                out_.sputn(buffer, static_cast<std::streamsize>(size + 1));
+            }
+
+            inline void put(const char *data, size_t size) {
+                out_.sputn(data, static_cast<std::streamsize>(size));
+            }
+
+            inline void put_real(uint8_t byte, double number) {
+                uint64_t bits;
+                std::memcpy(&bits, &number, sizeof(bits));
+                put(byte, bits, 8);
+            }
+        };
+
+        class MessagePackWriter : public BinaryWriter {
+        public:
+            explicit MessagePackWriter(std::streambuf &out) : BinaryWriter(out) { }
+
+            void write(const Json::Value &value) {
+                switch (value.type()) {
+                    case Json::nullValue:
+                        put(0xc0);
+                        break;
+                    case Json::booleanValue:
+                        put(value.asBool() ? 0xc3 : 0xc2);
+                        break;
+                    case Json::intValue: {
+                        Json::Int64 number = value.asInt64();
+                        if (number >= 0) write_unsigned(static_cast<uint64_t>(number)); else write_negative(number);
+                        break;
+                    }
+                    case Json::uintValue:
+                        write_unsigned(value.asUInt64());
+                        break;
+                    case Json::realValue:
+                        put_real(0xcb, value.asDouble());
+                        break;
+                    case Json::stringValue: {
+                        const char *begin = nullptr, *end = nullptr;
+                        value.getString(&begin, &end);
+                        write_string(begin, static_cast<size_t>(end - begin));
+                        break;
+                    }
+                    case Json::arrayValue: {
+                        Json::ArrayIndex size = value.size();
+                        write_size(size, 0x90, 0xdc);
+                        for (Json::ArrayIndex i = 0; i < size; ++i) write(value[i]);
+                        break;
+                    }
+                    case Json::objectValue: {
+                        write_size(value.size(), 0x80, 0xde);
+                        for (auto iter = value.begin(); iter != value.end(); ++iter) {
+                            const char *end = nullptr;
+                            const char *name = iter.memberName(&end);
+                            write_string(name, static_cast<size_t>(end - name));
+                            write(*iter);
+                        }
+                        break;
+                    }
+                }
+            }
+
+        private:
+            void write_unsigned(uint64_t number) {
+                if (number < 0x80) put(static_cast<uint8_t>(number));
+                else if (number <= 0xFF) put(0xcc, number, 1);
+                else if (number <= 0xFFFF) put(0xcd, number, 2);
+                else if (number <= 0xFFFFFFFF) put(0xce, number, 4);
+                else put(0xcf, number, 8);
+            }
+
+            void write_negative(int64_t number) {
+                uint64_t bits = static_cast<uint64_t>(number);
+                if (number >= -32) put(static_cast<uint8_t>(bits & 0xFF));
+                else if (number >= INT8_MIN) put(0xd0, bits, 1);
+                else if (number >= INT16_MIN) put(0xd1, bits, 2);
+                else if (number >= INT32_MIN) put(0xd2, bits, 4);
+                else put(0xd3, bits, 8);
+            }
+
+            void write_string(const char *data, size_t size) {
+                if (size < 32) put(static_cast<uint8_t>(0xa0 | size));
+                else if (size <= 0xFF) put(0xd9, size, 1);
+                else if (size <= 0xFFFF) put(0xda, size, 2);
+                else put(0xdb, size, 4);
+                put(data, size);
+            }
+
+            /**
+             * Header of array or map: fix type for up to 15 items, then 16 and 32 bit sizes
+             */
+            void write_size(size_t size, uint8_t fix, uint8_t wide) {
+                if (size < 16) put(static_cast<uint8_t>(fix | size));
+                else if (size <= 0xFFFF) put(wide, size, 2);
+                else put(static_cast<uint8_t>(wide + 1), size, 4);
+            }
+        };
+
+        class CborWriter : public BinaryWriter {
+        public:
+            explicit CborWriter(std::streambuf &out) : BinaryWriter(out) { }
+
+            void write(const Json::Value &value) {
+                switch (value.type()) {
+                    case Json::nullValue:
+                        put(0xf6);
+                        break;
+                    case Json::booleanValue:
+                        put(value.asBool() ? 0xf5 : 0xf4);
+                        break;
+                    case Json::intValue: {
+                        Json::Int64 number = value.asInt64();
+                        // Negative number -1-n is stored as n
+                        if (number >= 0) head(0, static_cast<uint64_t>(number));
+                        else head(1, static_cast<uint64_t>(-(number + 1)));
+                        break;
+                    }
+                    case Json::uintValue:
+                        head(0, value.asUInt64());
+                        break;
+                    case Json::realValue:
+                        put_real(0xfb, value.asDouble());
+                        break;
+                    case Json::stringValue: {
+                        const char *begin = nullptr, *end = nullptr;
+                        value.getString(&begin, &end);
+                        head(3, static_cast<uint64_t>(end - begin));
+                        put(begin, static_cast<size_t>(end - begin));
+                        break;
+                    }
+                    case Json::arrayValue: {
+                        Json::ArrayIndex size = value.size();
+                        head(4, size);
+                        for (Json::ArrayIndex i = 0; i < size; ++i) write(value[i]);
+                        break;
+                    }
+                    case Json::objectValue: {
+                        head(5, value.size());
+                        for (auto iter = value.begin(); iter != value.end(); ++iter) {
+                            const char *end = nullptr;
+                            const char *name = iter.memberName(&end);
+                            head(3, static_cast<uint64_t>(end - name));
+                            put(name, static_cast<size_t>(end - name));
+                            write(*iter);
+                        }
+                        break;
+                    }
+                }
+            }
+
+        private:
+            /**
+             * Initial byte of major type with shortest encoding of argument
+             */
+            void head(uint8_t major, uint64_t argument) {
+                uint8_t type = static_cast<uint8_t>(major << 5);
+                if (argument < 24) put(static_cast<uint8_t>(type | argument));
+                else if (argument <= 0xFF) put(type | 24, argument, 1);
+                else if (argument <= 0xFFFF) put(type | 25, argument, 2);
+                else if (argument <= 0xFFFFFFFF) put(type | 26, argument, 4);
+                else put(type | 27, argument, 8);
+            }
+        };
+
+        /**
+         * Bounds checked cursor over binary document
+         */
+        class BinaryReader {
+        public:
+            BinaryReader(const char *data, size_t size, size_t max_depth)
+                    : ptr_(reinterpret_cast<const uint8_t *>(data)), end_(ptr_ + size), max_depth_(max_depth) { }
+
+            inline bool at_end() const {
+                return ptr_ == end_;
+            }
+
+        protected:
+            const uint8_t *ptr_, *end_;
+            size_t max_depth_;
+            // Key of current map item. Reused to avoid temporary values
+            std::string key_;
+
+            inline size_t left() const {
+                return static_cast<size_t>(end_ - ptr_);
+            }
+
+            inline bool byte(uint8_t &result) {
+                if (ptr_ == end_) return false;
+                result = *ptr_++;
+                return true;
+            }
+
+            inline bool number(size_t size, uint64_t &result) {
+                if (left() < size) return false;
+                result = 0;
+                for (size_t i = 0; i < size; ++i) result = (result << 8) | ptr_[i];
+                ptr_ += size;
+                return true;
+            }
+
+            inline bool string(uint64_t size, Json::Value &value) {
+                if (left() < size) return false;
+                const char *begin = reinterpret_cast<const char *>(ptr_);
+                value = Json::Value(begin, begin + size);
+                ptr_ += size;
+                return true;
+            }
+
+            /**
+             * Copy `size` bytes of map key into `key_`
+             */
+            inline bool take_key(uint64_t size) {
+                if (left() < size) return false;
+                key_.assign(reinterpret_cast<const char *>(ptr_), size);
+                ptr_ += size;
+                return true;
+            }
+
+            static inline double real(uint64_t bits) {
+                double result;
+                std::memcpy(&result, &bits, sizeof(result));
+                return result;
+            }
+
+            static inline double real32(uint64_t bits) {
+                uint32_t narrow = static_cast<uint32_t>(bits);
+                float result;
+                std::memcpy(&result, &narrow, sizeof(result));
+                return result;
+            }
+
+            static inline Json::Value signed_value(int64_t number) {
+                return Json::Value(static_cast<Json::Int64>(number));
+            }
+
+            /**
+             * Integer as JSON reader makes it: unsigned if it doesn't fit `int`
+             */
+            static inline Json::Value unsigned_value(uint64_t number) {
+                if (number <= static_cast<uint64_t>(Json::Value::maxInt))
+                    return Json::Value(static_cast<Json::Int64>(number));
+                return Json::Value(static_cast<Json::UInt64>(number));
+            }
+        };
+
+        class MessagePackReader : public BinaryReader {
+        public:
+            using BinaryReader::BinaryReader;
+
+            bool read(Json::Value &value, size_t depth) {
+                uint8_t type;
+                uint64_t argument;
+                if (!byte(type)) return false;
+                if (type < 0x80) {
+                    value = unsigned_value(type);
+                    return true;
+                }
+                if (type >= 0xe0) {
+                    value = signed_value(static_cast<int8_t>(type));
+                    return true;
+                }
+                if (type >= 0xa0 && type <= 0xbf) return string(type & 0x1F, value);
+                if (type >= 0x90 && type <= 0x9f) return array(type & 0x0F, value, depth);
+                if (type >= 0x80 && type <= 0x8f) return map(type & 0x0F, value, depth);
+                switch (type) {
+                    case 0xc0:
+                        value = Json::Value();
+                        return true;
+                    case 0xc2:
+                    case 0xc3:
+                        value = Json::Value(type == 0xc3);
+                        return true;
+                    case 0xc4:
+                    case 0xd9:
+                        return number(1, argument) && string(argument, value);
+                    case 0xc5:
+                    case 0xda:
+                        return number(2, argument) && string(argument, value);
+                    case 0xc6:
+                    case 0xdb:
+                        return number(4, argument) && string(argument, value);
+                    case 0xca:
+                        if (!number(4, argument)) return false;
+                        value = Json::Value(real32(argument));
+                        return true;
+                    case 0xcb:
+                        if (!number(8, argument)) return false;
+                        value = Json::Value(real(argument));
+                        return true;
+                    case 0xcc:
+                    case 0xcd:
+                    case 0xce:
+                    case 0xcf:
+                        if (!number(size_t(1) << (type - 0xcc), argument)) return false;
+                        value = unsigned_value(argument);
+                        return true;
+                    case 0xd0:
+                        if (!number(1, argument)) return false;
+                        value = signed_value(static_cast<int8_t>(argument));
+                        return true;
+                    case 0xd1:
+                        if (!number(2, argument)) return false;
+                        value = signed_value(static_cast<int16_t>(argument));
+                        return true;
+                    case 0xd2:
+                        if (!number(4, argument)) return false;
+                        value = signed_value(static_cast<int32_t>(argument));
+                        return true;
+                    case 0xd3:
+                        if (!number(8, argument)) return false;
+                        value = signed_value(static_cast<int64_t>(argument));
+                        return true;
+                    case 0xdc:
+                        return number(2, argument) && array(argument, value, depth);
+                    case 0xdd:
+                        return number(4, argument) && array(argument, value, depth);
+                    case 0xde:
+                        return number(2, argument) && map(argument, value, depth);
+                    case 0xdf:
+                        return number(4, argument) && map(argument, value, depth);
+                    default:
+                        // Extensions and reserved type
+                        return false;
+                }
+            }
+
+        private:
+            bool array(uint64_t size, Json::Value &value, size_t depth) {
+                // Each item takes at least one byte: don't trust size before allocation
+                if (depth >= max_depth_ || size > left()) return false;
+                value = Json::Value(Json::arrayValue);
+                if (size > 0) value.resize(static_cast<Json::ArrayIndex>(size));
+                for (Json::ArrayIndex i = 0; i < size; ++i) {
+                    if (!read(value[i], depth + 1)) return false;
+                }
+                return true;
+            }
+
+            bool map(uint64_t size, Json::Value &value, size_t depth) {
+                if (depth >= max_depth_ || size > left() / 2) return false;
+                value = Json::Value(Json::objectValue);
+                for (uint64_t i = 0; i < size; ++i) {
+                    if (!key() || !read(value[key_], depth + 1)) return false;
+                }
+                return true;
+            }
+
+            /**
+             * Read string or binary map key
+             */
+            bool key() {
+                uint8_t type;
+                uint64_t size;
+                if (!byte(type)) return false;
+                if (type >= 0xa0 && type <= 0xbf) return take_key(type & 0x1F);
+                switch (type) {
+                    case 0xc4:
+                    case 0xd9:
+                        return number(1, size) && take_key(size);
+                    case 0xc5:
+                    case 0xda:
+                        return number(2, size) && take_key(size);
+                    case 0xc6:
+                    case 0xdb:
+                        return number(4, size) && take_key(size);
+                    default:
+                        return false;
+                }
+            }
+        };
+
+        class CborReader : public BinaryReader {
+        public:
+            using BinaryReader::BinaryReader;
+
+            bool read(Json::Value &value, size_t depth) {
+                uint8_t type;
+                if (!byte(type)) return false;
+                uint8_t major = type >> 5, info = type & 0x1F;
+                uint64_t argument = 0;
+                bool indefinite = info == 31;
+                // Only strings, arrays and maps may have indefinite length (break is consumed by containers)
+                if (indefinite && (major < 2 || major > 5)) return false;
+                if (!indefinite && !read_argument(info, argument)) return false;
+                switch (major) {
+                    case 0:
+                        value = unsigned_value(argument);
+                        return true;
+                    case 1:
+                        if (argument > static_cast<uint64_t>(INT64_MAX)) return false;
+                        value = signed_value(-1 - static_cast<int64_t>(argument));
+                        return true;
+                    case 2:
+                    case 3:
+                        if (!indefinite) return string(argument, value);
+                        return chunks(major, value);
+                    case 4:
+                        return array(indefinite, argument, value, depth);
+                    case 5:
+                        return map(indefinite, argument, value, depth);
+                    case 6:
+                        // Tags are ignored, tagged item is decoded as is
+                        return depth < max_depth_ && read(value, depth + 1);
+                    default:
+                        return simple(info, argument, value);
+                }
+            }
+
+        private:
+            inline bool read_argument(uint8_t info, uint64_t &argument) {
+                if (info < 24) {
+                    argument = info;
+                    return true;
+                }
+                if (info > 27) return false;
+                return number(size_t(1) << (info - 24), argument);
+            }
+
+            /**
+             * End of indefinite item
+             */
+            inline bool is_break() {
+                if (ptr_ == end_ || *ptr_ != 0xff) return false;
+                ++ptr_;
+                return true;
+            }
+
+            /**
+             * Indefinite string: definite strings of same major type till break
+             */
+            bool chunks(uint8_t major, Json::Value &value) {
+                std::string result;
+                while (!is_break()) {
+                    uint8_t type;
+                    uint64_t size;
+                    if (!byte(type) || type >> 5 != major || !read_argument(type & 0x1F, size) || left() < size)
+                        return false;
+                    result.append(reinterpret_cast<const char *>(ptr_), size);
+                    ptr_ += size;
+                }
+                value = Json::Value(result);
+                return true;
+            }
+
+            bool array(bool indefinite, uint64_t size, Json::Value &value, size_t depth) {
+                if (depth >= max_depth_ || (!indefinite && size > left())) return false;
+                value = Json::Value(Json::arrayValue);
+                if (indefinite) {
+                    while (!is_break()) {
+                        if (!read(value[value.size()], depth + 1)) return false;
+                    }
+                    return true;
+                }
+                if (size > 0) value.resize(static_cast<Json::ArrayIndex>(size));
+                for (Json::ArrayIndex i = 0; i < size; ++i) {
+                    if (!read(value[i], depth + 1)) return false;
+                }
+                return true;
+            }
+
+            bool map(bool indefinite, uint64_t size, Json::Value &value, size_t depth) {
+                if (depth >= max_depth_ || (!indefinite && size > left() / 2)) return false;
+                value = Json::Value(Json::objectValue);
+                for (uint64_t i = 0; indefinite || i < size; ++i) {
+                    if (indefinite && is_break()) break;
+                    if (!key(depth) || !read(value[key_], depth + 1)) return false;
+                }
+                return true;
+            }
+
+            /**
+             * Read text or byte string map key
+             */
+            bool key(size_t depth) {
+                if (ptr_ == end_) return false;
+                uint8_t major = *ptr_ >> 5, info = *ptr_ & 0x1F;
+                if (major != 2 && major != 3) return false;
+                if (info != 31) {
+                    uint64_t size;
+                    ++ptr_;
+                    return read_argument(info, size) && take_key(size);
+                }
+                Json::Value chunked;
+                if (!read(chunked, depth + 1)) return false;
+                key_ = chunked.asString();
+                return true;
+            }
+
+            bool simple(uint8_t info, uint64_t argument, Json::Value &value) {
+                switch (info) {
+                    case 20:
+                    case 21:
+                        value = Json::Value(info == 21);
+                        return true;
+                    case 22:
+                    case 23:
+                        // null and undefined
+                        value = Json::Value();
+                        return true;
+                    case 25:
+                        value = Json::Value(half(static_cast<uint16_t>(argument)));
+                        return true;
+                    case 26:
+                        value = Json::Value(real32(argument));
+                        return true;
+                    case 27:
+                        value = Json::Value(real(argument));
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+
+            static double half(uint16_t bits) {
+                int exponent = (bits >> 10) & 0x1F;
+                double mantissa = bits & 0x3FF;
+                double result;
+                if (exponent == 0) result = std::ldexp(mantissa, -24);
+                else if (exponent == 31) result = mantissa == 0 ? INFINITY : NAN;
+                else result = std::ldexp(mantissa + 1024, exponent - 25);
+                return bits & 0x8000 ? -result : result;
+            }
+        };
+
+        bool read_binary(Codec codec, const char *data, size_t size, Json::Value &value, size_t max_depth) {
+            switch (codec) {
+                case Codec::MessagePack: {
+                    MessagePackReader reader(data, size, max_depth);
+                    return reader.read(value, 0) && reader.at_end();
+                }
+                case Codec::Cbor: {
+                    CborReader reader(data, size, max_depth);
+                    return reader.read(value, 0) && reader.at_end();
+                }
+                default:
+                    return false;
+            }
+        }
+
+        void write_value(std::streambuf &out, const Json::Value &value, Codec codec, JsonStyle style) {
+            switch (codec) {
+                case Codec::MessagePack:
+                    MessagePackWriter(out).write(value);
+                    break;
+                case Codec::Cbor:
+                    CborWriter(out).write(value);
+                    break;
+                default:
+                    write_json(out, value, style);
+            }
+        }
+    }
+}
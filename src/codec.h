@@ -0,0 +1,55 @@
+#ifndef SCGI_CODEC_H
+#define SCGI_CODEC_H
+
+#include <streambuf>
+#include <string>
+#include <jsoncpp/json/value.h>
+#include "headers.h"
+#include "json_writer.h"
+
+namespace scgi {
+    namespace service {
+
+        /**
+         * Wire format of payload. Binary formats are decoded to the same `Json::Value` as JSON text, so
+         * handlers don't depend on format
+         */
+        enum class Codec {
+            Json,
+            // application/msgpack (also application/x-msgpack, application/vnd.msgpack)
+            MessagePack,
+            // application/cbor
+            Cbor
+        };
+
+        /**
+         * Format of request body by CONTENT_TYPE. JSON for other or missed type
+         */
+        Codec request_codec(const StringRef &content_type);
+
+        /**
+         * Format of response by HTTP_ACCEPT: first of supported binary types mentioned in header, otherwise (or
+         * if JSON is mentioned before them) JSON
+         */
+        Codec response_codec(const StringRef &accept);
+
+        /**
+         * Content type of responses in format
+         */
+        const std::string &content_type(Codec codec);
+
+        /**
+         * Decode binary (MessagePack or CBOR) document from `size` bytes of `data`. Map keys must be strings,
+         * binary strings are decoded as strings. Returns false on malformed or truncated data, unsupported
+         * items (extensions) or nesting deeper than `max_depth`
+         */
+        bool read_binary(Codec codec, const char *data, size_t size, Json::Value &value, size_t max_depth = 256);
+
+        /**
+         * Serialize `value` in format `codec` into stream buffer. Style is used only by JSON
+         */
+        void write_value(std::streambuf &out, const Json::Value &value, Codec codec,
+                         JsonStyle style = JsonStyle::Compact);
+    }
+}
+#endif //SCGI_CODEC_H
@@ -0,0 +1,150 @@
+#ifndef SCGI_COROUTINE_H
+#define SCGI_COROUTINE_H
+
+#include "service.h"
+#include "reactor.h"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <exception>
+#include <sys/epoll.h>
+
+#define SCGI_HAS_COROUTINES 1
+
+namespace scgi {
+    namespace service {
+
+        /**
+         * Return type of coroutine method `AsyncMethod(scgi::RequestPtr, Json::Value)`. Coroutine is started by
+         * dispatcher and holds request by deferred completion (see `defer`): `co_return value` sends JSON result,
+         * exception sends error. Request parameters should be taken by value: coroutine outlives dispatching
+         */
+        class AsyncMethod {
+        public:
+            struct promise_type {
+                Deferred deferred;
+
+                inline AsyncMethod get_return_object() {
+                    return AsyncMethod(std::coroutine_handle<promise_type>::from_promise(*this));
+                }
+
+                inline std::suspend_always initial_suspend() noexcept {
+                    return {};
+                }
+
+                inline std::suspend_never final_suspend() noexcept {
+                    return {};
+                }
+
+                inline void return_value(const Json::Value &value) {
+                    deferred.resolve(value);
+                }
+
+                inline void unhandled_exception() {
+                    try {
+                        throw;
+                    } catch (std::exception &ex) {
+                        deferred.reject(ex.what());
+                    } catch (...) {
+                        deferred.reject("Unknown error");
+                    }
+                }
+            };
+
+            AsyncMethod(AsyncMethod &&other) noexcept : handle_(other.handle_) {
+                other.handle_ = nullptr;
+            }
+
+            /**
+             * Run coroutine till first suspension. Coroutine frame is released by itself when it finishes
+             */
+            inline void start(scgi::RequestPtr request) {
+                std::coroutine_handle<promise_type> handle = handle_;
+                handle_ = nullptr;
+                handle.promise().deferred = defer(request);
+                handle.resume();
+            }
+
+            ~AsyncMethod() {
+                if (handle_) handle_.destroy();
+            }
+
+        private:
+            std::coroutine_handle<promise_type> handle_;
+
+            explicit AsyncMethod(std::coroutine_handle<promise_type> handle) : handle_(handle) { }
+
+            AsyncMethod(const AsyncMethod &) = delete;
+
+            AsyncMethod &operator=(const AsyncMethod &) = delete;
+        };
+
+        /**
+         * Processor which starts coroutine method. Use as `register_method(name).set_processor(...)`
+         */
+        template<class Function>
+        inline ServiceHandler::MethodType async_method(Function function) {
+            return [function](scgi::RequestPtr request, const Json::Value &value) {
+                AsyncMethod method = function(request, Json::Value(value));
+                method.start(request);
+                return true;
+            };
+        }
+
+        /**
+         * Awaitable readiness of descriptor. Descriptor is registered in reactor (by loop thread) for one event
+         * and coroutine is resumed in loop thread. Descriptor must not be registered in reactor by others.
+         * Result of `co_await` is mask of EPOLL* events (EPOLLERR if registration failed)
+         */
+        class Readiness {
+        public:
+            Readiness(Reactor &reactor, int fd, uint32_t events)
+                    : reactor_(reactor), fd_(fd), events_(events) { }
+
+            inline bool await_ready() const noexcept {
+                return false;
+            }
+
+            inline void await_suspend(std::coroutine_handle<> handle) {
+                reactor_.post([this, handle]() {
+                    bool added = reactor_.add(fd_, events_, [this, handle](uint32_t events) {
+                        reactor_.remove(fd_);
+                        result_ = events;
+                        handle.resume();
+                    });
+                    if (!added) {
+                        result_ = EPOLLERR;
+                        handle.resume();
+                    }
+                });
+            }
+
+            inline uint32_t await_resume() const noexcept {
+                return result_;
+            }
+
+        private:
+            Reactor &reactor_;
+            int fd_;
+            uint32_t events_;
+            uint32_t result_ = 0;
+        };
+
+        /**
+         * Wait till descriptor is readable: `co_await readable(reactor, fd)`
+         */
+        inline Readiness readable(Reactor &reactor, int fd) {
+            return Readiness(reactor, fd, EPOLLIN | EPOLLRDHUP);
+        }
+
+        /**
+         * Wait till descriptor is writable
+         */
+        inline Readiness writable(Reactor &reactor, int fd) {
+            return Readiness(reactor, fd, EPOLLOUT);
+        }
+    }
+}
+#endif
+#endif //SCGI_COROUTINE_H
@@ -0,0 +1,94 @@
+#include "file_cache.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace scgi {
+
+    static inline bool same_file(const struct stat &a, const struct stat &b) {
+        return a.st_ino == b.st_ino && a.st_dev == b.st_dev && a.st_size == b.st_size &&
+               a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+    }
+
+    OpenFile::Ptr OpenFile::open(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return nullptr;
+        std::shared_ptr<OpenFile> file = std::make_shared<OpenFile>();
+        file->fd = fd;
+        if (fstat(fd, &file->info) != 0 || !S_ISREG(file->info.st_mode)) return nullptr;
+        return file;
+    }
+
+    OpenFile::~OpenFile() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    FileCache::FileCache(size_t capacity, std::chrono::steady_clock::duration revalidate)
+            : capacity_(capacity), revalidate_(revalidate) { }
+
+    OpenFile::Ptr FileCache::open(const std::string &path) {
+        auto now = std::chrono::steady_clock::now();
+        OpenFile::Ptr cached;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            auto iter = entries_.find(path);
+            if (iter != entries_.end()) {
+                Entry &entry = (*iter).second;
+                order_.splice(order_.begin(), order_, entry.usage);
+                if (now - entry.checked < revalidate_) return entry.file;
+                cached = entry.file;
+            }
+        }
+        // File system is checked without lock
+        if (cached) {
+            struct stat info;
+            if (stat(path.c_str(), &info) == 0 && same_file(info, cached->info)) {
+                std::lock_guard<std::mutex> lock(lock_);
+                auto iter = entries_.find(path);
+                if (iter != entries_.end() && (*iter).second.file == cached) (*iter).second.checked = now;
+                return cached;
+            }
+        }
+        OpenFile::Ptr file = OpenFile::open(path);
+        std::lock_guard<std::mutex> lock(lock_);
+        auto iter = entries_.find(path);
+        if (!file) {
+            if (iter != entries_.end()) {
+                order_.erase((*iter).second.usage);
+                entries_.erase(iter);
+            }
+            return nullptr;
+        }
+        if (iter != entries_.end()) {
+            (*iter).second.file = file;
+            (*iter).second.checked = now;
+            return file;
+        }
+        if (capacity_ == 0) return file;
+        if (entries_.size() >= capacity_) {
+            entries_.erase(order_.back());
+            order_.pop_back();
+        }
+        order_.push_front(path);
+        entries_[path] = Entry{file, now, order_.begin()};
+        return file;
+    }
+
+    void FileCache::invalidate(const std::string &path) {
+        std::lock_guard<std::mutex> lock(lock_);
+        auto iter = entries_.find(path);
+        if (iter == entries_.end()) return;
+        order_.erase((*iter).second.usage);
+        entries_.erase(iter);
+    }
+
+    void FileCache::clear() {
+        std::lock_guard<std::mutex> lock(lock_);
+        entries_.clear();
+        order_.clear();
+    }
+
+    size_t FileCache::size() const {
+        std::lock_guard<std::mutex> lock(lock_);
+        return entries_.size();
+    }
+}
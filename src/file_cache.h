@@ -0,0 +1,87 @@
+#ifndef SCGI_FILE_CACHE_H
+#define SCGI_FILE_CACHE_H
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+
+namespace scgi {
+
+    /**
+     * Open regular file with its `stat` result. Descriptor is closed when last user releases it, so file which is
+     * being sent stays valid after eviction from cache
+     */
+    struct OpenFile {
+        typedef std::shared_ptr<const OpenFile> Ptr;
+
+        int fd = -1;
+        struct stat info = {};
+
+        /**
+         * Open regular file `path` for reading. Returns nullptr if file can't be opened or is not regular
+         */
+        static Ptr open(const std::string &path);
+
+        inline size_t size() const {
+            return static_cast<size_t>(info.st_size);
+        }
+
+        OpenFile() { }
+
+        ~OpenFile();
+
+    private:
+        OpenFile(const OpenFile &) = delete;
+
+        OpenFile &operator=(const OpenFile &) = delete;
+    };
+
+    /**
+     * Cache of open descriptors and `stat` results keyed by path (least recently used files are closed over
+     * `capacity`). Cached file is checked by `stat` of path not more often than once per `revalidate` interval
+     * and reopened if its inode, size or mtime is changed. Thread-safe
+     */
+    class FileCache {
+    public:
+        explicit FileCache(size_t capacity = 256,
+                           std::chrono::steady_clock::duration revalidate = std::chrono::seconds(1));
+
+        /**
+         * Open file `path` or take it from cache. Returns nullptr if file can't be opened
+         */
+        OpenFile::Ptr open(const std::string &path);
+
+        /**
+         * Forget file `path` (ex: it is known to be changed)
+         */
+        void invalidate(const std::string &path);
+
+        void clear();
+
+        size_t size() const;
+
+    private:
+        struct Entry {
+            OpenFile::Ptr file;
+            std::chrono::steady_clock::time_point checked;
+            // Position in `order_`
+            std::list<std::string>::iterator usage;
+        };
+
+        size_t capacity_;
+        std::chrono::steady_clock::duration revalidate_;
+        mutable std::mutex lock_;
+        std::unordered_map<std::string, Entry> entries_;
+        // Paths from most to least recently used
+        std::list<std::string> order_;
+
+        FileCache(const FileCache &) = delete;
+
+        FileCache &operator=(const FileCache &) = delete;
+    };
+}
+#endif //SCGI_FILE_CACHE_H
@@ -0,0 +1,95 @@
+#include "headers.h"
+
+namespace scgi {
+
+    namespace header {
+        static const char *const names[] = {
+                "CONTENT_LENGTH",
+                "PATH_INFO",
+                "REQUEST_METHOD",
+                "QUERY_STRING",
+                "CONTENT_TYPE",
+                "REQUEST_URI",
+                "DOCUMENT_URI",
+                "SCRIPT_NAME",
+                "SERVER_PROTOCOL",
+                "REMOTE_ADDR",
+                "REMOTE_PORT",
+                "SERVER_NAME",
+                "SERVER_PORT",
+                "HTTPS",
+                "HTTP_HOST",
+                "HTTP_ACCEPT",
+                "HTTP_COOKIE",
+                "HTTP_USER_AGENT"
+        };
+
+        static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(Slot::count),
+                      "Names of well-known headers are not in sync with Slot enum");
+
+        Slot slot_of(const char *name, size_t size) {
+            // Cheap prefilter by length: most of nginx variables are not well-known
+            if (size < 5 || size > 15) return Slot::count;
+            for (int i = 0; i < static_cast<int>(Slot::count); ++i) {
+                if (names[i][0] == name[0] && std::strlen(names[i]) == size &&
+                    std::memcmp(names[i], name, size) == 0)
+                    return static_cast<Slot>(i);
+            }
+            return Slot::count;
+        }
+
+        const char *slot_name(Slot slot) {
+            if (slot >= Slot::count) return "";
+            return names[static_cast<int>(slot)];
+        }
+    }
+
+    bool HeaderBlock::index() {
+        items_.clear();
+        for (auto &slot:slots_) slot = StringRef();
+        const char *ptr = buffer_.data();
+        const char *end = ptr + buffer_.size();
+        while (ptr < end) {
+            auto key_end = static_cast<const char *>(std::memchr(ptr, '\0', end - ptr));
+            if (key_end == nullptr) return false;
+            auto value_begin = key_end + 1;
+            auto value_end = static_cast<const char *>(std::memchr(value_begin, '\0', end - value_begin));
+            if (value_end == nullptr) return false;
+            StringRef key(ptr, key_end - ptr), value(value_begin, value_end - value_begin);
+            items_.emplace_back(key, value);
+            auto slot = header::slot_of(key.data, key.size);
+            if (slot != header::Slot::count) slots_[static_cast<int>(slot)] = value;
+            ptr = value_end + 1;
+        }
+        return true;
+    }
+
+    bool HeaderBlock::find(const char *name, size_t size, StringRef &value) const {
+        auto slot = header::slot_of(name, size);
+        if (slot != header::Slot::count) {
+            value = slots_[static_cast<int>(slot)];
+            // Slot may be empty either for missing or for empty variable
+            if (!value.empty()) return true;
+        }
+        for (auto &item:items_) {
+            if (item.first.equals(name, size)) {
+                value = item.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void HeaderBlock::clear() {
+        buffer_.clear();
+        items_.clear();
+        for (auto &slot:slots_) slot = StringRef();
+    }
+
+    void HeaderBlock::swap(HeaderBlock &other) {
+        // References stay valid: vectors exchange their heap memory
+        buffer_.swap(other.buffer_);
+        items_.swap(other.items_);
+        for (int i = 0; i < static_cast<int>(header::Slot::count); ++i) std::swap(slots_[i], other.slots_[i]);
+    }
+}
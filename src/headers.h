@@ -0,0 +1,301 @@
+#ifndef SCGI_HEADERS_H
+#define SCGI_HEADERS_H
+
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <ostream>
+
+namespace scgi {
+
+    /**
+     * Non-owning reference to chars sequence (C++11 replacement of string_view).
+     * Valid only while owner of memory is alive
+     */
+    struct StringRef {
+        const char *data = nullptr;
+        size_t size = 0;
+
+        StringRef() { }
+
+        StringRef(const char *data_, size_t size_) : data(data_), size(size_) { }
+
+        StringRef(const std::string &s) : data(s.data()), size(s.size()) { }
+
+        inline bool empty() const {
+            return size == 0;
+        }
+
+        inline const char *begin() const {
+            return data;
+        }
+
+        inline const char *end() const {
+            return data + size;
+        }
+
+        inline char operator[](size_t index) const {
+            return data[index];
+        }
+
+        /**
+         * Copy referenced chars to new string
+         */
+        inline std::string str() const {
+            return size == 0 ? std::string() : std::string(data, size);
+        }
+
+        inline bool equals(const char *other, size_t other_size) const {
+            return size == other_size && (size == 0 || std::memcmp(data, other, size) == 0);
+        }
+
+        inline bool operator==(const StringRef &other) const {
+            return equals(other.data, other.size);
+        }
+
+        inline bool operator!=(const StringRef &other) const {
+            return !equals(other.data, other.size);
+        }
+
+        inline bool operator==(const std::string &other) const {
+            return equals(other.data(), other.size());
+        }
+
+        inline bool operator!=(const std::string &other) const {
+            return !equals(other.data(), other.size());
+        }
+    };
+
+    inline std::ostream &operator<<(std::ostream &out, const StringRef &ref) {
+        return out.write(ref.data, ref.size);
+    }
+
+    namespace header {
+        /**
+         * Maximum size of SCGI netstring with headers
+         */
+        static const size_t max_length = 1024 * 1024;
+
+        /**
+         * Well-known SCGI/CGI variables with direct slots in parsed header block
+         */
+        enum class Slot : int {
+            content_length = 0,
+            path,
+            method,
+            query,
+            content_type,
+            request_uri,
+            document_uri,
+            script_name,
+            server_protocol,
+            remote_addr,
+            remote_port,
+            server_name,
+            server_port,
+            https,
+            http_host,
+            http_accept,
+            http_cookie,
+            http_user_agent,
+            count
+        };
+
+        /**
+         * Find slot of variable `name`. Returns Slot::count for unknown variables
+         */
+        Slot slot_of(const char *name, size_t size);
+
+        /**
+         * Name of well-known variable
+         */
+        const char *slot_name(Slot slot);
+    }
+
+    /**
+     * Parsed SCGI netstring payload. All keys and values point inside one contiguous buffer, so parsing
+     * allocates only the buffer itself and the index of pairs.
+     */
+    class HeaderBlock {
+    public:
+        typedef std::pair<StringRef, StringRef> Item;
+
+        HeaderBlock() { }
+
+        /**
+         * References point into buffer, so block can be moved (buffer memory is kept) but not copied
+         */
+        HeaderBlock(HeaderBlock &&) = default;
+
+        HeaderBlock &operator=(HeaderBlock &&) = default;
+
+        HeaderBlock(const HeaderBlock &) = delete;
+
+        HeaderBlock &operator=(const HeaderBlock &) = delete;
+
+        /**
+         * Raw netstring content (without length prefix and trailing comma). Fill it and call `index`
+         */
+        inline std::vector<char> &buffer() {
+            return buffer_;
+        }
+
+        inline const std::vector<char> &buffer() const {
+            return buffer_;
+        }
+
+        /**
+         * Build index of key-value pairs over buffer. Returns false on malformed content
+         */
+        bool index();
+
+        /**
+         * Value of well-known variable or empty reference
+         */
+        inline StringRef get(header::Slot slot) const {
+            return slots_[static_cast<int>(slot)];
+        }
+
+        /**
+         * Find value by name. Returns false if variable is not present
+         */
+        bool find(const char *name, size_t size, StringRef &value) const;
+
+        inline bool find(const std::string &name, StringRef &value) const {
+            return find(name.data(), name.size(), value);
+        }
+
+        /**
+         * All pairs in order of arrival
+         */
+        inline const std::vector<Item> &items() const {
+            return items_;
+        }
+
+        /**
+         * Reset state but keep allocated memory
+         */
+        void clear();
+
+        /**
+         * Exchange content (and allocated memory) with `other`
+         */
+        void swap(HeaderBlock &other);
+
+    private:
+        std::vector<char> buffer_;
+        std::vector<Item> items_;
+        StringRef slots_[static_cast<int>(header::Slot::count)];
+    };
+
+    /**
+     * Map which is built by `builder` only on first access. Used as compatibility view of cheap internal
+     * representation (ex: request headers).
+     */
+    template<class Map>
+    class LazyMap {
+    public:
+        typedef typename Map::key_type key_type;
+        typedef typename Map::mapped_type mapped_type;
+        typedef typename Map::iterator iterator;
+        typedef typename Map::const_iterator const_iterator;
+        typedef std::function<void(Map &)> Builder;
+
+        LazyMap() { }
+
+        explicit LazyMap(const Builder &builder) : builder_(builder) { }
+
+        LazyMap(const LazyMap &) = delete;
+
+        LazyMap &operator=(const LazyMap &) = delete;
+
+        /**
+         * Set new builder and drop built content
+         */
+        inline void reset(const Builder &builder) {
+            builder_ = builder;
+            map_.clear();
+            built_ = false;
+        }
+
+        /**
+         * Drop built content. Map will be built again on next access
+         */
+        inline void clear() {
+            map_.clear();
+            built_ = false;
+        }
+
+        /**
+         * Is underlying map already built
+         */
+        inline bool is_built() const {
+            return built_;
+        }
+
+        /**
+         * Underlying map (builds it if required)
+         */
+        inline Map &map() const {
+            if (!built_) {
+                built_ = true;
+                if (builder_) builder_(map_);
+            }
+            return map_;
+        }
+
+        inline mapped_type &operator[](const key_type &key) {
+            return map()[key];
+        }
+
+        inline iterator find(const key_type &key) {
+            return map().find(key);
+        }
+
+        inline const_iterator find(const key_type &key) const {
+            return map().find(key);
+        }
+
+        inline size_t count(const key_type &key) const {
+            return map().count(key);
+        }
+
+        inline mapped_type &at(const key_type &key) {
+            return map().at(key);
+        }
+
+        inline iterator begin() {
+            return map().begin();
+        }
+
+        inline iterator end() {
+            return map().end();
+        }
+
+        inline const_iterator begin() const {
+            return map().begin();
+        }
+
+        inline const_iterator end() const {
+            return map().end();
+        }
+
+        inline size_t size() const {
+            return map().size();
+        }
+
+        inline bool empty() const {
+            return map().empty();
+        }
+
+    private:
+        Builder builder_;
+        mutable Map map_;
+        mutable bool built_ = false;
+    };
+}
+#endif //SCGI_HEADERS_H
@@ -2,8 +2,284 @@
 // Created by Red Dec on 09.04.15.
 //
 #include "http.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <cstdlib>
+#include <list>
 
 namespace scgi {
+    namespace http {
 
+        const char *reason_phrase(int code) {
+            switch (code) {
+#define SCGI_HTTP_STATUS_REASON(code, name, reason) case code: return reason;
+                SCGI_HTTP_STATUS_LIST(SCGI_HTTP_STATUS_REASON)
+#undef SCGI_HTTP_STATUS_REASON
+                default:
+                    return nullptr;
+            }
+        }
 
-}
\ No newline at end of file
+        StringRef status_line(int code) {
+            // Lines are concatenated at compile time
+            switch (code) {
+#define SCGI_HTTP_STATUS_LINE(code, name, reason) \
+                case code: return StringRef("Status: " #code " " reason "\r\n", sizeof("Status: " #code " " reason "\r\n") - 1);
+                SCGI_HTTP_STATUS_LIST(SCGI_HTTP_STATUS_LINE)
+#undef SCGI_HTTP_STATUS_LINE
+                default:
+                    return StringRef();
+            }
+        }
+
+        Horspool::Horspool(const std::string &pattern) : pattern_(pattern) {
+            size_t m = pattern_.size();
+            for (auto &shift:shift_) shift = m;
+            for (size_t i = 0; i + 1 < m; ++i) shift_[static_cast<unsigned char>(pattern_[i])] = m - 1 - i;
+        }
+
+        size_t Horspool::find(const char *text, size_t size) const {
+            size_t m = pattern_.size();
+            if (m == 0) return 0;
+            const char *pattern = pattern_.data();
+            char last = pattern[m - 1];
+            size_t pos = 0;
+            while (pos + m <= size) {
+                char c = text[pos + m - 1];
+                if (c == last && std::memcmp(text + pos, pattern, m - 1) == 0) return pos;
+                pos += shift_[static_cast<unsigned char>(c)];
+            }
+            return std::string::npos;
+        }
+
+        MultipartParser::MultipartParser(const std::string &boundary, const Handler &handler, bool preamble)
+                : delimiter_("\r\n--" + boundary), handler_(handler) {
+            if (!preamble) {
+                state_ = State::Headers;
+                return;
+            }
+            // First boundary may be not preceded by line break
+            buffer_ = "\r\n";
+        }
+
+        bool MultipartParser::feed(const char *data, size_t size) {
+            if (state_ == State::Done || state_ == State::Error) return state_ == State::Done;
+            buffer_.append(data, size);
+            size_t offset = process(0);
+            buffer_.erase(0, offset);
+            return state_ != State::Error;
+        }
+
+        size_t MultipartParser::process(size_t offset) {
+            size_t m = delimiter_.size();
+            while (true) {
+                const char *data = buffer_.data() + offset;
+                size_t size = buffer_.size() - offset;
+                switch (state_) {
+                    case State::Preamble: {
+                        size_t found = delimiter_.find(data, size);
+                        if (found == std::string::npos) return size >= m ? buffer_.size() - m + 1 : offset;
+                        offset += found + m;
+                        state_ = State::Boundary;
+                        break;
+                    }
+                    case State::Boundary: {
+                        // Skip transport padding
+                        while (size > 0 && (*data == ' ' || *data == '\t')) {
+                            ++data;
+                            ++offset;
+                            --size;
+                        }
+                        if (size < 2) return offset;
+                        if (data[0] == '-' && data[1] == '-') {
+                            state_ = State::Done;
+                            return buffer_.size();
+                        }
+                        if (data[0] != '\r' || data[1] != '\n') {
+                            state_ = State::Error;
+                            return offset;
+                        }
+                        offset += 2;
+                        state_ = State::Headers;
+                        break;
+                    }
+                    case State::Headers: {
+                        size_t end;
+                        if (size >= 2 && data[0] == '\r' && data[1] == '\n') {
+                            end = 0;
+                        } else {
+                            const char *found = static_cast<const char *>(memmem(data, size, "\r\n\r\n", 4));
+                            if (found == nullptr) {
+                                if (size > max_headers_size) state_ = State::Error;
+                                return offset;
+                            }
+                            end = found - data + 2;
+                        }
+                        if (!parse_part_headers(data, end) ||
+                            (handler_.on_part_begin && !handler_.on_part_begin(part_))) {
+                            state_ = State::Error;
+                            return offset;
+                        }
+                        offset += end + 2;
+                        state_ = State::Data;
+                        break;
+                    }
+                    case State::Data: {
+                        size_t found = delimiter_.find(data, size);
+                        // Tail which may be beginning of delimiter is kept till next chunk
+                        size_t chunk = found != std::string::npos ? found : (size >= m ? size - m + 1 : 0);
+                        if (chunk > 0 && handler_.on_data && !handler_.on_data(part_, data, chunk)) {
+                            state_ = State::Error;
+                            return offset;
+                        }
+                        offset += chunk;
+                        if (found == std::string::npos) return offset;
+                        offset += m;
+                        if (handler_.on_part_end && !handler_.on_part_end(part_)) {
+                            state_ = State::Error;
+                            return offset;
+                        }
+                        state_ = State::Boundary;
+                        break;
+                    }
+                    case State::Done:
+                    case State::Error:
+                        return offset;
+                }
+            }
+        }
+
+        bool MultipartParser::parse_part_headers(const char *data, size_t size) {
+            part_ = Part();
+            std::string block(data, size);
+            std::stringstream ss(block);
+            parse_http_headers(ss, part_.headers, 64);
+            auto disposition = part_.headers.find(header::content_disposition);
+            if (disposition != part_.headers.end()) {
+                std::list<std::string> options;
+                std::map<std::string, std::string> params;
+                parse_http_line((*disposition).second, options, params);
+                part_.name = params["name"];
+                part_.filename = params["filename"];
+            }
+            auto type = part_.headers.find(header::content_type);
+            if (type != part_.headers.end()) part_.content_type = (*type).second;
+            return true;
+        }
+
+        FormField::FormField(FormField &&other)
+                : name(std::move(other.name)), filename(std::move(other.filename)),
+                  content_type(std::move(other.content_type)), data(std::move(other.data)), fd(other.fd),
+                  size(other.size) {
+            other.fd = -1;
+        }
+
+        FormField &FormField::operator=(FormField &&other) {
+            if (this == &other) return *this;
+            if (fd >= 0) close(fd);
+            name = std::move(other.name);
+            filename = std::move(other.filename);
+            content_type = std::move(other.content_type);
+            data = std::move(other.data);
+            fd = other.fd;
+            size = other.size;
+            other.fd = -1;
+            return *this;
+        }
+
+        std::string FormField::content() const {
+            if (!is_spilled()) return data;
+            std::string result(size, '\0');
+            size_t done = 0;
+            while (done < size) {
+                ssize_t reads = pread(fd, &result[done], size - done, static_cast<off_t>(done));
+                if (reads <= 0) break;
+                done += static_cast<size_t>(reads);
+            }
+            result.resize(done);
+            return result;
+        }
+
+        FormField::~FormField() {
+            if (fd >= 0) close(fd);
+        }
+
+        FormCollector::FormCollector(std::vector<FormField> &fields, size_t spill_threshold, size_t max_size,
+                                     const std::string &temp_dir)
+                : fields_(fields), spill_threshold_(spill_threshold), max_size_(max_size), temp_dir_(temp_dir) { }
+
+        MultipartParser::Handler FormCollector::handler() {
+            MultipartParser::Handler handler;
+            handler.on_part_begin = [this](const MultipartParser::Part &part) {
+                fields_.emplace_back();
+                FormField &field = fields_.back();
+                field.name = part.name;
+                field.filename = part.filename;
+                field.content_type = part.content_type;
+                return true;
+            };
+            handler.on_data = [this](const MultipartParser::Part &, const char *data, size_t size) {
+                return append(data, size);
+            };
+            return handler;
+        }
+
+        bool FormCollector::append(const char *data, size_t size) {
+            if (fields_.empty() || total_ + size > max_size_) return false;
+            total_ += size;
+            FormField &field = fields_.back();
+            if (!field.is_spilled() && field.size + size > spill_threshold_ && !spill(field)) return false;
+            if (field.is_spilled()) {
+                while (size > 0) {
+                    ssize_t written = write(field.fd, data, size);
+                    if (written <= 0) return false;
+                    data += written;
+                    size -= static_cast<size_t>(written);
+                    field.size += static_cast<size_t>(written);
+                }
+            } else {
+                field.data.append(data, size);
+                field.size += size;
+            }
+            return true;
+        }
+
+        bool FormCollector::spill(FormField &field) {
+            int fd = -1;
+            if (!temp_dir_.empty()) {
+                std::string path = temp_dir_ + "/scgi-form-XXXXXX";
+                fd = mkostemp(&path[0], O_CLOEXEC);
+                if (fd >= 0) unlink(path.c_str());
+            } else {
+#ifdef MFD_CLOEXEC
+                fd = memfd_create("scgi-form", MFD_CLOEXEC);
+#else
+                char path[] = "/tmp/scgi-form-XXXXXX";
+                fd = mkostemp(path, O_CLOEXEC);
+                if (fd >= 0) unlink(path);
+#endif
+            }
+            if (fd < 0) return false;
+            field.fd = fd;
+            const char *data = field.data.data();
+            size_t size = field.data.size();
+            while (size > 0) {
+                ssize_t written = write(fd, data, size);
+                if (written <= 0) return false;
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+            std::string().swap(field.data);
+            return true;
+        }
+
+        std::string multipart_boundary(const std::string &content_type) {
+            std::vector<std::string> options;
+            std::map<std::string, std::string> params;
+            parse_http_line(content_type, options, params);
+            auto iter = params.find("boundary");
+            return iter == params.end() ? std::string() : (*iter).second;
+        }
+    }
+}
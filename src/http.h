@@ -5,11 +5,18 @@
 #ifndef SCGI_HTTP_H
 #define SCGI_HTTP_H
 
+#include <algorithm>
 #include <iostream>
 #include <cstring>
 #include <vector>
 #include <map>
 #include <sstream>
+#include <functional>
+#include <string>
+#include "headers.h"
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 namespace scgi {
     namespace http {
@@ -19,6 +26,7 @@ namespace scgi {
         namespace header {
             static const std::string content_disposition = "Content-Disposition";
             static const std::string content_type = "Content-Type";
+            static const std::string content_length = "Content-Length";
         }
 
         /**
@@ -41,43 +49,194 @@ namespace scgi {
         }
 
         /**
-         * Base HTTP status code
+         * HTTP status codes with reason phrases: X(code, enum name, reason phrase)
+         */
+#define SCGI_HTTP_STATUS_LIST(X) \
+    X(100, Continue, "Continue") \
+    X(101, SwitchingProtocols, "Switching Protocols") \
+    X(102, Processing, "Processing") \
+    X(103, EarlyHints, "Early Hints") \
+    X(200, OK, "OK") \
+    X(201, Created, "Created") \
+    X(202, Accepted, "Accepted") \
+    X(203, NonAuthoritativeInformation, "Non-Authoritative Information") \
+    X(204, NoContent, "No Content") \
+    X(205, ResetContent, "Reset Content") \
+    X(206, PartialContent, "Partial Content") \
+    X(207, MultiStatus, "Multi-Status") \
+    X(208, AlreadyReported, "Already Reported") \
+    X(226, IMUsed, "IM Used") \
+    X(300, MultipleChoices, "Multiple Choices") \
+    X(301, MovedPermanently, "Moved Permanently") \
+    X(302, Found, "Found") \
+    X(303, SeeOther, "See Other") \
+    X(304, NotModified, "Not Modified") \
+    X(305, UseProxy, "Use Proxy") \
+    X(307, TemporaryRedirect, "Temporary Redirect") \
+    X(308, PermanentRedirect, "Permanent Redirect") \
+    X(400, BadRequest, "Bad Request") \
+    X(401, Unauthorized, "Unauthorized") \
+    X(402, PaymentRequired, "Payment Required") \
+    X(403, Forbidden, "Forbidden") \
+    X(404, NotFound, "Not Found") \
+    X(405, MethodNotAllowed, "Method Not Allowed") \
+    X(406, NotAcceptable, "Not Acceptable") \
+    X(407, ProxyAuthenticationRequired, "Proxy Authentication Required") \
+    X(408, RequestTimeout, "Request Timeout") \
+    X(409, Conflict, "Conflict") \
+    X(410, Gone, "Gone") \
+    X(411, LengthRequired, "Length Required") \
+    X(412, PreconditionFailed, "Precondition Failed") \
+    X(413, PayloadTooLarge, "Payload Too Large") \
+    X(414, URITooLong, "URI Too Long") \
+    X(415, UnsupportedMediaType, "Unsupported Media Type") \
+    X(416, RangeNotSatisfiable, "Range Not Satisfiable") \
+    X(417, ExpectationFailed, "Expectation Failed") \
+    X(418, ImATeapot, "I'm a teapot") \
+    X(421, MisdirectedRequest, "Misdirected Request") \
+    X(422, UnprocessableEntity, "Unprocessable Entity") \
+    X(423, Locked, "Locked") \
+    X(424, FailedDependency, "Failed Dependency") \
+    X(425, TooEarly, "Too Early") \
+    X(426, UpgradeRequired, "Upgrade Required") \
+    X(428, PreconditionRequired, "Precondition Required") \
+    X(429, TooManyRequests, "Too Many Requests") \
+    X(431, RequestHeaderFieldsTooLarge, "Request Header Fields Too Large") \
+    X(451, UnavailableForLegalReasons, "Unavailable For Legal Reasons") \
+    X(500, InternalError, "Internal Server Error") \
+    X(501, NotImplemented, "Not Implemented") \
+    X(502, BadGateway, "Bad Gateway") \
+    X(503, ServiceUnavailable, "Service Unavailable") \
+    X(504, GatewayTimeout, "Gateway Timeout") \
+    X(505, HTTPVersionNotSupported, "HTTP Version Not Supported") \
+    X(506, VariantAlsoNegotiates, "Variant Also Negotiates") \
+    X(507, InsufficientStorage, "Insufficient Storage") \
+    X(508, LoopDetected, "Loop Detected") \
+    X(510, NotExtended, "Not Extended") \
+    X(511, NetworkAuthenticationRequired, "Network Authentication Required")
+
+        /**
+         * HTTP status code
          */
         enum class Status : int {
-            OK = 200,
-            NotFound = 404,
-            InternalError = 500
+#define SCGI_HTTP_STATUS_ENUM(code, name, reason) name = code,
+            SCGI_HTTP_STATUS_LIST(SCGI_HTTP_STATUS_ENUM)
+#undef SCGI_HTTP_STATUS_ENUM
         };
 
+        /**
+         * Standard reason phrase of `code` or nullptr for unknown code
+         */
+        const char *reason_phrase(int code);
+
+        /**
+         * Precomputed CGI status line ("Status: 404 Not Found\r\n") of `code` or empty reference for unknown code
+         */
+        StringRef status_line(int code);
 
         /**
          * Supported form data encoding
          */
         enum class EncodingType {
-            x_www_form_urlencoded
+            x_www_form_urlencoded,
+            multipart_form_data
         };
 
+        /**
+         * Value of hex digit or -1
+         */
+        static inline int hex_value(char c) {
+            static const signed char table[256] = {
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, -1, -1, -1, -1, -1, -1,
+                    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+            };
+            return table[static_cast<unsigned char>(c)];
+        }
+
+        /**
+         * Length of prefix of `s` without '%' and '+' chars (plain text which can be copied as is).
+         * Uses AVX2 or SSE2 when available
+         */
+        static inline size_t url_plain_prefix(const char *s, size_t size) {
+            size_t i = 0;
+#if defined(__AVX2__)
+            const __m256i percent32 = _mm256_set1_epi8('%'), plus32 = _mm256_set1_epi8('+');
+            for (; i + 32 <= size; i += 32) {
+                __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+                unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+                        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, percent32), _mm256_cmpeq_epi8(chunk, plus32))));
+                if (mask != 0) return i + __builtin_ctz(mask);
+            }
+#endif
+#if defined(__SSE2__)
+            const __m128i percent = _mm_set1_epi8('%'), plus = _mm_set1_epi8('+');
+            for (; i + 16 <= size; i += 16) {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+                        _mm_or_si128(_mm_cmpeq_epi8(chunk, percent), _mm_cmpeq_epi8(chunk, plus))));
+                if (mask != 0) return i + __builtin_ctz(mask);
+            }
+#endif
+            for (; i < size; ++i) if (s[i] == '%' || s[i] == '+') break;
+            return i;
+        }
+
+        /**
+         * Decode `size` chars of `s` in URL-Percent (with + extension) format into `out` which should have at least
+         * `size` bytes. Decoding in place (`out` == `s`) is allowed. Malformed escape sequences are kept as is.
+         * Returns decoded size
+         */
+        static inline size_t url_decode_to(const char *s, size_t size, char *out) {
+            size_t i = 0, o = 0;
+            while (i < size) {
+                size_t plain = url_plain_prefix(s + i, size - i);
+                if (plain > 0) {
+                    if (out + o != s + i) std::memmove(out + o, s + i, plain);
+                    i += plain;
+                    o += plain;
+                    if (i == size) break;
+                }
+                char c = s[i];
+                if (c == '+') {
+                    out[o++] = ' ';
+                    ++i;
+                    continue;
+                }
+                int high = i + 1 < size ? hex_value(s[i + 1]) : -1;
+                int low = i + 2 < size ? hex_value(s[i + 2]) : -1;
+                if (high >= 0 && low >= 0) {
+                    out[o++] = static_cast<char>((high << 4) | low);
+                    i += 3;
+                } else {
+                    out[o++] = c;
+                    ++i;
+                }
+            }
+            return o;
+        }
+
         /**
          * Decode string in URL-Percent (with + extension) format
          */
         template<class CharSqeuence>
         static inline std::string url_decode(const CharSqeuence &s, size_t size) {
-            std::stringstream ss;
-            char hex[3];
-            hex[2] = '\0';
-            for (size_t i = 0; i < size; ++i) {
-                char c = s[i];
-                if (c == '%') {
-                    hex[0] = i + 1 < size && std::isalnum(s[i + 1]) ? s[i + 1] : '0';
-                    hex[1] = i + 2 < size && std::isalnum(s[i + 1]) ? s[i + 2] : '0';
-                    ss << (char) std::stoi(hex, nullptr, 16);
-                    i += 2;
-                } else if (c == '+') {
-                    ss << ' ';
-                } else
-                    ss << c;
-            }
-            return ss.str();
+            std::string result(size, '\0');
+            if (size > 0) result.resize(url_decode_to(&s[0], size, &result[0]));
+            return result;
         }
 
         static inline std::string url_decode(const std::string &s) {
@@ -224,37 +383,204 @@ namespace scgi {
             return reads;
         }
 
+        /**
+         * Horspool substring search with precomputed shift table
+         */
+        class Horspool {
+        public:
+            explicit Horspool(const std::string &pattern);
+
+            /**
+             * Position of first occurrence of pattern in `text` or std::string::npos
+             */
+            size_t find(const char *text, size_t size) const;
+
+            inline size_t size() const {
+                return pattern_.size();
+            }
+
+        private:
+            std::string pattern_;
+            size_t shift_[256];
+        };
+
+        /**
+         * Streaming multipart/form-data parser. Body may be fed by chunks of any size: data of each part is passed
+         * to handler by chunks as soon as it is known that chunk is not a part of boundary, so memory usage does
+         * not depend on size of parts.
+         */
+        class MultipartParser {
+        public:
+
+            /**
+             * Description of part from part headers
+             */
+            struct Part {
+                std::string name;
+                std::string filename;
+                std::string content_type;
+                std::map<std::string, std::string> headers;
+            };
+
+            /**
+             * Callbacks of parser. Returning false aborts parsing
+             */
+            struct Handler {
+                std::function<bool(const Part &)> on_part_begin;
+                std::function<bool(const Part &, const char *, size_t)> on_data;
+                std::function<bool(const Part &)> on_part_end;
+            };
+
+            /**
+             * Parser for `boundary` (value of boundary option of Content-Type, without leading dashes).
+             * If `preamble` is false, body starts with headers of first part (first boundary line is already read)
+             */
+            MultipartParser(const std::string &boundary, const Handler &handler, bool preamble = true);
+
+            /**
+             * Consume next chunk of body. Returns false on error
+             */
+            bool feed(const char *data, size_t size);
+
+            /**
+             * Final boundary found
+             */
+            inline bool is_done() const {
+                return state_ == State::Done;
+            }
+
+            inline bool is_failed() const {
+                return state_ == State::Error;
+            }
+
+        private:
+            enum class State {
+                Preamble,
+                Boundary,
+                Headers,
+                Data,
+                Done,
+                Error
+            };
+
+            // Maximum size of headers block of one part
+            static const size_t max_headers_size = 16384;
+
+            Horspool delimiter_;
+            Handler handler_;
+            State state_ = State::Preamble;
+            std::string buffer_;
+            Part part_;
+
+            /**
+             * Process buffered data from `offset`. Returns new offset
+             */
+            size_t process(size_t offset);
+
+            bool parse_part_headers(const char *data, size_t size);
+        };
+
+        /**
+         * Field of multipart form. Small content is kept in memory, large content is spilled to anonymous file
+         */
+        struct FormField {
+            std::string name;
+            std::string filename;
+            std::string content_type;
+            // Content of not spilled field
+            std::string data;
+            // Descriptor of spilled content (memfd or unlinked temporary file) or -1
+            int fd = -1;
+            size_t size = 0;
+
+            FormField() { }
+
+            FormField(FormField &&other);
+
+            FormField &operator=(FormField &&other);
+
+            FormField(const FormField &) = delete;
+
+            FormField &operator=(const FormField &) = delete;
+
+            inline bool is_spilled() const {
+                return fd >= 0;
+            }
+
+            /**
+             * Whole content (reads spilled file)
+             */
+            std::string content() const;
+
+            /**
+             * Close spilled file
+             */
+            ~FormField();
+        };
+
+        /**
+         * Collects multipart fields. Fields bigger then `spill_threshold` are moved to memfd (or to unlinked temporary
+         * file in `temp_dir` if specified). Parsing fails if total size exceeds `max_size`
+         */
+        class FormCollector {
+        public:
+            FormCollector(std::vector<FormField> &fields, size_t spill_threshold = std::string::npos,
+                          size_t max_size = std::string::npos, const std::string &temp_dir = "");
+
+            /**
+             * Callbacks for MultipartParser. Collector must outlive parser
+             */
+            MultipartParser::Handler handler();
+
+        private:
+            std::vector<FormField> &fields_;
+            size_t spill_threshold_, max_size_, total_ = 0;
+            std::string temp_dir_;
+
+            bool append(const char *data, size_t size);
+
+            bool spill(FormField &field);
+        };
+
+        /**
+         * Find `boundary` option in value of Content-Type header. Returns empty string if not found
+         */
+        std::string multipart_boundary(const std::string &content_type);
+
         /**
          * Parse HTTP multipart/form-data request.
          * `in` - Input body
          * `map` - Data content with value
-         * `boundary` - Multipart form boundary line
+         * `boundary` - Multipart form boundary line: boundary option of Content-Type prefixed by `--`
          * `max-size` - Maximum total size of all parts
-         * `skip_preambule` - Skip first part
+         * `skip_preambule` - Skip preamble and first boundary line. If false, `in` starts with headers of first part
          */
         template<class Map>
         static inline void parse_http_multipart_form(std::istream &in, Map &map, const std::string &boundary,
                                                      size_t max_size = 65535, bool skip_preambule = true) {
-            size_t part_size = max_size;
-            std::vector<char> buffer;
-            std::vector<std::string> options;
-            std::string name;
-            std::map<std::string, std::string> headers;
-
-            if (skip_preambule) {
-                read_to_line(in, boundary, buffer, boundary.size() + 20);
-            }
-            while (!in.eof() && part_size > 0) {
-                buffer.clear();
-                headers.clear();
-                parse_http_headers(in, headers, 20);
-                if (headers.empty() || headers.find(header::content_disposition) == headers.end()) break;
-                parse_http_line(headers[header::content_disposition], options, headers);
-                if (headers.empty() || headers.find("name") == headers.end())break;
-                name = headers["name"];
-                read_to_line(in, boundary, buffer, part_size);
-                part_size -= buffer.size();
-                map[name] = std::string(buffer.data(), buffer.size());
+            size_t total = 0;
+            std::string value;
+            MultipartParser::Handler handler;
+            handler.on_part_begin = [&value](const MultipartParser::Part &) {
+                value.clear();
+                return true;
+            };
+            handler.on_data = [&](const MultipartParser::Part &, const char *data, size_t size) {
+                if (total + size > max_size) return false;
+                total += size;
+                value.append(data, size);
+                return true;
+            };
+            handler.on_part_end = [&](const MultipartParser::Part &part) {
+                if (!part.name.empty()) map[part.name] = value;
+                return true;
+            };
+            // Two dashes of boundary line are not part of boundary
+            MultipartParser parser(boundary.substr(std::min<size_t>(2, boundary.size())), handler, skip_preambule);
+            char buffer[65536];
+            while (!parser.is_done() && in) {
+                in.read(buffer, sizeof(buffer));
+                if (!parser.feed(buffer, static_cast<size_t>(in.gcount()))) break;
             }
         }
 
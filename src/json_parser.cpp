@@ -0,0 +1,402 @@
+#include "json_parser.h"
+#include <cstdlib>
+
+namespace scgi {
+    namespace service {
+
+        static inline bool is_space(char c) {
+            return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+        }
+
+        static inline bool is_number_char(char c) {
+            return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+        }
+
+        static inline bool is_digit(char c) {
+            return c >= '0' && c <= '9';
+        }
+
+        static void append_utf8(std::string &out, uint32_t code) {
+            if (code < 0x80) {
+                out += static_cast<char>(code);
+            } else if (code < 0x800) {
+                out += static_cast<char>(0xC0 | (code >> 6));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            } else if (code < 0x10000) {
+                out += static_cast<char>(0xE0 | (code >> 12));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            } else {
+                out += static_cast<char>(0xF0 | (code >> 18));
+                out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+        }
+
+        JsonParser::JsonParser(Handler &handler, size_t max_depth) : handler_(handler), max_depth_(max_depth) { }
+
+        bool JsonParser::feed(const char *data, size_t size) {
+            const char *p = data, *end = data + size;
+            while (p < end && state_ != State::Error) {
+                char c = *p;
+                switch (state_) {
+                    case State::Value:
+                    case State::FirstItem:
+                        if (is_space(c)) {
+                            ++p;
+                        } else if (c == ']' && state_ == State::FirstItem) {
+                            ++p;
+                            close(c);
+                        } else {
+                            p = begin_value(p);
+                        }
+                        break;
+                    case State::FirstKey:
+                    case State::Key:
+                        if (is_space(c)) {
+                            ++p;
+                        } else if (c == '}' && state_ == State::FirstKey) {
+                            ++p;
+                            close(c);
+                        } else if (c == '"') {
+                            ++p;
+                            key_ = true;
+                            state_ = State::String;
+                        } else {
+                            fail();
+                        }
+                        break;
+                    case State::Colon:
+                        ++p;
+                        if (c == ':') state_ = State::Value;
+                        else if (!is_space(c)) fail();
+                        break;
+                    case State::Next:
+                        ++p;
+                        if (c == ',') state_ = stack_.back() == '{' ? State::Key : State::Value;
+                        else if (c == '}' || c == ']') close(c);
+                        else if (!is_space(c)) fail();
+                        break;
+                    case State::String:
+                        p = read_string(p, end);
+                        break;
+                    case State::Escape:
+                        ++p;
+                        escape(c);
+                        break;
+                    case State::Unicode:
+                        ++p;
+                        unicode(c);
+                        break;
+                    case State::Number: {
+                        const char *start = p;
+                        while (p < end && is_number_char(*p)) ++p;
+                        buffer_.append(start, p - start);
+                        // Terminator is processed as next token
+                        if (p < end) number();
+                        break;
+                    }
+                    case State::Literal:
+                        ++p;
+                        if (c != literal_[matched_++]) fail();
+                        else if (literal_[matched_] == '\0') literal();
+                        break;
+                    case State::Done:
+                        ++p;
+                        if (!is_space(c)) fail();
+                        break;
+                    case State::Error:
+                        break;
+                }
+            }
+            return state_ != State::Error;
+        }
+
+        bool JsonParser::finish() {
+            if (state_ == State::Number && stack_.empty()) number();
+            return state_ == State::Done;
+        }
+
+        const char *JsonParser::begin_value(const char *p) {
+            switch (*p) {
+                case '{':
+                case '[':
+                    if (stack_.size() >= max_depth_) {
+                        fail();
+                        break;
+                    }
+                    stack_.push_back(*p);
+                    if (*p == '{') {
+                        state_ = handler_.on_object_begin() ? State::FirstKey : State::Error;
+                    } else {
+                        state_ = handler_.on_array_begin() ? State::FirstItem : State::Error;
+                    }
+                    return p + 1;
+                case '"':
+                    key_ = false;
+                    state_ = State::String;
+                    return p + 1;
+                case 't':
+                    literal_ = "true";
+                    break;
+                case 'f':
+                    literal_ = "false";
+                    break;
+                case 'n':
+                    literal_ = "null";
+                    break;
+                default:
+                    if (*p == '-' || is_digit(*p)) {
+                        buffer_.clear();
+                        state_ = State::Number;
+                    } else {
+                        fail();
+                    }
+                    return p;
+            }
+            if (state_ != State::Error) {
+                matched_ = 0;
+                state_ = State::Literal;
+            }
+            return p;
+        }
+
+        const char *JsonParser::read_string(const char *p, const char *end) {
+            if (surrogate_ != 0 && *p != '\\') {
+                fail();
+                return p;
+            }
+            const char *start = p;
+            while (p < end && *p != '"' && *p != '\\') ++p;
+            if (p == end) {
+                buffer_.append(start, p - start);
+                return p;
+            }
+            if (*p == '\\') {
+                buffer_.append(start, p - start);
+                state_ = State::Escape;
+                return p + 1;
+            }
+            // String without escapes in one chunk is passed without copying
+            const char *data = start;
+            size_t size = p - start;
+            if (!buffer_.empty()) {
+                buffer_.append(start, size);
+                data = buffer_.data();
+                size = buffer_.size();
+            }
+            if (!(key_ ? handler_.on_key(data, size) : handler_.on_string(data, size))) {
+                fail();
+            } else if (key_) {
+                state_ = State::Colon;
+            } else {
+                complete();
+            }
+            buffer_.clear();
+            return p + 1;
+        }
+
+        bool JsonParser::escape(char c) {
+            if (surrogate_ != 0 && c != 'u') return fail();
+            state_ = State::String;
+            switch (c) {
+                case '"':
+                case '\\':
+                case '/':
+                    buffer_ += c;
+                    break;
+                case 'b':
+                    buffer_ += '\b';
+                    break;
+                case 'f':
+                    buffer_ += '\f';
+                    break;
+                case 'n':
+                    buffer_ += '\n';
+                    break;
+                case 'r':
+                    buffer_ += '\r';
+                    break;
+                case 't':
+                    buffer_ += '\t';
+                    break;
+                case 'u':
+                    code_ = 0;
+                    digits_ = 0;
+                    state_ = State::Unicode;
+                    break;
+                default:
+                    return fail();
+            }
+            return true;
+        }
+
+        bool JsonParser::unicode(char c) {
+            uint32_t digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+            else return fail();
+            code_ = (code_ << 4) | digit;
+            if (++digits_ < 4) return true;
+            state_ = State::String;
+            if (surrogate_ != 0) {
+                if (code_ < 0xDC00 || code_ > 0xDFFF) return fail();
+                append_utf8(buffer_, 0x10000 + ((surrogate_ - 0xD800) << 10) + (code_ - 0xDC00));
+                surrogate_ = 0;
+            } else if (code_ >= 0xD800 && code_ <= 0xDBFF) {
+                surrogate_ = code_;
+            } else {
+                append_utf8(buffer_, code_);
+            }
+            return true;
+        }
+
+        bool JsonParser::close(char c) {
+            char open = c == '}' ? '{' : '[';
+            if (stack_.empty() || stack_.back() != open) return fail();
+            stack_.pop_back();
+            if (!(c == '}' ? handler_.on_object_end() : handler_.on_array_end())) return fail();
+            complete();
+            return true;
+        }
+
+        bool JsonParser::number() {
+            // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+            const char *p = buffer_.data(), *end = p + buffer_.size();
+            bool negative = *p == '-', integer = true;
+            if (negative) ++p;
+            if (p == end || !is_digit(*p)) return fail();
+            uint64_t value = 0;
+            bool overflow = false;
+            if (*p == '0') {
+                ++p;
+            } else {
+                for (; p < end && is_digit(*p); ++p) {
+                    uint64_t digit = static_cast<uint64_t>(*p - '0');
+                    if (value > (UINT64_MAX - digit) / 10) overflow = true;
+                    else value = value * 10 + digit;
+                }
+            }
+            if (p < end && *p == '.') {
+                integer = false;
+                if (++p == end || !is_digit(*p)) return fail();
+                while (p < end && is_digit(*p)) ++p;
+            }
+            if (p < end && (*p == 'e' || *p == 'E')) {
+                integer = false;
+                if (++p < end && (*p == '+' || *p == '-')) ++p;
+                if (p == end || !is_digit(*p)) return fail();
+                while (p < end && is_digit(*p)) ++p;
+            }
+            if (p != end) return fail();
+            bool accepted;
+            if (integer && !overflow && !negative) {
+                accepted = handler_.on_uint(value);
+            } else if (integer && !overflow && value <= static_cast<uint64_t>(INT64_MAX) + 1) {
+                accepted = handler_.on_int(static_cast<int64_t>(0 - value));
+            } else {
+                accepted = handler_.on_double(std::strtod(buffer_.c_str(), nullptr));
+            }
+            buffer_.clear();
+            if (!accepted) return fail();
+            complete();
+            return true;
+        }
+
+        bool JsonParser::literal() {
+            bool accepted;
+            switch (literal_[0]) {
+                case 't':
+                    accepted = handler_.on_bool(true);
+                    break;
+                case 'f':
+                    accepted = handler_.on_bool(false);
+                    break;
+                default:
+                    accepted = handler_.on_null();
+            }
+            if (!accepted) return fail();
+            complete();
+            return true;
+        }
+
+        Json::Value &JsonBuilder::slot() {
+            if (stack_.empty()) return root_;
+            Json::Value &top = *stack_.back();
+            if (top.isArray()) return top.append(Json::Value());
+            return top[key_];
+        }
+
+        bool JsonBuilder::on_null() {
+            slot() = Json::Value();
+            return true;
+        }
+
+        bool JsonBuilder::on_bool(bool value) {
+            slot() = Json::Value(value);
+            return true;
+        }
+
+        bool JsonBuilder::on_int(int64_t value) {
+            slot() = Json::Value(static_cast<Json::Int64>(value));
+            return true;
+        }
+
+        bool JsonBuilder::on_uint(uint64_t value) {
+            // Same types as Json::Reader: int while it fits into 32 bits
+            if (value <= static_cast<uint64_t>(Json::Value::maxInt))
+                slot() = Json::Value(static_cast<Json::Int64>(value));
+            else
+                slot() = Json::Value(static_cast<Json::UInt64>(value));
+            return true;
+        }
+
+        bool JsonBuilder::on_double(double value) {
+            slot() = Json::Value(value);
+            return true;
+        }
+
+        bool JsonBuilder::on_string(const char *data, size_t size) {
+            slot() = Json::Value(data, data + size);
+            return true;
+        }
+
+        bool JsonBuilder::on_key(const char *data, size_t size) {
+            key_.assign(data, size);
+            return true;
+        }
+
+        bool JsonBuilder::on_object_begin() {
+            Json::Value &value = slot();
+            value = Json::Value(Json::objectValue);
+            stack_.push_back(&value);
+            return true;
+        }
+
+        bool JsonBuilder::on_object_end() {
+            stack_.pop_back();
+            return true;
+        }
+
+        bool JsonBuilder::on_array_begin() {
+            Json::Value &value = slot();
+            value = Json::Value(Json::arrayValue);
+            stack_.push_back(&value);
+            return true;
+        }
+
+        bool JsonBuilder::on_array_end() {
+            stack_.pop_back();
+            return true;
+        }
+
+        bool parse_json(const char *data, size_t size, Json::Value &value, size_t max_depth) {
+            value = Json::Value();
+            JsonBuilder builder(value);
+            JsonParser parser(builder, max_depth);
+            return parser.feed(data, size) && parser.finish();
+        }
+    }
+}
@@ -0,0 +1,193 @@
+#ifndef SCGI_JSON_PARSER_H
+#define SCGI_JSON_PARSER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <jsoncpp/json/value.h>
+
+namespace scgi {
+    namespace service {
+
+        /**
+         * Streaming (event driven) JSON parser. Document may be fed by chunks of any size as they come from socket:
+         * values are passed to handler as soon as they are complete, only current string or number and stack of
+         * containers are kept by parser. Nesting deeper than `max_depth` containers is an error
+         */
+        class JsonParser {
+        public:
+
+            /**
+             * Receiver of parsed values. Returning false aborts parsing. Strings are valid only during call
+             */
+            class Handler {
+            public:
+                virtual bool on_null() { return true; }
+
+                virtual bool on_bool(bool) { return true; }
+
+                /**
+                 * Negative integer
+                 */
+                virtual bool on_int(int64_t) { return true; }
+
+                /**
+                 * Non-negative integer
+                 */
+                virtual bool on_uint(uint64_t) { return true; }
+
+                /**
+                 * Number with fraction or exponent, or integer out of 64 bits
+                 */
+                virtual bool on_double(double) { return true; }
+
+                virtual bool on_string(const char *, size_t) { return true; }
+
+                /**
+                 * Name of next member of object
+                 */
+                virtual bool on_key(const char *, size_t) { return true; }
+
+                virtual bool on_object_begin() { return true; }
+
+                virtual bool on_object_end() { return true; }
+
+                virtual bool on_array_begin() { return true; }
+
+                virtual bool on_array_end() { return true; }
+
+                virtual ~Handler() { }
+            };
+
+            explicit JsonParser(Handler &handler, size_t max_depth = 256);
+
+            /**
+             * Consume next chunk of document. Returns false on error
+             */
+            bool feed(const char *data, size_t size);
+
+            /**
+             * End of document: completes top-level number. Returns true if whole document is parsed
+             */
+            bool finish();
+
+            inline bool is_done() const {
+                return state_ == State::Done;
+            }
+
+            inline bool is_failed() const {
+                return state_ == State::Error;
+            }
+
+        private:
+            enum class State {
+                Value,
+                // After '[': value or ']'
+                FirstItem,
+                // After '{': key or '}'
+                FirstKey,
+                // After ','
+                Key,
+                Colon,
+                // After item or member: ',' or end of container
+                Next,
+                String,
+                Escape,
+                Unicode,
+                Number,
+                Literal,
+                Done,
+                Error
+            };
+
+            Handler &handler_;
+            size_t max_depth_;
+            State state_ = State::Value;
+            // Open containers: '{' or '['
+            std::vector<char> stack_;
+            // Not complete string or number
+            std::string buffer_;
+            // String is name of member
+            bool key_ = false;
+            const char *literal_ = nullptr;
+            size_t matched_ = 0;
+            // Code point of \u escape and count of its hex digits
+            uint32_t code_ = 0;
+            size_t digits_ = 0;
+            // High surrogate waiting for low one
+            uint32_t surrogate_ = 0;
+
+            const char *begin_value(const char *p);
+
+            const char *read_string(const char *p, const char *end);
+
+            bool escape(char c);
+
+            bool unicode(char c);
+
+            bool close(char c);
+
+            bool number();
+
+            bool literal();
+
+            /**
+             * Value is complete: expect next item or end of document
+             */
+            inline void complete() {
+                state_ = stack_.empty() ? State::Done : State::Next;
+            }
+
+            inline bool fail() {
+                state_ = State::Error;
+                return false;
+            }
+        };
+
+        /**
+         * Handler building `Json::Value` (same values as `Json::Reader`)
+         */
+        class JsonBuilder : public JsonParser::Handler {
+        public:
+            explicit JsonBuilder(Json::Value &root) : root_(root) { }
+
+            bool on_null() override;
+
+            bool on_bool(bool value) override;
+
+            bool on_int(int64_t value) override;
+
+            bool on_uint(uint64_t value) override;
+
+            bool on_double(double value) override;
+
+            bool on_string(const char *data, size_t size) override;
+
+            bool on_key(const char *data, size_t size) override;
+
+            bool on_object_begin() override;
+
+            bool on_object_end() override;
+
+            bool on_array_begin() override;
+
+            bool on_array_end() override;
+
+        private:
+            Json::Value &root_;
+            std::vector<Json::Value *> stack_;
+            std::string key_;
+
+            /**
+             * Place of next value: root, new item of array or member `key_` of object
+             */
+            Json::Value &slot();
+        };
+
+        /**
+         * Parse whole JSON document
+         */
+        bool parse_json(const char *data, size_t size, Json::Value &value, size_t max_depth = 256);
+    }
+}
+#endif //SCGI_JSON_PARSER_H
@@ -0,0 +1,301 @@
+#ifndef SCGI_JSON_TRAITS_H
+#define SCGI_JSON_TRAITS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <limits>
+#include <type_traits>
+#include <jsoncpp/json/value.h>
+#include "json_parser.h"
+
+namespace scgi {
+    namespace service {
+
+        /**
+         * Mapping of C++ type to JSON: schema type, decoding from and encoding to Json::Value.
+         * Specialize it to use own types as arguments or results of typed methods
+         */
+        template<class T, class Enable = void>
+        struct JsonTraits;
+
+        /**
+         * Can `value` be used where type `expected` is declared: integers are accepted as reals and
+         * non-negative integers as unsigned (and back while they fit)
+         */
+        inline bool is_json_compatible(const Json::Value &value, Json::ValueType expected) {
+            switch (expected) {
+                case Json::nullValue:
+                    return true;
+                case Json::intValue:
+                    return value.isInt64();
+                case Json::uintValue:
+                    return value.isUInt64();
+                case Json::realValue:
+                    return value.isNumeric() && !value.isBool();
+                default:
+                    return value.type() == expected;
+            }
+        }
+
+        template<>
+        struct JsonTraits<bool> {
+            static const Json::ValueType type = Json::booleanValue;
+
+            static inline bool decode(const Json::Value &value, bool &result) {
+                if (!value.isBool()) return false;
+                result = value.asBool();
+                return true;
+            }
+
+            static inline void encode(bool value, Json::Value &result) {
+                result = value;
+            }
+        };
+
+        template<class T>
+        struct JsonTraits<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type> {
+            static const Json::ValueType type = Json::intValue;
+
+            static inline bool decode(const Json::Value &value, T &result) {
+                if (!value.isInt64()) return false;
+                Json::Int64 number = value.asInt64();
+                if (number < std::numeric_limits<T>::min() || number > std::numeric_limits<T>::max()) return false;
+                result = static_cast<T>(number);
+                return true;
+            }
+
+            static inline void encode(T value, Json::Value &result) {
+                result = static_cast<Json::Int64>(value);
+            }
+        };
+
+        template<class T>
+        struct JsonTraits<T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value &&
+                                                     !std::is_same<T, bool>::value>::type> {
+            static const Json::ValueType type = Json::uintValue;
+
+            static inline bool decode(const Json::Value &value, T &result) {
+                if (!value.isUInt64()) return false;
+                Json::UInt64 number = value.asUInt64();
+                if (number > std::numeric_limits<T>::max()) return false;
+                result = static_cast<T>(number);
+                return true;
+            }
+
+            static inline void encode(T value, Json::Value &result) {
+                result = static_cast<Json::UInt64>(value);
+            }
+        };
+
+        template<class T>
+        struct JsonTraits<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+            static const Json::ValueType type = Json::realValue;
+
+            static inline bool decode(const Json::Value &value, T &result) {
+                if (!is_json_compatible(value, type)) return false;
+                result = static_cast<T>(value.asDouble());
+                return true;
+            }
+
+            static inline void encode(T value, Json::Value &result) {
+                result = static_cast<double>(value);
+            }
+        };
+
+        template<>
+        struct JsonTraits<std::string> {
+            static const Json::ValueType type = Json::stringValue;
+
+            static inline bool decode(const Json::Value &value, std::string &result) {
+                const char *begin = nullptr, *end = nullptr;
+                if (!value.isString()) return false;
+                if (value.getString(&begin, &end)) result.assign(begin, end); else result.clear();
+                return true;
+            }
+
+            static inline void encode(const std::string &value, Json::Value &result) {
+                result = value;
+            }
+        };
+
+        /**
+         * Any JSON value is passed as is
+         */
+        template<>
+        struct JsonTraits<Json::Value> {
+            static const Json::ValueType type = Json::nullValue;
+
+            static inline bool decode(const Json::Value &value, Json::Value &result) {
+                result = value;
+                return true;
+            }
+
+            static inline void encode(const Json::Value &value, Json::Value &result) {
+                result = value;
+            }
+        };
+
+        template<class T>
+        struct JsonTraits<std::vector<T>> {
+            static const Json::ValueType type = Json::arrayValue;
+
+            static inline bool decode(const Json::Value &value, std::vector<T> &result) {
+                if (!value.isArray()) return false;
+                result.resize(value.size());
+                for (Json::ArrayIndex i = 0; i < value.size(); ++i) {
+                    T item;
+                    if (!JsonTraits<T>::decode(value[i], item)) return false;
+                    result[i] = std::move(item);
+                }
+                return true;
+            }
+
+            static inline void encode(const std::vector<T> &value, Json::Value &result) {
+                result = Json::Value(Json::arrayValue);
+                result.resize(static_cast<Json::ArrayIndex>(value.size()));
+                for (size_t i = 0; i < value.size(); ++i)
+                    JsonTraits<T>::encode(value[i], result[static_cast<Json::ArrayIndex>(i)]);
+            }
+        };
+
+        /**
+         * Compile-time sequence of indexes (C++11 replacement of std::index_sequence)
+         */
+        template<size_t ...I>
+        struct Indices {
+        };
+
+        template<size_t N, size_t ...I>
+        struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {
+        };
+
+        template<size_t ...I>
+        struct MakeIndices<0, I...> {
+            typedef Indices<I...> type;
+        };
+
+        /**
+         * Decoder of one argument from parser events of its value. Wrong type doesn't stop parsing: argument is
+         * marked invalid and rest of its events are consumed
+         */
+        class ArgumentReader : public JsonParser::Handler {
+        public:
+            /**
+             * Was value of argument passed
+             */
+            inline bool is_passed() const {
+                return passed_;
+            }
+
+            /**
+             * Was passed value decoded
+             */
+            inline bool is_valid() const {
+                return valid_;
+            }
+
+        protected:
+            // Depth of open containers of current value
+            size_t depth_ = 0;
+            bool passed_ = false;
+            bool valid_ = false;
+
+            inline bool complete(bool decoded) {
+                passed_ = true;
+                valid_ = decoded;
+                return true;
+            }
+        };
+
+        /**
+         * Decoder of value of type T from parser events. Scalars are decoded by JsonTraits<T> without building
+         * tree and strings are assigned to std::string directly; arrays and objects are built into Json::Value
+         * first. Results are the same as of decoding value built by JsonBuilder
+         */
+        template<class T>
+        class TypedArgumentReader : public ArgumentReader {
+        public:
+            explicit TypedArgumentReader(T &result) : result_(result), builder_(tree_) { }
+
+            bool on_null() override {
+                if (depth_ > 0) return builder_.on_null();
+                return complete(JsonTraits<T>::decode(Json::Value(), result_));
+            }
+
+            bool on_bool(bool value) override {
+                if (depth_ > 0) return builder_.on_bool(value);
+                return complete(JsonTraits<T>::decode(Json::Value(value), result_));
+            }
+
+            bool on_int(int64_t value) override {
+                if (depth_ > 0) return builder_.on_int(value);
+                return complete(JsonTraits<T>::decode(Json::Value(static_cast<Json::Int64>(value)), result_));
+            }
+
+            bool on_uint(uint64_t value) override {
+                if (depth_ > 0) return builder_.on_uint(value);
+                // Same types as JsonBuilder
+                if (value <= static_cast<uint64_t>(Json::Value::maxInt))
+                    return complete(JsonTraits<T>::decode(Json::Value(static_cast<Json::Int64>(value)), result_));
+                return complete(JsonTraits<T>::decode(Json::Value(static_cast<Json::UInt64>(value)), result_));
+            }
+
+            bool on_double(double value) override {
+                if (depth_ > 0) return builder_.on_double(value);
+                return complete(JsonTraits<T>::decode(Json::Value(value), result_));
+            }
+
+            bool on_string(const char *data, size_t size) override {
+                if (depth_ > 0) return builder_.on_string(data, size);
+                return complete(decode_string(result_, data, size));
+            }
+
+            bool on_key(const char *data, size_t size) override {
+                return builder_.on_key(data, size);
+            }
+
+            bool on_object_begin() override {
+                ++depth_;
+                return builder_.on_object_begin();
+            }
+
+            bool on_object_end() override {
+                return builder_.on_object_end() && close();
+            }
+
+            bool on_array_begin() override {
+                ++depth_;
+                return builder_.on_array_begin();
+            }
+
+            bool on_array_end() override {
+                return builder_.on_array_end() && close();
+            }
+
+        private:
+            T &result_;
+            // Tree of array or object value
+            Json::Value tree_;
+            JsonBuilder builder_;
+
+            inline bool close() {
+                if (--depth_ > 0) return true;
+                bool decoded = JsonTraits<T>::decode(tree_, result_);
+                tree_ = Json::Value();
+                return complete(decoded);
+            }
+
+            static inline bool decode_string(std::string &result, const char *data, size_t size) {
+                result.assign(data, size);
+                return true;
+            }
+
+            template<class Other>
+            static inline bool decode_string(Other &result, const char *data, size_t size) {
+                return JsonTraits<Other>::decode(Json::Value(data, data + size), result);
+            }
+        };
+    }
+}
+#endif //SCGI_JSON_TRAITS_H
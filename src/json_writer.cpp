@@ -0,0 +1,305 @@
+#include "json_writer.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+namespace scgi {
+    namespace service {
+
+        /**
+         * Recursive serializer over raw stream buffer
+         */
+        class JsonWriter {
+        public:
+            JsonWriter(std::streambuf &out, JsonStyle style) : out_(out), pretty_(style == JsonStyle::Pretty) { }
+
+            void write(const Json::Value &value, size_t depth) {
+                switch (value.type()) {
+                    case Json::nullValue:
+                        put("null", 4);
+                        break;
+                    case Json::booleanValue:
+                        if (value.asBool()) put("true", 4); else put("false", 5);
+                        break;
+                    case Json::intValue: {
+                        Json::Int64 number = value.asInt64();
+                        // Negate in unsigned domain to handle minimal value
+                        Json::UInt64 magnitude = number < 0 ? 0 - static_cast<Json::UInt64>(number)
+                                                            : static_cast<Json::UInt64>(number);
+                        write_unsigned(magnitude, number < 0);
+                        break;
+                    }
+                    case Json::uintValue:
+                        write_unsigned(value.asUInt64(), false);
+                        break;
+                    case Json::realValue:
+                        write_real(value.asDouble());
+                        break;
+                    case Json::stringValue: {
+                        const char *begin = nullptr, *end = nullptr;
+                        value.getString(&begin, &end);
+                        write_string(begin, end);
+                        break;
+                    }
+                    case Json::arrayValue: {
+                        Json::ArrayIndex size = value.size();
+                        if (size == 0) {
+                            put("[]", 2);
+                            break;
+                        }
+                        out_.sputc('[');
+                        for (Json::ArrayIndex i = 0; i < size; ++i) {
+                            if (i > 0) out_.sputc(',');
+                            indent(depth + 1);
+                            write(value[i], depth + 1);
+                        }
+                        indent(depth);
+                        out_.sputc(']');
+                        break;
+                    }
+                    case Json::objectValue: {
+                        if (value.empty()) {
+                            put("{}", 2);
+                            break;
+                        }
+                        out_.sputc('{');
+                        bool first = true;
+                        for (auto iter = value.begin(); iter != value.end(); ++iter) {
+                            if (!first) out_.sputc(',');
+                            first = false;
+                            indent(depth + 1);
+                            const char *end = nullptr;
+                            const char *name = iter.memberName(&end);
+                            write_string(name, end);
+                            if (pretty_) put(" : ", 3); else out_.sputc(':');
+                            write(*iter, depth + 1);
+                        }
+                        indent(depth);
+                        out_.sputc('}');
+                        break;
+                    }
+                }
+            }
+
+            inline void put(const char *data, size_t size) {
+                out_.sputn(data, static_cast<std::streamsize>(size));
+            }
+
+            inline void indent(size_t depth) {
+                if (!pretty_) return;
+                out_.sputc('\n');
+                for (size_t i = 0; i < depth; ++i) put("   ", 3);
+            }
+
+            void write_unsigned(Json::UInt64 number, bool negative) {
+                char buffer[24];
+                char *ptr = buffer + sizeof(buffer);
+                do {
+                    *--ptr = static_cast<char>('0' + number % 10);
+                    number /= 10;
+                } while (number > 0);
+                if (negative) *--ptr = '-';
+                put(ptr, static_cast<size_t>(buffer + sizeof(buffer) - ptr));
+            }
+
+            void write_real(double number) {
+                if (!std::isfinite(number)) {
+                    put("null", 4);
+                    return;
+                }
+                // Shortest of common precisions which restores the same value
+                char buffer[32];
+                int size = 0;
+                for (int precision = 15; precision <= 17; ++precision) {
+                    size = std::snprintf(buffer, sizeof(buffer), "%.*g", precision, number);
+                    if (std::strtod(buffer, nullptr) == number) break;
+                }
+                put(buffer, static_cast<size_t>(size));
+                // Keep value real after parsing
+                for (int i = 0; i < size; ++i) {
+                    if (buffer[i] == '.' || buffer[i] == 'e') return;
+                }
+                put(".0", 2);
+            }
+
+            void write_string(const char *begin, const char *end) {
+                static const char hex[] = "0123456789abcdef";
+                out_.sputc('"');
+                const char *run = begin;
+                for (const char *ptr = begin; ptr < end; ++ptr) {
+                    unsigned char c = static_cast<unsigned char>(*ptr);
+                    if (c >= 0x20 && c != '"' && c != '\\') continue;
+                    put(run, static_cast<size_t>(ptr - run));
+                    run = ptr + 1;
+                    switch (c) {
+                        case '"':
+                            put("\\\"", 2);
+                            break;
+                        case '\\':
+                            put("\\\\", 2);
+                            break;
+                        case '\n':
+                            put("\\n", 2);
+                            break;
+                        case '\r':
+                            put("\\r", 2);
+                            break;
+                        case '\t':
+                            put("\\t", 2);
+                            break;
+                        case '\b':
+                            put("\\b", 2);
+                            break;
+                        case '\f':
+                            put("\\f", 2);
+                            break;
+                        default: {
+                            char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                            put(escaped, sizeof(escaped));
+                        }
+                    }
+                }
+                put(run, static_cast<size_t>(end - run));
+                out_.sputc('"');
+            }
+
+        private:
+            std::streambuf &out_;
+            bool pretty_;
+        };
+
+        void write_json(std::streambuf &out, const Json::Value &value, JsonStyle style) {
+            JsonWriter(out, style).write(value, 0);
+            if (style == JsonStyle::Pretty) out.sputc('\n');
+        }
+
+        std::string to_json(const Json::Value &value, JsonStyle style) {
+            std::stringstream ss;
+            write_json(ss, value, style);
+            return ss.str();
+        }
+
+        JsonStream::JsonStream(std::streambuf &out, JsonStyle style) : out_(&out), style_(style) { }
+
+        JsonStream::JsonStream(JsonStream &&other)
+                : out_(other.out_), style_(other.style_), stack_(std::move(other.stack_)), started_(other.started_),
+                  finished_(other.finished_) {
+            other.finished_ = true;
+        }
+
+        void JsonStream::prepare() {
+            if (finished_) throw std::logic_error("JSON stream is finished");
+            if (stack_.empty()) {
+                if (started_) throw std::logic_error("JSON stream already has root value");
+                started_ = true;
+                return;
+            }
+            Frame &top = stack_.back();
+            if (top.object) {
+                if (!top.has_key) throw std::logic_error("Key of JSON object member is expected");
+                top.has_key = false;
+                return;
+            }
+            if (!top.empty) out_->sputc(',');
+            top.empty = false;
+            JsonWriter(*out_, style_).indent(stack_.size());
+        }
+
+        void JsonStream::written() {
+            // Same layout as write_json
+            if (stack_.empty() && style_ == JsonStyle::Pretty) out_->sputc('\n');
+        }
+
+        JsonStream &JsonStream::begin(bool object) {
+            prepare();
+            out_->sputc(object ? '{' : '[');
+            stack_.push_back(Frame{object, true, false});
+            return *this;
+        }
+
+        JsonStream &JsonStream::begin_array() {
+            return begin(false);
+        }
+
+        JsonStream &JsonStream::begin_object() {
+            return begin(true);
+        }
+
+        JsonStream &JsonStream::key(const char *name, size_t size) {
+            if (stack_.empty() || !stack_.back().object || stack_.back().has_key)
+                throw std::logic_error("Key is allowed only for member of JSON object");
+            Frame &top = stack_.back();
+            if (!top.empty) out_->sputc(',');
+            top.empty = false;
+            top.has_key = true;
+            JsonWriter writer(*out_, style_);
+            writer.indent(stack_.size());
+            writer.write_string(name, name + size);
+            if (style_ == JsonStyle::Pretty) writer.put(" : ", 3); else out_->sputc(':');
+            return *this;
+        }
+
+        JsonStream &JsonStream::end() {
+            if (stack_.empty() || stack_.back().has_key) throw std::logic_error("No JSON container to end");
+            Frame top = stack_.back();
+            stack_.pop_back();
+            if (!top.empty) JsonWriter(*out_, style_).indent(stack_.size());
+            out_->sputc(top.object ? '}' : ']');
+            written();
+            return *this;
+        }
+
+        JsonStream &JsonStream::value(const Json::Value &value) {
+            prepare();
+            JsonWriter(*out_, style_).write(value, stack_.size());
+            written();
+            return *this;
+        }
+
+        JsonStream &JsonStream::value(const char *data, size_t size) {
+            prepare();
+            JsonWriter(*out_, style_).write_string(data, data + size);
+            written();
+            return *this;
+        }
+
+        JsonStream &JsonStream::null() {
+            return literal("null");
+        }
+
+        JsonStream &JsonStream::literal(const char *text) {
+            prepare();
+            JsonWriter(*out_, style_).put(text, std::char_traits<char>::length(text));
+            written();
+            return *this;
+        }
+
+        JsonStream &JsonStream::integer(uint64_t magnitude, bool negative) {
+            prepare();
+            JsonWriter(*out_, style_).write_unsigned(magnitude, negative);
+            written();
+            return *this;
+        }
+
+        JsonStream &JsonStream::real(double number) {
+            prepare();
+            JsonWriter(*out_, style_).write_real(number);
+            written();
+            return *this;
+        }
+
+        void JsonStream::finish() {
+            if (finished_) return;
+            // Member without value is completed by null
+            if (!stack_.empty() && stack_.back().has_key) null();
+            while (!stack_.empty()) end();
+            finished_ = true;
+        }
+
+        JsonStream::~JsonStream() {
+            finish();
+        }
+    }
+}
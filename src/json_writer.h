@@ -0,0 +1,147 @@
+#ifndef SCGI_JSON_WRITER_H
+#define SCGI_JSON_WRITER_H
+
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <cstdint>
+#include <jsoncpp/json/value.h>
+
+namespace scgi {
+    namespace service {
+
+        /**
+         * Layout of serialized JSON
+         */
+        enum class JsonStyle {
+            // No whitespaces. For machine clients
+            Compact,
+            // Indented, one member per line. For humans and debugging
+            Pretty
+        };
+
+        /**
+         * Serialize `value` directly into stream buffer `out` (ex: request output) without intermediate string.
+         * Not finite numbers are written as null
+         */
+        void write_json(std::streambuf &out, const Json::Value &value, JsonStyle style = JsonStyle::Compact);
+
+        inline void write_json(std::ostream &out, const Json::Value &value, JsonStyle style = JsonStyle::Compact) {
+            write_json(*out.rdbuf(), value, style);
+        }
+
+        /**
+         * Serialize `value` to string
+         */
+        std::string to_json(const Json::Value &value, JsonStyle style = JsonStyle::Compact);
+
+        /**
+         * Incremental JSON serializer: document is written item by item directly into stream buffer `out`, so
+         * large arrays and objects are not built in memory. Containers left open are closed by `finish` (or by
+         * destructor). Calls out of order (ex: value in object without key) throw std::logic_error
+         */
+        class JsonStream {
+        public:
+            explicit JsonStream(std::streambuf &out, JsonStyle style = JsonStyle::Compact);
+
+            JsonStream(JsonStream &&other);
+
+            JsonStream &begin_array();
+
+            JsonStream &begin_object();
+
+            /**
+             * Name of next member of current object
+             */
+            JsonStream &key(const char *name, size_t size);
+
+            inline JsonStream &key(const std::string &name) {
+                return key(name.data(), name.size());
+            }
+
+            /**
+             * Close innermost array or object
+             */
+            JsonStream &end();
+
+            JsonStream &value(const Json::Value &value);
+
+            JsonStream &value(const char *data, size_t size);
+
+            inline JsonStream &value(const std::string &data) {
+                return value(data.data(), data.size());
+            }
+
+            inline JsonStream &value(const char *data) {
+                return value(data, std::char_traits<char>::length(data));
+            }
+
+            /**
+             * Number or boolean
+             */
+            template<class T>
+            typename std::enable_if<std::is_arithmetic<T>::value, JsonStream &>::type value(T number) {
+                if (std::is_same<T, bool>::value) return literal(number ? "true" : "false");
+                if (std::is_floating_point<T>::value) return real(static_cast<double>(number));
+                if (std::is_signed<T>::value && number < 0)
+                    return integer(0 - static_cast<uint64_t>(static_cast<int64_t>(number)), true);
+                return integer(static_cast<uint64_t>(number), false);
+            }
+
+            JsonStream &null();
+
+            /**
+             * Close all open containers. Only first call has effect
+             */
+            void finish();
+
+            /**
+             * Count of open containers
+             */
+            inline size_t depth() const {
+                return stack_.size();
+            }
+
+            ~JsonStream();
+
+        private:
+            struct Frame {
+                bool object;
+                bool empty;
+                // Key of object member is written, value is expected
+                bool has_key;
+            };
+
+            std::streambuf *out_;
+            JsonStyle style_;
+            std::vector<Frame> stack_;
+            bool started_ = false;
+            bool finished_ = false;
+
+            /**
+             * Write separator before next value
+             */
+            void prepare();
+
+            /**
+             * Value is complete
+             */
+            void written();
+
+            JsonStream &begin(bool object);
+
+            JsonStream &literal(const char *text);
+
+            JsonStream &integer(uint64_t magnitude, bool negative);
+
+            JsonStream &real(double number);
+
+            JsonStream(const JsonStream &) = delete;
+
+            JsonStream &operator=(const JsonStream &) = delete;
+        };
+    }
+}
+#endif //SCGI_JSON_WRITER_H
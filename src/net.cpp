@@ -0,0 +1,94 @@
+#include "net.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+
+namespace scgi {
+    namespace net {
+
+        int listen_tcp(const std::string &host, const std::string &service, int backlog, bool reuse_port) {
+            addrinfo hints{}, *result = nullptr;
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = AI_PASSIVE;
+            if (getaddrinfo(host.empty() ? nullptr : host.c_str(), service.c_str(), &hints, &result) != 0)
+                return -1;
+            int fd = -1;
+            for (addrinfo *info = result; info != nullptr; info = info->ai_next) {
+                fd = socket(info->ai_family, info->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, info->ai_protocol);
+                if (fd < 0) continue;
+                int enable = 1;
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+                if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+                    close(fd);
+                    fd = -1;
+                    continue;
+                }
+                if (bind(fd, info->ai_addr, info->ai_addrlen) == 0 && listen(fd, backlog) == 0) break;
+                close(fd);
+                fd = -1;
+            }
+            freeaddrinfo(result);
+            return fd;
+        }
+
+        int listen_unix(const std::string &path, int backlog) {
+            sockaddr_un address{};
+            if (path.size() >= sizeof(address.sun_path)) return -1;
+            address.sun_family = AF_UNIX;
+            std::memcpy(address.sun_path, path.data(), path.size());
+            int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0) return -1;
+            unlink(path.c_str());
+            if (bind(fd, (sockaddr *) &address, sizeof(address)) != 0 || listen(fd, backlog) != 0) {
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        bool resolve(const std::string &address, Address &result) {
+            result = Address();
+            if (address.compare(0, 5, "unix:") == 0 || address.find('/') != std::string::npos) {
+                std::string path = address.compare(0, 5, "unix:") == 0 ? address.substr(5) : address;
+                sockaddr_un unix_address{};
+                if (path.empty() || path.size() >= sizeof(unix_address.sun_path)) return false;
+                unix_address.sun_family = AF_UNIX;
+                std::memcpy(unix_address.sun_path, path.data(), path.size());
+                std::memcpy(&result.storage, &unix_address, sizeof(unix_address));
+                result.size = sizeof(unix_address);
+                return true;
+            }
+            size_t colon = address.rfind(':');
+            if (colon == std::string::npos) return false;
+            std::string host = address.substr(0, colon);
+            // IPv6 literal in brackets: [::1]:8080
+            if (host.size() >= 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+            addrinfo hints{}, *info = nullptr;
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            if (getaddrinfo(host.empty() ? nullptr : host.c_str(), address.c_str() + colon + 1, &hints, &info) != 0)
+                return false;
+            bool found = info != nullptr && info->ai_addrlen <= sizeof(result.storage);
+            if (found) {
+                std::memcpy(&result.storage, info->ai_addr, info->ai_addrlen);
+                result.size = info->ai_addrlen;
+            }
+            freeaddrinfo(info);
+            return found;
+        }
+
+        int connect(const Address &address) {
+            int fd = socket(address.storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0) return -1;
+            if (::connect(fd, (const sockaddr *) &address.storage, address.size) != 0 && errno != EINPROGRESS) {
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+    }
+}
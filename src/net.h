@@ -0,0 +1,46 @@
+#ifndef SCGI_NET_H
+#define SCGI_NET_H
+
+#include <string>
+#include <sys/socket.h>
+
+namespace scgi {
+    namespace net {
+
+        /**
+         * Create non-blocking TCP listening socket bound to `host` (empty - all interfaces) and `service` (port).
+         * With `reuse_port` several sockets may be bound to same address and kernel balances connections
+         * between them (SO_REUSEPORT).
+         * Returns descriptor or -1 on error
+         */
+        int listen_tcp(const std::string &host, const std::string &service, int backlog = 1024,
+                       bool reuse_port = false);
+
+        /**
+         * Create non-blocking UNIX listening socket bound to `path`. Old socket file is removed.
+         * Returns descriptor or -1 on error
+         */
+        int listen_unix(const std::string &path, int backlog = 1024);
+
+        /**
+         * Resolved socket address
+         */
+        struct Address {
+            sockaddr_storage storage;
+            socklen_t size = 0;
+        };
+
+        /**
+         * Resolve `address`: `unix:/path` (or any path with slash) for UNIX socket, `host:port` for TCP.
+         * Returns false if address is malformed or unknown
+         */
+        bool resolve(const std::string &address, Address &result);
+
+        /**
+         * Start non-blocking connection to `address`. Connection is complete when socket is writable.
+         * Returns descriptor or -1 on error
+         */
+        int connect(const Address &address);
+    }
+}
+#endif //SCGI_NET_H
@@ -0,0 +1,131 @@
+#include "parser.h"
+#include <algorithm>
+
+namespace scgi {
+
+    // Length prefix of SCGI netstring can not be longer
+    static const size_t max_length_digits = 10;
+
+    RequestParser::RequestParser(size_t body_limit) : body_limit_(body_limit) { }
+
+    size_t RequestParser::feed(const char *data, size_t size) {
+        size_t consumed = 0;
+        if (first_byte_ == 0 && size > 0 && trace::enabled()) first_byte_ = trace::now();
+        while (consumed < size) {
+            switch (state_) {
+                case State::Length: {
+                    char c = data[consumed++];
+                    if (c >= '0' && c <= '9' && digits_ < max_length_digits) {
+                        header_length_ = header_length_ * 10 + (c - '0');
+                        ++digits_;
+                    } else if (c == ':' && digits_ > 0 && header_length_ <= header::max_length) {
+                        header_block_.buffer().reserve(header_length_);
+                        state_ = header_length_ > 0 ? State::Headers : State::Comma;
+                    } else {
+                        state_ = State::Error;
+                    }
+                    break;
+                }
+                case State::Headers: {
+                    auto &buffer = header_block_.buffer();
+                    size_t chunk = std::min(size - consumed, header_length_ - buffer.size());
+                    buffer.insert(buffer.end(), data + consumed, data + consumed + chunk);
+                    consumed += chunk;
+                    if (buffer.size() == header_length_) state_ = State::Comma;
+                    break;
+                }
+                case State::Comma:
+                    if (data[consumed++] != ',' || !header_block_.index())
+                        state_ = State::Error;
+                    else
+                        complete_headers();
+                    break;
+                case State::Body: {
+                    size_t chunk = std::min(size - consumed, content_length_ - body_.size());
+                    body_.insert(body_.end(), data + consumed, data + consumed + chunk);
+                    consumed += chunk;
+                    if (body_.size() == content_length_) {
+                        body_buffered_ = true;
+                        state_ = State::Done;
+                        if (first_byte_ != 0) done_ = trace::now();
+                    }
+                    break;
+                }
+                case State::Done:
+                case State::Error:
+                    return consumed;
+            }
+        }
+        return consumed;
+    }
+
+    size_t RequestParser::wanted() const {
+        switch (state_) {
+            case State::Length:
+                return max_length_digits + 1 - digits_;
+            case State::Headers:
+                return header_length_ - header_block_.buffer().size() + 1;
+            case State::Comma:
+                return 1;
+            case State::Body:
+                return content_length_ - body_.size();
+            default:
+                return 0;
+        }
+    }
+
+    void RequestParser::complete_headers() {
+        if (first_byte_ != 0) headers_done_ = trace::now();
+        if (!parse_size(header_block_.get(header::Slot::content_length), content_length_, max_content_length)) {
+            content_length_ = 0;
+            state_ = State::Error;
+        } else if (content_length_ == 0) {
+            body_buffered_ = true;
+            state_ = State::Done;
+        } else if (content_length_ <= body_limit_) {
+            body_.reserve(content_length_);
+            state_ = State::Body;
+        } else {
+            state_ = State::Done;
+        }
+    }
+
+    void RequestParser::reset() {
+        state_ = State::Length;
+        header_length_ = digits_ = content_length_ = 0;
+        body_buffered_ = false;
+        header_block_.clear();
+        body_.clear();
+        accepted_ = first_byte_ = headers_done_ = done_ = 0;
+    }
+
+    void RequestParser::fill_trace(trace::Record &record) const {
+        if (first_byte_ == 0) return;
+        if (accepted_ != 0) {
+            record.mark_begin(trace::Phase::Accept, accepted_);
+            record.mark_end(trace::Phase::Accept, first_byte_);
+        }
+        if (headers_done_ == 0) return;
+        record.mark_begin(trace::Phase::ReadHeaders, first_byte_);
+        record.mark_end(trace::Phase::ReadHeaders, headers_done_);
+        if (done_ == 0) return;
+        record.mark_begin(trace::Phase::ReadBody, headers_done_);
+        record.mark_end(trace::Phase::ReadBody, done_);
+    }
+
+    size_t parse_size(const StringRef &value) {
+        size_t result = 0;
+        return parse_size(value, result, std::numeric_limits<size_t>::max()) ? result : 0;
+    }
+
+    bool parse_size(const StringRef &value, size_t &result, size_t max_value) {
+        result = 0;
+        for (char c:value) {
+            if (c < '0' || c > '9') break;
+            size_t digit = static_cast<size_t>(c - '0');
+            if (result > (max_value - digit) / 10) return false;
+            result = result * 10 + digit;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef SCGI_PARSER_H
+#define SCGI_PARSER_H
+
+#include <limits>
+#include <cstdint>
+#include <vector>
+#include "headers.h"
+#include "trace.h"
+
+namespace scgi {
+
+    /**
+     * Resumable SCGI request parser. Bytes may be fed in chunks of any size as they arrive from
+     * non-blocking descriptor: netstring length, key-value pairs, trailing comma and (optionally) body.
+     */
+    class RequestParser {
+    public:
+        enum class State {
+            Length,
+            Headers,
+            Comma,
+            Body,
+            Done,
+            Error
+        };
+
+        /**
+         * Bodies not bigger than `body_limit` are buffered by parser. Bigger bodies are left in descriptor
+         * and should be read by consumer. Zero disables body buffering.
+         */
+        explicit RequestParser(size_t body_limit = 1024 * 1024);
+
+        /**
+         * Consume bytes. Parser never consumes more then required for current request.
+         * Returns count of consumed bytes.
+         */
+        size_t feed(const char *data, size_t size);
+
+        /**
+         * Maximum bytes which can be fed without over-reading data of request body that will not be buffered.
+         * SCGI requires CONTENT_LENGTH as first header, so length prefix is always followed by more bytes
+         * then size of prefix itself.
+         */
+        size_t wanted() const;
+
+        inline State state() const {
+            return state_;
+        }
+
+        /**
+         * Headers (and body if it is buffered) completely received
+         */
+        inline bool is_done() const {
+            return state_ == State::Done;
+        }
+
+        inline bool is_failed() const {
+            return state_ == State::Error;
+        }
+
+        /**
+         * Parsed headers. Valid after headers state
+         */
+        inline HeaderBlock &header_block() {
+            return header_block_;
+        }
+
+        /**
+         * Buffered body. Empty if body is not buffered
+         */
+        inline std::vector<char> &body() {
+            return body_;
+        }
+
+        /**
+         * Body is completely buffered by parser
+         */
+        inline bool is_body_buffered() const {
+            return body_buffered_;
+        }
+
+        /**
+         * Value of CONTENT_LENGTH. Valid after headers state
+         */
+        inline size_t content_length() const {
+            return content_length_;
+        }
+
+        /**
+         * Prepare parser for new request but keep allocated memory
+         */
+        void reset();
+
+        inline void set_body_limit(size_t limit) {
+            body_limit_ = limit;
+        }
+
+        /**
+         * Remember time of accepting connection if tracing is enabled
+         */
+        inline void mark_accepted() {
+            if (trace::enabled()) accepted_ = trace::now();
+        }
+
+        /**
+         * Fill phases of receiving (accept, headers, body) into trace record
+         */
+        void fill_trace(trace::Record &record) const;
+
+    private:
+        State state_ = State::Length;
+        size_t body_limit_;
+        size_t header_length_ = 0, digits_ = 0, content_length_ = 0;
+        bool body_buffered_ = false;
+        HeaderBlock header_block_;
+        std::vector<char> body_;
+        // Trace timestamps (zero if tracing was disabled)
+        int64_t accepted_ = 0, first_byte_ = 0, headers_done_ = 0, done_ = 0;
+
+        /**
+         * Index headers and decide what to do with body
+         */
+        void complete_headers();
+    };
+
+    /**
+     * Parse decimal unsigned number. Stops on first non-digit. Zero if number doesn't fit into size_t
+     */
+    size_t parse_size(const StringRef &value);
+
+    /**
+     * Parse decimal unsigned number into `result`. Stops on first non-digit. Returns false if number is bigger
+     * than `max_value`
+     */
+    bool parse_size(const StringRef &value, size_t &result, size_t max_value);
+
+    /**
+     * Maximum accepted CONTENT_LENGTH: it is exposed as signed `Request::content_size()`
+     */
+    static const size_t max_content_length = static_cast<size_t>(std::numeric_limits<long>::max());
+}
+#endif //SCGI_PARSER_H
@@ -8,6 +8,11 @@
 #include <mutex>
 #include <queue>
 #include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <cstdint>
 
 namespace scgi {
     namespace patterns {
@@ -35,17 +40,24 @@ namespace scgi {
              * Returns false if queue is closed
              */
             inline bool pop(T &var) {
-                while (true) {
-                    std::unique_lock<std::mutex> lock(mutex);
-                    if (finalized) break;
-                    if (!queue_.empty()) {
-                        var = queue_.front();
-                        queue_.pop();
-                        return true;
-                    }
-                    monitor.wait(lock);
-                }
-                return false;
+                std::unique_lock<std::mutex> lock(mutex);
+                monitor.wait(lock, [this]() { return finalized || !queue_.empty(); });
+                if (finalized) return false;
+                var = queue_.front();
+                queue_.pop();
+                return true;
+            }
+
+            /**
+             * Get (and pop) one element from queue without waiting.
+             * Returns false if queue is empty or closed
+             */
+            inline bool try_pop(T &var) {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (finalized || queue_.empty()) return false;
+                var = queue_.front();
+                queue_.pop();
+                return true;
             }
 
             /**
@@ -73,10 +85,279 @@ namespace scgi {
 
         private:
             std::queue<T> queue_;
-            volatile bool finalized = false;
+            std::atomic<bool> finalized{false};
             std::condition_variable monitor;
             std::mutex mutex;
         };
+
+        /**
+         * Hint to CPU that thread is spinning
+         */
+        static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+
+        /**
+         * Lock-free bounded multi-producer multi-consumer queue over ring buffer (D. Vyukov algorithm).
+         * Non-blocking operations (`try_*`, `*_bulk`) never take locks. Blocking operations spin for a while
+         * and then park thread on condition variable; producers and consumers touch the mutex only when
+         * somebody is parked.
+         */
+        template<class T>
+        class BoundedQueue {
+        public:
+
+            /**
+             * Create queue with `capacity` rounded up to power of two.
+             * `spin` - count of attempts before parking thread in blocking operations
+             */
+            explicit BoundedQueue(size_t capacity = 4096, size_t spin = 128) : spin_(spin) {
+                size_t size = 2;
+                while (size < capacity) size <<= 1;
+                mask_ = size - 1;
+                cells_ = std::vector<Cell>(size);
+                for (size_t i = 0; i < size; ++i) cells_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+
+            inline size_t capacity() const {
+                return mask_ + 1;
+            }
+
+            /**
+             * Approximate count of items (exact when queue is not modified concurrently)
+             */
+            inline size_t size() const {
+                size_t dequeued = dequeue_pos_.load(std::memory_order_relaxed);
+                size_t enqueued = enqueue_pos_.load(std::memory_order_relaxed);
+                return enqueued > dequeued ? enqueued - dequeued : 0;
+            }
+
+            /**
+             * Push without waiting. Returns false if queue is full or closed
+             */
+            inline bool try_push(const T &var) {
+                if (closed_.load(std::memory_order_relaxed) || !enqueue(var)) return false;
+                notify(pop_waiters_, not_empty_, false);
+                return true;
+            }
+
+            inline bool try_push(T &&var) {
+                if (closed_.load(std::memory_order_relaxed) || !enqueue(std::move(var))) return false;
+                notify(pop_waiters_, not_empty_, false);
+                return true;
+            }
+
+            /**
+             * Pop without waiting. Returns false if queue is empty
+             */
+            inline bool try_pop(T &var) {
+                if (!dequeue(var)) return false;
+                notify(push_waiters_, not_full_, false);
+                return true;
+            }
+
+            /**
+             * Push and wait while queue is full. Returns false if queue is closed
+             */
+            inline bool push(const T &var) {
+                if (!wait_for_cell([this, &var]() { return !closed_ && enqueue(var); }, push_waiters_, not_full_,
+                                   std::chrono::steady_clock::time_point::max()))
+                    return false;
+                notify(pop_waiters_, not_empty_, false);
+                return true;
+            }
+
+            /**
+             * Pop and wait while queue is empty. Returns false if queue is closed and empty
+             */
+            inline bool pop(T &var) {
+                return pop_until(var, std::chrono::steady_clock::time_point::max());
+            }
+
+            /**
+             * Pop and wait at most `timeout` while queue is empty.
+             * Returns false on timeout or if queue is closed and empty
+             */
+            template<class Rep, class Period>
+            inline bool pop_for(T &var, const std::chrono::duration<Rep, Period> &timeout) {
+                return pop_until(var, std::chrono::steady_clock::now() + timeout);
+            }
+
+            /**
+             * Push items from range [first, last) without waiting till queue is full. Consumers are woken once
+             * per batch. Returns count of pushed items
+             */
+            template<class Iterator>
+            inline size_t push_bulk(Iterator first, Iterator last) {
+                size_t pushed = 0;
+                if (closed_.load(std::memory_order_relaxed)) return 0;
+                for (; first != last && enqueue(*first); ++first) ++pushed;
+                if (pushed > 0) notify(pop_waiters_, not_empty_, pushed > 1);
+                return pushed;
+            }
+
+            /**
+             * Pop at most `max` items into output iterator `out` without waiting. Producers are woken once
+             * per batch. Returns count of popped items
+             */
+            template<class OutputIterator>
+            inline size_t pop_bulk(OutputIterator out, size_t max) {
+                size_t popped = 0;
+                T var;
+                while (popped < max && dequeue(var)) {
+                    *out = std::move(var);
+                    ++out;
+                    ++popped;
+                }
+                if (popped > 0) notify(push_waiters_, not_full_, popped > 1);
+                return popped;
+            }
+
+            /**
+             * Queue state
+             */
+            inline bool is_finished() const {
+                return closed_;
+            }
+
+            /**
+             * Close queue and release all waiting threads. Items which are already in queue still can be popped
+             */
+            inline void kill() {
+                closed_ = true;
+                std::unique_lock<std::mutex> lock(park_);
+                not_empty_.notify_all();
+                not_full_.notify_all();
+            }
+
+            ~BoundedQueue() {
+                kill();
+            }
+
+        private:
+            struct Cell {
+                std::atomic<size_t> sequence;
+                T data;
+
+                Cell() : sequence(0) { }
+
+                Cell(Cell &&other) : sequence(other.sequence.load()), data(std::move(other.data)) { }
+
+                Cell &operator=(Cell &&other) {
+                    sequence.store(other.sequence.load());
+                    data = std::move(other.data);
+                    return *this;
+                }
+            };
+
+            // Padding protects positions of producers and consumers from false sharing. Padding is used instead
+            // of alignas, because C++11 `new` does not support over-aligned types
+            static const size_t cache_line = 64;
+
+            std::vector<Cell> cells_;
+            size_t mask_;
+            size_t spin_;
+            char pad0_[cache_line];
+            std::atomic<size_t> enqueue_pos_{0};
+            char pad1_[cache_line - sizeof(std::atomic<size_t>)];
+            std::atomic<size_t> dequeue_pos_{0};
+            char pad2_[cache_line - sizeof(std::atomic<size_t>)];
+            std::atomic<bool> closed_{false};
+            std::atomic<size_t> push_waiters_{0}, pop_waiters_{0};
+            std::mutex park_;
+            std::condition_variable not_empty_, not_full_;
+
+            template<class V>
+            inline bool enqueue(V &&var) {
+                Cell *cell;
+                size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+                while (true) {
+                    cell = &cells_[pos & mask_];
+                    size_t seq = cell->sequence.load(std::memory_order_acquire);
+                    intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+                    if (diff == 0) {
+                        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                    } else if (diff < 0) {
+                        return false;
+                    } else {
+                        pos = enqueue_pos_.load(std::memory_order_relaxed);
+                    }
+                }
+                cell->data = std::forward<V>(var);
+                cell->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+            inline bool dequeue(T &var) {
+                Cell *cell;
+                size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+                while (true) {
+                    cell = &cells_[pos & mask_];
+                    size_t seq = cell->sequence.load(std::memory_order_acquire);
+                    intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+                    if (diff == 0) {
+                        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                    } else if (diff < 0) {
+                        return false;
+                    } else {
+                        pos = dequeue_pos_.load(std::memory_order_relaxed);
+                    }
+                }
+                var = std::move(cell->data);
+                // Release resources (ex: shared pointers) held by cell right now
+                cell->data = T();
+                cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+
+            /**
+             * Wake parked threads if any
+             */
+            inline void notify(std::atomic<size_t> &waiters, std::condition_variable &monitor, bool all) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (waiters.load(std::memory_order_relaxed) == 0) return;
+                std::unique_lock<std::mutex> lock(park_);
+                if (all) monitor.notify_all(); else monitor.notify_one();
+            }
+
+            inline bool pop_until(T &var, const std::chrono::steady_clock::time_point &deadline) {
+                if (!wait_for_cell([this, &var]() { return dequeue(var); }, pop_waiters_, not_empty_, deadline))
+                    return false;
+                notify(push_waiters_, not_full_, false);
+                return true;
+            }
+
+            /**
+             * Spin-then-park loop around lock-free operation. Operation is called under park lock only
+             * after spinning, so notifiers can not miss parked thread
+             */
+            template<class Operation>
+            inline bool wait_for_cell(const Operation &operation, std::atomic<size_t> &waiters,
+                                      std::condition_variable &monitor,
+                                      const std::chrono::steady_clock::time_point &deadline) {
+                for (size_t i = 0; i < spin_; ++i) {
+                    if (operation()) return true;
+                    if (closed_) return false;
+                    if (i < spin_ / 2) cpu_relax(); else std::this_thread::yield();
+                }
+                std::unique_lock<std::mutex> lock(park_);
+                ++waiters;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                bool done;
+                while (!(done = operation()) && !closed_) {
+                    if (deadline == std::chrono::steady_clock::time_point::max()) {
+                        monitor.wait(lock);
+                    } else if (monitor.wait_until(lock, deadline) == std::cv_status::timeout) {
+                        done = operation();
+                        break;
+                    }
+                }
+                --waiters;
+                return done;
+            }
+        };
     }
 }
 #endif //AUTH_PATTERNS_H
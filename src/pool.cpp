@@ -0,0 +1,125 @@
+#include "pool.h"
+#include <type_traits>
+
+namespace scgi {
+
+    struct RequestPool::Slot {
+        std::unique_ptr<Request> request;
+        // Storage of shared pointer control block
+        std::aligned_storage<128, alignof(std::max_align_t)>::type control;
+        // Keeps pool alive while slot is used
+        RequestPool::Ptr owner;
+    };
+
+    /**
+     * Places shared pointer control block into slot. Slot returns to pool when control block is released, so
+     * slot is never reused while weak pointers to request exist
+     */
+    template<class T>
+    struct RequestPool::SlotAllocator {
+        typedef T value_type;
+
+        Slot *slot;
+
+        explicit SlotAllocator(Slot *slot_) : slot(slot_) { }
+
+        template<class U>
+        SlotAllocator(const SlotAllocator<U> &other) : slot(other.slot) { }
+
+        T *allocate(size_t) {
+            static_assert(sizeof(T) <= sizeof(Slot::control), "Control block doesn't fit in pool slot");
+            return reinterpret_cast<T *>(&slot->control);
+        }
+
+        void deallocate(T *, size_t) {
+            RequestPool::Ptr owner = std::move(slot->owner);
+            owner->release(slot);
+        }
+
+        template<class U>
+        bool operator==(const SlotAllocator<U> &other) const {
+            return slot == other.slot;
+        }
+
+        template<class U>
+        bool operator!=(const SlotAllocator<U> &other) const {
+            return slot != other.slot;
+        }
+    };
+
+    void RequestPool::Recycler::operator()(Request *request) const {
+        RequestPool::recycle(request);
+    }
+
+    void RequestPool::recycle(Request *request) {
+        request->recycle();
+    }
+
+    RequestPool::Ptr RequestPool::create(size_t capacity) {
+        return Ptr(new RequestPool(capacity));
+    }
+
+    RequestPool::RequestPool(size_t capacity) : capacity_(capacity) {
+        idle_.reserve(capacity);
+    }
+
+    RequestPtr RequestPool::acquire(int fd, uint64_t id, RequestParser &parser) {
+        return acquire(fd, id, parser, ResponseSink());
+    }
+
+    RequestPtr RequestPool::acquire(uint64_t id, RequestParser &parser, const ResponseSink &sink) {
+        return acquire(-1, id, parser, sink);
+    }
+
+    RequestPtr RequestPool::acquire(int fd, uint64_t id, RequestParser &parser, const ResponseSink &sink) {
+        Slot *slot = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (!idle_.empty()) {
+                slot = idle_.back();
+                idle_.pop_back();
+            }
+        }
+        if (slot == nullptr) {
+            slot = new Slot();
+            slot->request.reset(new Request());
+        }
+        slot->owner = shared_from_this();
+        slot->request->assign(fd, id, parser, sink);
+        return RequestPtr(slot->request.get(), Recycler(), SlotAllocator<Request>(slot));
+    }
+
+    void RequestPool::release(Slot *slot) {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (idle_.size() < capacity_) {
+                idle_.push_back(slot);
+                return;
+            }
+        }
+        delete slot;
+    }
+
+    size_t RequestPool::idle() const {
+        std::lock_guard<std::mutex> lock(lock_);
+        return idle_.size();
+    }
+
+    RequestPool::~RequestPool() {
+        for (auto slot:idle_) delete slot;
+    }
+
+    std::unique_ptr<RequestParser> ParserCache::take(size_t body_limit) {
+        if (spare_.empty()) return std::unique_ptr<RequestParser>(new RequestParser(body_limit));
+        std::unique_ptr<RequestParser> parser = std::move(spare_.back());
+        spare_.pop_back();
+        parser->set_body_limit(body_limit);
+        return parser;
+    }
+
+    void ParserCache::give(std::unique_ptr<RequestParser> &&parser) {
+        if (!parser || spare_.size() >= capacity_) return;
+        parser->reset();
+        spare_.push_back(std::move(parser));
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef SCGI_POOL_H
+#define SCGI_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "scgi.h"
+
+namespace scgi {
+
+    /**
+     * Pool of reusable requests for completely received requests (see RequestParser). Finished request is reset
+     * and returned to pool with all its memory (header block, body, response buffer, arena), so serving loop
+     * doesn't allocate requests in steady state. Shared pointer control blocks are placed inside pool slots too.
+     * Requests may be released in any thread. Pool is alive while any of its requests is alive.
+     */
+    class RequestPool : public std::enable_shared_from_this<RequestPool> {
+    public:
+        typedef std::shared_ptr<RequestPool> Ptr;
+
+        /**
+         * Pool which keeps up to `capacity` idle requests
+         */
+        static Ptr create(size_t capacity = 1024);
+
+        /**
+         * Request which owns descriptor `fd`. Parser must be done with buffered body, its buffers are exchanged
+         * with buffers of pooled request
+         */
+        RequestPtr acquire(int fd, uint64_t id, RequestParser &parser);
+
+        /**
+         * Request without descriptor, response is passed to `sink` (see Request constructor with sink)
+         */
+        RequestPtr acquire(uint64_t id, RequestParser &parser, const ResponseSink &sink);
+
+        /**
+         * Count of idle requests
+         */
+        size_t idle() const;
+
+        ~RequestPool();
+
+    private:
+        struct Slot;
+
+        template<class T>
+        struct SlotAllocator;
+
+        struct Recycler {
+            void operator()(Request *request) const;
+        };
+
+        size_t capacity_;
+        mutable std::mutex lock_;
+        std::vector<Slot *> idle_;
+
+        explicit RequestPool(size_t capacity);
+
+        RequestPtr acquire(int fd, uint64_t id, RequestParser &parser, const ResponseSink &sink);
+
+        static void recycle(Request *request);
+
+        /**
+         * Return slot when its shared pointer control block is released
+         */
+        void release(Slot *slot);
+
+        RequestPool(const RequestPool &) = delete;
+
+        RequestPool &operator=(const RequestPool &) = delete;
+    };
+
+    /**
+     * Spare parsers of one event loop: parsers of finished connections are reset and reused with their buffers.
+     * Not thread-safe
+     */
+    class ParserCache {
+    public:
+        explicit ParserCache(size_t capacity = 256) : capacity_(capacity) { }
+
+        /**
+         * Spare or new parser with `body_limit`
+         */
+        std::unique_ptr<RequestParser> take(size_t body_limit);
+
+        /**
+         * Return parser of finished connection
+         */
+        void give(std::unique_ptr<RequestParser> &&parser);
+
+    private:
+        size_t capacity_;
+        std::vector<std::unique_ptr<RequestParser>> spare_;
+    };
+}
+#endif //SCGI_POOL_H
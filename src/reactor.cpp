@@ -0,0 +1,116 @@
+#include "reactor.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+
+namespace scgi {
+
+    // Maximum events processed by one epoll_wait call
+    static const int max_events = 256;
+
+    Reactor::Reactor() : stopped_(false) {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd_ >= 0 && wake_fd_ >= 0) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = wake_fd_;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+        }
+    }
+
+    bool Reactor::add(int fd, uint32_t events, const Callback &callback) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) return false;
+        callbacks_[fd] = callback;
+        return true;
+    }
+
+    bool Reactor::modify(int fd, uint32_t events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) == 0;
+    }
+
+    void Reactor::remove(int fd) {
+        if (callbacks_.erase(fd) > 0)
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    size_t Reactor::run_once(int timeout_ms) {
+        epoll_event events[max_events];
+        int count = epoll_wait(epoll_fd_, events, max_events, timeout_ms);
+        if (count <= 0) return 0;
+        size_t processed = 0;
+        bool woken = false;
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wake_fd_) {
+                uint64_t value;
+                while (read(wake_fd_, &value, sizeof(value)) > 0);
+                woken = true;
+                continue;
+            }
+            // Descriptor may be removed by previous callback
+            auto iter = callbacks_.find(fd);
+            if (iter == callbacks_.end()) continue;
+            // Callback may remove itself, so call a copy
+            Callback callback = (*iter).second;
+            callback(events[i].events);
+            ++processed;
+        }
+        if (woken) processed += run_posted();
+        return processed;
+    }
+
+    void Reactor::post(const std::function<void()> &task) {
+        {
+            std::lock_guard<std::mutex> lock(posted_lock_);
+            posted_.push_back(task);
+        }
+        wake();
+    }
+
+    size_t Reactor::run_posted() {
+        std::vector<std::function<void()>> tasks;
+        {
+            std::lock_guard<std::mutex> lock(posted_lock_);
+            tasks.swap(posted_);
+        }
+        for (auto &task:tasks) task();
+        return tasks.size();
+    }
+
+    void Reactor::run(int timeout_ms) {
+        while (!stopped_) {
+            if (run_once(timeout_ms) == 0 && on_idle_) on_idle_();
+        }
+    }
+
+    void Reactor::stop() {
+        stopped_ = true;
+        wake();
+    }
+
+    void Reactor::wake() {
+        uint64_t value = 1;
+        if (write(wake_fd_, &value, sizeof(value)) < 0 && errno != EAGAIN) return;
+    }
+
+    Reactor::~Reactor() {
+        if (wake_fd_ >= 0) close(wake_fd_);
+        if (epoll_fd_ >= 0) close(epoll_fd_);
+    }
+
+    bool set_non_blocking(int fd, bool enable) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0) return false;
+        flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+        return fcntl(fd, F_SETFL, flags) == 0;
+    }
+}
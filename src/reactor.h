@@ -0,0 +1,131 @@
+#ifndef SCGI_REACTOR_H
+#define SCGI_REACTOR_H
+
+#include <functional>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace scgi {
+
+    /**
+     * Minimal epoll based event loop. Each registered descriptor has own callback which receives epoll events.
+     * Loop itself is single threaded, but `stop`, `wake` and `post` may be called from any thread.
+     */
+    class Reactor {
+    public:
+        /**
+         * Callback of descriptor readiness. Argument is mask of EPOLL* events
+         */
+        typedef std::function<void(uint32_t)> Callback;
+
+        Reactor();
+
+        /**
+         * Register descriptor `fd` for `events` (EPOLLIN, EPOLLOUT, ...).
+         * Returns false on error
+         */
+        bool add(int fd, uint32_t events, const Callback &callback);
+
+        /**
+         * Change events mask of registered descriptor
+         */
+        bool modify(int fd, uint32_t events);
+
+        /**
+         * Unregister descriptor. Descriptor is not closed
+         */
+        void remove(int fd);
+
+        /**
+         * Wait for events at most `timeout_ms` (-1 - infinity) and process them.
+         * Returns number of processed events
+         */
+        size_t run_once(int timeout_ms = -1);
+
+        /**
+         * Process events till `stop`. Idle function is called on each timeout
+         */
+        void run(int timeout_ms = 1000);
+
+        /**
+         * Break `run` loop. Thread-safe. Stop is kept: `run` called after it returns at once (see `reset`)
+         */
+        void stop();
+
+        /**
+         * Allow `run` again after `stop`
+         */
+        inline void reset() {
+            stopped_ = false;
+        }
+
+        /**
+         * Interrupt waiting in `run_once`. Thread-safe
+         */
+        void wake();
+
+        /**
+         * Call `task` in loop thread after current events. Used to register descriptors or to resume work from
+         * other threads. Thread-safe
+         */
+        void post(const std::function<void()> &task);
+
+        /**
+         * Function which will be called when no events during timeout in `run`
+         */
+        inline void set_on_idle(const std::function<void()> &func) {
+            on_idle_ = func;
+        }
+
+        /**
+         * Epoll descriptor
+         */
+        inline int descriptor() const {
+            return epoll_fd_;
+        }
+
+        /**
+         * Count of registered descriptors
+         */
+        inline size_t size() const {
+            return callbacks_.size();
+        }
+
+        inline bool is_valid() const {
+            return epoll_fd_ >= 0 && wake_fd_ >= 0;
+        }
+
+        /**
+         * Close epoll descriptor. Registered descriptors are not closed
+         */
+        ~Reactor();
+
+    private:
+        int epoll_fd_ = -1, wake_fd_ = -1;
+        std::atomic<bool> stopped_;
+        std::unordered_map<int, Callback> callbacks_;
+        std::function<void()> on_idle_;
+        std::mutex posted_lock_;
+        std::vector<std::function<void()>> posted_;
+
+        /**
+         * Call posted tasks
+         */
+        size_t run_posted();
+
+        Reactor(const Reactor &) = delete;
+
+        Reactor &operator=(const Reactor &) = delete;
+    };
+
+    /**
+     * Switch descriptor to non-blocking (or back to blocking) mode.
+     * Returns false on error
+     */
+    bool set_non_blocking(int fd, bool enable = true);
+}
+#endif //SCGI_REACTOR_H
@@ -0,0 +1,219 @@
+#include "response.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace scgi {
+
+    ResponseWriter::ResponseWriter(int fd, size_t flush_threshold)
+            : fd_(fd), flush_threshold_(flush_threshold), default_flush_threshold_(flush_threshold) { }
+
+    ResponseWriter::ResponseWriter(const ResponseSink &sink)
+            : flush_threshold_(std::string::npos), sink_(sink) { }
+
+    void ResponseWriter::reset(int fd, const ResponseSink &sink) {
+        fd_ = fd;
+        sink_ = sink;
+        flush_threshold_ = sink_ ? std::string::npos : default_flush_threshold_;
+        head_size_ = 0;
+        head_heap_.clear();
+        sent_ = 0;
+        finished_ = false;
+        failed_ = false;
+        is_socket_ = true;
+        setp(pbase(), epptr());
+    }
+
+    void ResponseWriter::head(const char *data, size_t size) {
+        if (sent_ > 0 || body_size() > 0) {
+            xsputn(data, static_cast<std::streamsize>(size));
+            return;
+        }
+        if (head_heap_.empty() && head_size_ + size <= inline_head_size) {
+            std::memcpy(head_ + head_size_, data, size);
+            head_size_ += size;
+            return;
+        }
+        if (head_heap_.empty()) head_heap_.assign(head_, head_size_);
+        head_heap_.append(data, size);
+    }
+
+    bool ResponseWriter::flush(bool more) {
+        if (sink_ || finished_ || failed_) return !failed_;
+        return send(more, nullptr, 0);
+    }
+
+    bool ResponseWriter::send_file(int fd, off_t offset, size_t size) {
+        if (finished_ || failed_) return !failed_;
+        if (sink_) {
+            // Whole response is collected for sink anyway
+            while (size > 0) {
+                size_t part = std::min<size_t>(size, 1 << 30);
+                reserve(part);
+                ssize_t reads = pread(fd, pptr(), part, offset);
+                if (reads < 0 && errno == ESPIPE) reads = read(fd, pptr(), part);
+                if (reads < 0 && errno == EINTR) continue;
+                if (reads <= 0) return false;
+                pbump(static_cast<int>(reads));
+                offset += reads;
+                size -= static_cast<size_t>(reads);
+            }
+            return true;
+        }
+        // Headers and buffered body go first
+        if (!send(true, nullptr, 0)) return false;
+        bool copy = false;
+        while (size > 0 && !failed_) {
+            if (copy) {
+                char chunk[64 * 1024];
+                ssize_t reads = pread(fd, chunk, std::min(size, sizeof(chunk)), offset);
+                // Not seekable descriptor is read from current position
+                if (reads < 0 && errno == ESPIPE) reads = read(fd, chunk, std::min(size, sizeof(chunk)));
+                if (reads < 0 && errno == EINTR) continue;
+                if (reads <= 0) {
+                    failed_ = true;
+                    break;
+                }
+                offset += reads;
+                size -= static_cast<size_t>(reads);
+                send(size > 0, chunk, static_cast<size_t>(reads));
+                continue;
+            }
+            ssize_t written = sendfile(fd_, fd, &offset, size);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    pollfd wait = {fd_, POLLOUT, 0};
+                    if (poll(&wait, 1, -1) >= 0 || errno == EINTR) continue;
+                }
+                // Descriptor doesn't support sendfile (ex: pipe): copy by chunks
+                if (errno == EINVAL || errno == ENOSYS || errno == ESPIPE) {
+                    copy = true;
+                    continue;
+                }
+                failed_ = true;
+                break;
+            }
+            // File is shorter than declared size: response can't be completed
+            if (written == 0) {
+                failed_ = true;
+                break;
+            }
+            sent_ += static_cast<size_t>(written);
+            size -= static_cast<size_t>(written);
+        }
+        return !failed_;
+    }
+
+    bool ResponseWriter::finish() {
+        if (finished_) return !failed_;
+        finished_ = true;
+        if (sink_) {
+            std::string response;
+            response.reserve(head_heap_.size() + head_size_ + body_size());
+            if (head_heap_.empty()) response.append(head_, head_size_); else response.append(head_heap_);
+            if (body_size() > 0) response.append(pbase(), body_size());
+            sent_ = response.size();
+            sink_(std::move(response));
+            return true;
+        }
+        return failed_ ? false : send(false, nullptr, 0);
+    }
+
+    ResponseWriter::~ResponseWriter() {
+        finish();
+    }
+
+    void ResponseWriter::reserve(size_t extra) {
+        size_t used = body_size();
+        if (used + extra <= body_.size()) return;
+        body_.resize(std::max(used + extra, std::max<size_t>(256, body_.size() * 2)));
+        setp(&body_[0], &body_[0] + body_.size());
+        pbump(static_cast<int>(used));
+    }
+
+    ResponseWriter::int_type ResponseWriter::overflow(int_type c) {
+        if (body_size() >= flush_threshold_) flush(true);
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            reserve(1);
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize ResponseWriter::xsputn(const char *s, std::streamsize count) {
+        size_t size = static_cast<size_t>(count);
+        if (!sink_ && body_size() + size > flush_threshold_) {
+            // Large chunk is sent directly after buffered data without copying
+            if (size >= flush_threshold_) {
+                if (!finished_ && !failed_) send(true, s, size);
+                return count;
+            }
+            flush(true);
+        }
+        reserve(size);
+        std::memcpy(pptr(), s, size);
+        pbump(static_cast<int>(size));
+        return count;
+    }
+
+    int ResponseWriter::sync() {
+        return 0;
+    }
+
+    bool ResponseWriter::send(bool more, const char *extra, size_t extra_size) {
+        iovec parts[3];
+        int count = 0;
+        if (!head_heap_.empty()) parts[count++] = {&head_heap_[0], head_heap_.size()};
+        else if (head_size_ > 0) parts[count++] = {head_, head_size_};
+        if (body_size() > 0) parts[count++] = {pbase(), body_size()};
+        if (extra_size > 0) parts[count++] = {const_cast<char *>(extra), extra_size};
+        iovec *iov = parts;
+        int flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+        while (count > 0 && !failed_) {
+            ssize_t written;
+            if (is_socket_) {
+                msghdr message = {};
+                message.msg_iov = iov;
+                message.msg_iovlen = static_cast<size_t>(count);
+                written = sendmsg(fd_, &message, flags);
+                if (written < 0 && errno == ENOTSOCK) {
+                    is_socket_ = false;
+                    continue;
+                }
+            } else {
+                written = writev(fd_, iov, count);
+            }
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    pollfd wait = {fd_, POLLOUT, 0};
+                    if (poll(&wait, 1, -1) >= 0 || errno == EINTR) continue;
+                }
+                failed_ = true;
+                break;
+            }
+            sent_ += static_cast<size_t>(written);
+            size_t done = static_cast<size_t>(written);
+            while (count > 0 && done >= iov->iov_len) {
+                done -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+            if (count > 0) {
+                iov->iov_base = static_cast<char *>(iov->iov_base) + done;
+                iov->iov_len -= done;
+            }
+        }
+        head_size_ = 0;
+        head_heap_.clear();
+        setp(pbase(), epptr());
+        return !failed_;
+    }
+}
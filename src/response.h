@@ -0,0 +1,139 @@
+#ifndef SCGI_RESPONSE_H
+#define SCGI_RESPONSE_H
+
+#include <streambuf>
+#include <string>
+#include <functional>
+#include <sys/types.h>
+
+namespace scgi {
+
+    /**
+     * Receiver of complete serialized response of request without own descriptor (ex: io_uring backend)
+     */
+    typedef std::function<void(std::string &&)> ResponseSink;
+
+    /**
+     * Output buffer of response. Status line and headers are kept in small inline buffer, body is collected
+     * in growing buffer. Stream flushes (ex: std::endl) are ignored: everything is sent by one scatter-gather
+     * call on `finish`, or earlier by parts with MSG_MORE when body exceeds flush threshold, so small
+     * responses leave in one packet.
+     */
+    class ResponseWriter : public std::streambuf {
+    public:
+        /**
+         * Size of inline headers buffer. Bigger headers are moved to heap
+         */
+        static const size_t inline_head_size = 512;
+
+        /**
+         * Writer to socket (or any descriptor) `fd`. Descriptor is not owned. Body is sent by parts when it
+         * exceeds `flush_threshold`
+         */
+        explicit ResponseWriter(int fd, size_t flush_threshold = 64 * 1024);
+
+        /**
+         * Writer which collects whole response and passes it to `sink` on `finish`
+         */
+        explicit ResponseWriter(const ResponseSink &sink);
+
+        /**
+         * Drop state and buffered data (memory is kept) and write to `fd` (or to `sink` if it is set) from now
+         */
+        void reset(int fd, const ResponseSink &sink = ResponseSink());
+
+        /**
+         * Append status line or headers. Data is placed before body if nothing is sent or written to body
+         * yet, otherwise it is written to body as is
+         */
+        void head(const char *data, size_t size);
+
+        inline void head(const std::string &data) {
+            head(data.data(), data.size());
+        }
+
+        /**
+         * Send buffered data now. If `more` is set, kernel is hinted that more data follows (MSG_MORE)
+         */
+        bool flush(bool more = true);
+
+        /**
+         * Send `size` bytes of file `fd` from `offset` after buffered data. Descriptor is copied to socket by
+         * kernel (sendfile) without passing through user space; sink mode reads file into response buffer.
+         * Returns false if file is shorter than `size` or writing failed. File descriptor is not owned
+         */
+        bool send_file(int fd, off_t offset, size_t size);
+
+        /**
+         * Send rest of response (or pass it to sink). Only first call has effect
+         */
+        bool finish();
+
+        /**
+         * Response is collected for sink instead of descriptor
+         */
+        inline bool has_sink() const {
+            return static_cast<bool>(sink_);
+        }
+
+        /**
+         * Bytes sent to descriptor (or passed to sink)
+         */
+        inline size_t sent() const {
+            return sent_;
+        }
+
+        /**
+         * Write to descriptor failed. Further data is dropped
+         */
+        inline bool is_failed() const {
+            return failed_;
+        }
+
+        ~ResponseWriter();
+
+    protected:
+        virtual int_type overflow(int_type c) override;
+
+        virtual std::streamsize xsputn(const char *s, std::streamsize count) override;
+
+        /**
+         * Explicit stream flushes do nothing: response is sent once
+         */
+        virtual int sync() override;
+
+    private:
+        int fd_ = -1;
+        size_t flush_threshold_;
+        // Threshold of descriptor mode
+        size_t default_flush_threshold_ = 64 * 1024;
+        ResponseSink sink_;
+        char head_[inline_head_size];
+        size_t head_size_ = 0;
+        std::string head_heap_;
+        std::string body_;
+        size_t sent_ = 0;
+        bool finished_ = false;
+        bool failed_ = false;
+        bool is_socket_ = true;
+
+        inline size_t body_size() const {
+            return static_cast<size_t>(pptr() - pbase());
+        }
+
+        /**
+         * Grow body buffer to fit at least `extra` more bytes
+         */
+        void reserve(size_t extra);
+
+        /**
+         * Write headers, body and `extra` data to descriptor by one gathering call (repeated on partial write)
+         */
+        bool send(bool more, const char *extra, size_t extra_size);
+
+        ResponseWriter(const ResponseWriter &) = delete;
+
+        ResponseWriter &operator=(const ResponseWriter &) = delete;
+    };
+}
+#endif //SCGI_RESPONSE_H
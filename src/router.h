@@ -0,0 +1,248 @@
+#ifndef SCGI_ROUTER_H
+#define SCGI_ROUTER_H
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "headers.h"
+
+namespace scgi {
+
+    /**
+     * Segments captured by router. References point to matched path and to router
+     */
+    struct RouteParams {
+        /**
+         * Maximum count of captured segments in one route
+         */
+        static const size_t capacity = 8;
+
+        typedef std::pair<StringRef, StringRef> Item;
+
+        Item items[capacity];
+        size_t size = 0;
+        // Part of path after matched prefix of mount or wildcard tail
+        StringRef tail;
+
+        /**
+         * Value of captured segment `name` or empty reference
+         */
+        inline StringRef get(const char *name, size_t name_size) const {
+            for (size_t i = 0; i < size; ++i) {
+                if (items[i].first.equals(name, name_size)) return items[i].second;
+            }
+            return StringRef();
+        }
+
+        inline StringRef get(const std::string &name) const {
+            return get(name.data(), name.size());
+        }
+
+        inline void clear() {
+            size = 0;
+            tail = StringRef();
+        }
+    };
+
+    /**
+     * Compressed radix tree of paths. Route patterns consist of:
+     * - static parts: `/users/list`;
+     * - `:name` segments which match one path segment: `/users/:id/posts`;
+     * - `*name` tail which matches rest of path (only at the end, ex: `*path` after `/files/`).
+     * Static parts have priority over segments and segments over tails. Mounted prefixes match path itself and
+     * everything below it, longest mount wins if no route matches whole path. Lookup doesn't allocate and
+     * takes O(path length) for static routes.
+     * Routes are added before lookups: modifications are not synchronized.
+     */
+    template<class T>
+    class Router {
+    public:
+        Router() : root_(new Node()) { }
+
+        /**
+         * Add route for whole path (replaces value of same route). Returns false if pattern is malformed or
+         * conflicts with names of segments of other routes
+         */
+        inline bool add(const std::string &pattern, const T &value) {
+            return insert(pattern, value, false);
+        }
+
+        /**
+         * Add route for path and all paths below it
+         */
+        inline bool mount(const std::string &pattern, const T &value) {
+            return insert(pattern, value, true);
+        }
+
+        /**
+         * Find value for `path` and fill captured `params`. Returns nullptr if nothing matches
+         */
+        const T *match(const char *path, size_t size, RouteParams &params) const {
+            Candidate best;
+            params.clear();
+            const Node *found = match(root_.get(), StringRef(path, size), 0, params, best);
+            if (found != nullptr) return found->value.get();
+            if (best.node == nullptr) return nullptr;
+            params = best.params;
+            params.tail = StringRef(path + best.position, size - best.position);
+            return best.node->value.get();
+        }
+
+        inline const T *match(const StringRef &path, RouteParams &params) const {
+            return match(path.data, path.size, params);
+        }
+
+        inline bool empty() const {
+            return root_->children.empty() && !root_->param && !root_->wildcard && !root_->value;
+        }
+
+    private:
+        struct Node {
+            std::string label;
+            // Name of segment for `:name` and `*name` nodes
+            std::string name;
+            std::vector<std::unique_ptr<Node>> children;
+            std::unique_ptr<Node> param;
+            std::unique_ptr<Node> wildcard;
+            std::unique_ptr<T> value;
+            bool is_mount = false;
+        };
+
+        struct Candidate {
+            const Node *node = nullptr;
+            size_t position = 0;
+            RouteParams params;
+        };
+
+        std::unique_ptr<Node> root_;
+
+        static inline bool is_segment_start(const std::string &pattern, size_t index) {
+            return index == 0 || pattern[index - 1] == '/';
+        }
+
+        /**
+         * Add static `part` below `node`, splitting edges when required. Returns node of part end
+         */
+        static Node *insert_static(Node *node, const char *part, size_t size) {
+            while (size > 0) {
+                Node *child = nullptr;
+                for (auto &candidate:node->children) {
+                    if (candidate->label[0] == part[0]) {
+                        child = candidate.get();
+                        break;
+                    }
+                }
+                if (child == nullptr) {
+                    node->children.emplace_back(new Node());
+                    node->children.back()->label.assign(part, size);
+                    return node->children.back().get();
+                }
+                size_t common = 0;
+                while (common < size && common < child->label.size() && child->label[common] == part[common])
+                    ++common;
+                if (common < child->label.size()) {
+                    // Split edge: child keeps common part, its content moves to new node
+                    std::unique_ptr<Node> rest(new Node());
+                    rest->label = child->label.substr(common);
+                    rest->children.swap(child->children);
+                    rest->param.swap(child->param);
+                    rest->wildcard.swap(child->wildcard);
+                    rest->value.swap(child->value);
+                    rest->is_mount = child->is_mount;
+                    child->is_mount = false;
+                    child->label.resize(common);
+                    child->children.push_back(std::move(rest));
+                }
+                node = child;
+                part += common;
+                size -= common;
+            }
+            return node;
+        }
+
+        bool insert(const std::string &pattern, const T &value, bool is_mount) {
+            Node *node = root_.get();
+            size_t index = 0, captures = 0;
+            while (index < pattern.size()) {
+                char c = pattern[index];
+                if ((c == ':' || c == '*') && is_segment_start(pattern, index)) {
+                    size_t end = c == '*' ? pattern.size() : pattern.find('/', index);
+                    if (end == std::string::npos) end = pattern.size();
+                    std::string name = pattern.substr(index + 1, end - index - 1);
+                    if (name.empty() || ++captures > RouteParams::capacity) return false;
+                    std::unique_ptr<Node> &child = c == ':' ? node->param : node->wildcard;
+                    if (!child) {
+                        child.reset(new Node());
+                        child->name = name;
+                    } else if (child->name != name) {
+                        return false;
+                    }
+                    node = child.get();
+                    index = end;
+                    continue;
+                }
+                size_t end = index;
+                while (end < pattern.size() &&
+                       !((pattern[end] == ':' || pattern[end] == '*') && is_segment_start(pattern, end)))
+                    ++end;
+                node = insert_static(node, pattern.data() + index, end - index);
+                index = end;
+            }
+            // Same route replaces previous value
+            node->value.reset(new T(value));
+            node->is_mount = is_mount;
+            return true;
+        }
+
+        /**
+         * Match rest of `path` from `position` below `node`. Deepest mount passed on the way is kept in `best`
+         */
+        static const Node *match(const Node *node, const StringRef &path, size_t position, RouteParams &params,
+                                 Candidate &best) {
+            if (node->value && node->is_mount && position >= best.position &&
+                (position == path.size || path[position] == '/' || (position > 0 && path[position - 1] == '/'))) {
+                best.node = node;
+                best.position = position;
+                best.params = params;
+            }
+            if (position == path.size && node->value) return node;
+            if (position < path.size) {
+                for (auto &child:node->children) {
+                    const std::string &label = child->label;
+                    if (label[0] != path[position]) continue;
+                    if (label.size() <= path.size - position &&
+                        std::memcmp(label.data(), path.data + position, label.size()) == 0) {
+                        const Node *found = match(child.get(), path, position + label.size(), params, best);
+                        if (found != nullptr) return found;
+                    }
+                    break;
+                }
+                if (node->param && params.size < RouteParams::capacity) {
+                    const char *slash = static_cast<const char *>(
+                            std::memchr(path.data + position, '/', path.size - position));
+                    size_t end = slash == nullptr ? path.size : static_cast<size_t>(slash - path.data);
+                    if (end > position) {
+                        params.items[params.size++] = RouteParams::Item(
+                                StringRef(node->param->name), StringRef(path.data + position, end - position));
+                        const Node *found = match(node->param.get(), path, end, params, best);
+                        if (found != nullptr) return found;
+                        --params.size;
+                    }
+                }
+            }
+            if (node->wildcard && node->wildcard->value && params.size < RouteParams::capacity) {
+                StringRef rest(path.data + position, path.size - position);
+                params.items[params.size++] = RouteParams::Item(StringRef(node->wildcard->name), rest);
+                params.tail = rest;
+                return node->wildcard.get();
+            }
+            return nullptr;
+        }
+
+        Router(const Router &) = delete;
+
+        Router &operator=(const Router &) = delete;
+    };
+}
+#endif //SCGI_ROUTER_H
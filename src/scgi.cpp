@@ -3,6 +3,8 @@
 #include <unistd.h>
 #include <sstream>
 #include <netdb.h>
+#include <cstring>
+#include <algorithm>
 
 #ifndef  BUILD_VERSION
 #define BUILD_VERSION "0.0.0"
@@ -12,43 +14,256 @@ namespace scgi {
 
     Request::Request(int fd, uint64_t id)
             : FileStream(fd),
-              id_(id) {
-        size_t header_length, total = 0;
-        std::string key, value;
-        // Parse SCGI header size
-        input() >> header_length;
-        // Skip delimiter
-        input().ignore();
-        // Read SCGI key-values
-        while (total < header_length && !input().eof()) {
-            std::getline(input(), key, '\0');
-            std::getline(input(), value, '\0');
-            headers[key] = value;
-            total += 2 + key.size() + value.size();
+              headers([this](Headers &map) {
+                  for (auto &item:header_block_.items())
+                      map[item.first.str()] = item.second.str();
+              }),
+              query([this](std::unordered_map<std::string, std::string> &map) { parse_query(map); }),
+              id_(id),
+              writer_(fd),
+              output_(&writer_) {
+        tracing_ = trace::enabled();
+        trace_begin(trace::Phase::ReadHeaders);
+        if (!read_header_block()) return;
+        trace_end(trace::Phase::ReadHeaders);
+        init();
+    }
+
+    Request::Request(int fd, uint64_t id, RequestParser &parser)
+            : FileStream(fd),
+              headers([this](Headers &map) {
+                  for (auto &item:header_block_.items())
+                      map[item.first.str()] = item.second.str();
+              }),
+              query([this](std::unordered_map<std::string, std::string> &map) { parse_query(map); }),
+              id_(id),
+              writer_(fd),
+              output_(&writer_) {
+        tracing_ = trace::enabled();
+        if (tracing_) parser.fill_trace(trace_);
+        if (!parser.is_done()) return;
+        header_block_ = std::move(parser.header_block());
+        if (parser.is_body_buffered()) {
+            body_.swap(parser.body());
+            body_buffered_ = true;
         }
-        input().ignore();//comma
-        // Parse URL query
-        std::string query_str = headers[header::query];
-        std::string::size_type li, pi = 0, sep;
-        do {
-            li = query_str.find('&', pi);
-            sep = query_str.find('=', pi);
-            key = query_str.substr(pi, sep - pi);
-            value = query_str.substr(sep + 1, li - sep - 1);
-            query[http::url_decode(key)] = http::url_decode(value);
-            pi = li + 1;
-        } while (li != std::string::npos);
+        init();
+    }
+
+    Request::Request(uint64_t id, RequestParser &parser, const ResponseSink &sink)
+            : FileStream(-1),
+              headers([this](Headers &map) {
+                  for (auto &item:header_block_.items())
+                      map[item.first.str()] = item.second.str();
+              }),
+              query([this](std::unordered_map<std::string, std::string> &map) { parse_query(map); }),
+              id_(id),
+              writer_(sink),
+              output_(&writer_) {
+        tracing_ = trace::enabled();
+        if (tracing_) parser.fill_trace(trace_);
+        if (!parser.is_done() || !parser.is_body_buffered()) return;
+        header_block_ = std::move(parser.header_block());
+        body_.swap(parser.body());
+        body_buffered_ = true;
+        init();
+    }
+
+    Request::Request(const Request &parent, uint64_t id, const ResponseSink &sink)
+            : FileStream(-1),
+              headers([this](Headers &map) {
+                  for (auto &item:header_block_.items())
+                      map[item.first.str()] = item.second.str();
+              }),
+              query([this](std::unordered_map<std::string, std::string> &map) { parse_query(map); }),
+              id_(id),
+              writer_(sink),
+              output_(&writer_) {
+        if (!parent.valid) return;
+        header_block_.buffer() = parent.header_block_.buffer();
+        if (!header_block_.index()) return;
+        // Captured segments point into path header of parent
+        uintptr_t from = reinterpret_cast<uintptr_t>(parent.header_block_.buffer().data());
+        uintptr_t size = parent.header_block_.buffer().size();
+        const char *to = header_block_.buffer().data();
+        auto rebase = [from, size, to](StringRef &ref) {
+            uintptr_t address = reinterpret_cast<uintptr_t>(ref.data);
+            if (address >= from && address < from + size) ref.data = to + (address - from);
+        };
+        route_ = parent.route_;
+        for (size_t i = 0; i < route_.size; ++i) rebase(route_.items[i].second);
+        rebase(route_.tail);
+        init();
+        content_size_ = 0;
+        body_buffered_ = true;
+    }
+
+    Request::Request()
+            : FileStream(-1),
+              headers([this](Headers &map) {
+                  for (auto &item:header_block_.items())
+                      map[item.first.str()] = item.second.str();
+              }),
+              query([this](std::unordered_map<std::string, std::string> &map) { parse_query(map); }),
+              id_(0),
+              writer_(-1),
+              output_(&writer_) {
+    }
+
+    void Request::assign(int fd, uint64_t id, RequestParser &parser, const ResponseSink &sink) {
+        id_ = id;
+        writer_.reset(fd, sink);
+        if (!sink) own_fd_ = fd;
+        tracing_ = trace::enabled();
+        if (tracing_) {
+            trace_.clear();
+            parser.fill_trace(trace_);
+        }
+        if (!parser.is_done() || !parser.is_body_buffered()) return;
+        header_block_.swap(parser.header_block());
+        body_.swap(parser.body());
+        body_buffered_ = true;
+        init();
+    }
+
+    void Request::recycle() {
+        trace_begin(trace::Phase::Flush);
+        writer_.finish();
+        if (own_fd_ >= 0) ::close(own_fd_);
+        own_fd_ = -1;
+        trace_end(trace::Phase::Flush);
+        complete();
+        status_ = 0;
+        valid = false;
+        content_size_ = 0;
+        header_block_.clear();
+        body_.clear();
+        body_buffered_ = false;
+        route_.clear();
+        response_headers.clear();
+        headers.clear();
+        query.clear();
+        arena_.reset();
+        output_.clear();
+    }
+
+    void Request::init() {
         // Cache useful headers
-        content_size_ =
-                static_cast<size_t>(std::atol(headers[header::content_length].c_str()));
-        path_ = headers[header::path];
-        method_ = headers[header::method];
+        // Overflowed length is not trusted: request stays invalid
+        if (!parse_size(header(header::Slot::content_length), content_size_, max_content_length)) {
+            content_size_ = 0;
+            return;
+        }
+        received_ = std::chrono::steady_clock::now();
+        if (tracing_) {
+            StringRef path = header(header::Slot::path);
+            size_t size = std::min(path.size, trace::Record::path_size - 1);
+            std::memcpy(trace_.path, path.data, size);
+            trace_.path[size] = '\0';
+            trace_.id = id_;
+        }
         valid = true;
     }
 
+    void Request::complete() {
+        if (tracing_) trace::commit(trace_);
+        tracing_ = false;
+        for (auto &callback:completions_) callback(*this);
+        completions_.clear();
+    }
+
+    /**
+     * Call `func(key, key_size, value, value_size)` for each raw (not decoded) pair of query string
+     */
+    template<class Functor>
+    static inline void for_each_query_pair(const StringRef &query_str, const Functor &func) {
+        const char *ptr = query_str.begin(), *end = query_str.end();
+        while (ptr < end) {
+            auto li = static_cast<const char *>(std::memchr(ptr, '&', end - ptr));
+            if (li == nullptr) li = end;
+            auto sep = static_cast<const char *>(std::memchr(ptr, '=', li - ptr));
+            if (li > ptr) {
+                if (sep == nullptr) {
+                    if (!func(ptr, li - ptr, li, 0)) return;
+                } else if (!func(ptr, sep - ptr, sep + 1, li - sep - 1)) {
+                    return;
+                }
+            }
+            ptr = li + 1;
+        }
+    }
+
+    void Request::parse_query(std::unordered_map<std::string, std::string> &map) const {
+        for_each_query_pair(header(header::Slot::query),
+                            [&map](const char *key, size_t key_size, const char *value, size_t value_size) {
+                                map[http::url_decode(key, key_size)] = http::url_decode(value, value_size);
+                                return true;
+                            });
+    }
+
+    bool Request::find_query(const std::string &name, std::string &value) const {
+        if (query.is_built()) {
+            auto iter = query.find(name);
+            if (iter == query.end()) return false;
+            value = (*iter).second;
+            return true;
+        }
+        bool found = false;
+        std::string decoded;
+        for_each_query_pair(header(header::Slot::query),
+                            [&](const char *key, size_t key_size, const char *val, size_t value_size) {
+                                StringRef raw(key, key_size);
+                                if (http::url_plain_prefix(key, key_size) != key_size) {
+                                    decoded = http::url_decode(key, key_size);
+                                    raw = StringRef(decoded);
+                                }
+                                if (raw != name) return true;
+                                value = http::url_decode(val, value_size);
+                                found = true;
+                                return false;
+                            });
+        return found;
+    }
+
+    StringRef Request::body() {
+        if (!body_buffered_) {
+            body_buffered_ = true;
+            body_.resize(content_size());
+            if (!body_.empty()) {
+                trace_begin(trace::Phase::ReadBody);
+                input().read(body_.data(), body_.size());
+                body_.resize(static_cast<size_t>(input().gcount()));
+                trace_end(trace::Phase::ReadBody);
+            }
+        }
+        return StringRef(body_.data(), body_.size());
+    }
+
+    bool Request::read_header_block() {
+        size_t header_length = 0, digits = 0;
+        char c = 0;
+        // Parse SCGI header size till delimiter
+        while (input().get(c) && c >= '0' && c <= '9' && digits < 10) {
+            header_length = header_length * 10 + (c - '0');
+            ++digits;
+        }
+        if (!input() || c != ':' || digits == 0 || header_length > header::max_length) return false;
+        // Read SCGI key-values by one call into one buffer
+        auto &buffer = header_block_.buffer();
+        buffer.resize(header_length);
+        if (header_length > 0 && !input().read(buffer.data(), header_length)) return false;
+        // Comma
+        if (!input().get(c) || c != ',') return false;
+        return header_block_.index();
+    }
+
     Request::~Request() {
-        output().flush();
-        close();
+        trace_begin(trace::Phase::Flush);
+        writer_.finish();
+        if (own_fd_ >= 0) ::close(own_fd_);
+        if (!writer_.has_sink()) close();
+        trace_end(trace::Phase::Flush);
+        complete();
     }
 
     SimpleAcceptor::SimpleAcceptor(std::shared_ptr<io::ConnectionManager> connection_manager) :
@@ -64,40 +279,125 @@ namespace scgi {
 
 
     void Request::begin_response(int code, std::string const &message) {
-        output() << "Status: " << code << " " << message << "\r\n";
+        status_ = code;
+        const char *reason = http::reason_phrase(code);
+        StringRef line = http::status_line(code);
+        if (!line.empty() && (message.empty() || message == reason)) {
+            writer_.head(line.data, line.size);
+        } else {
+            std::string custom = "Status: " + std::to_string(code) + " ";
+            custom += message.empty() && reason != nullptr ? reason : message;
+            custom += "\r\n";
+            writer_.head(custom);
+        }
         for (auto &kv:response_headers) {
-            output() << kv.first << ": " << kv.second << "\r\n";
+            writer_.head(kv.first);
+            writer_.head(": ", 2);
+            writer_.head(kv.second);
+            writer_.head("\r\n", 2);
         }
-        output() << "\r\n";
+        writer_.head("\r\n", 2);
     }
 
     void Request::begin_response(http::Status status, std::string const &message) {
         begin_response((int) status, message);
     }
 
+    bool Request::send_file(int fd, off_t offset, size_t size, int code) {
+        if (status_ == 0) {
+            response_headers[http::header::content_length] = std::to_string(size);
+            begin_response(code);
+        }
+        return writer_.send_file(fd, offset, size);
+    }
+
+    bool Request::send_file(const std::string &path, FileCache *cache, int code) {
+        OpenFile::Ptr file = cache != nullptr ? cache->open(path) : OpenFile::open(path);
+        if (!file) {
+            if (status_ == 0) begin_response(http::Status::NotFound);
+            return false;
+        }
+        return send_file(file->fd, 0, file->size(), code);
+    }
+
     void Request::set_response_type(std::string const &type) {
         response_headers[http::header::content_type] = type;
     }
 
-    bool Request::parse_data(std::unordered_map<std::string, std::string> &result, http::EncodingType encodingType) {
-        if (content_size() <= 0 || !is_valid() || input().eof()) return false;
-        //Test supported
-        if (encodingType != http::EncodingType::x_www_form_urlencoded) return false;
+    bool Request::parse_data(std::unordered_map<std::string, std::string> &result, http::EncodingType encodingType,
+                             size_t max_size) {
+        if (content_size() <= 0 || !is_valid() || (!body_buffered_ && input().eof())) return false;
         switch (encodingType) {
             case http::EncodingType::x_www_form_urlencoded: {
-                std::vector<char> buffer(content_size() + 1);
-                buffer.back() = '\0';
-                input().read(buffer.data(), buffer.size() - 1);
-                std::stringstream ss(buffer.data());
+                // Checked before body is read
+                if (static_cast<size_t>(content_size()) > max_size) return false;
+                StringRef content = body();
+                std::stringstream ss(content.str());
                 http::parse_http_urlencoded_form(ss, result);
                 break;
             };
+            case http::EncodingType::multipart_form_data: {
+                std::string value;
+                size_t total = 0;
+                http::MultipartParser::Handler handler;
+                handler.on_part_begin = [&value](const http::MultipartParser::Part &) {
+                    value.clear();
+                    return true;
+                };
+                handler.on_data = [&value, &total, max_size](const http::MultipartParser::Part &, const char *data,
+                                                             size_t size) {
+                    total += size;
+                    if (total > max_size) return false;
+                    value.append(data, size);
+                    return true;
+                };
+                handler.on_part_end = [&](const http::MultipartParser::Part &part) {
+                    if (!part.name.empty()) result[part.name] = value;
+                    return true;
+                };
+                return parse_multipart(handler);
+            };
             default:
                 return false;
         }
         return true;
     }
 
+    bool Request::parse_data(std::vector<http::FormField> &fields, size_t spill_threshold, size_t max_size,
+                             const std::string &temp_dir) {
+        http::FormCollector collector(fields, spill_threshold, max_size, temp_dir);
+        return parse_multipart(collector.handler());
+    }
+
+    bool Request::parse_multipart(const http::MultipartParser::Handler &handler) {
+        if (content_size() <= 0 || !is_valid()) return false;
+        std::string boundary = http::multipart_boundary(header(header::Slot::content_type).str());
+        if (boundary.empty()) return false;
+        http::MultipartParser parser(boundary, handler);
+        read_body([&parser](const char *data, size_t size) {
+            return parser.feed(data, size) && !parser.is_done();
+        });
+        return parser.is_done();
+    }
+
+    bool Request::read_body(const std::function<bool(const char *, size_t)> &consumer, size_t chunk_size) {
+        if (body_buffered_) return body_.empty() || consumer(body_.data(), body_.size());
+        // Stream body without buffering
+        body_buffered_ = true;
+        size_t left = content_size();
+        if (left == 0) return true;
+        std::vector<char> chunk(std::min(left, chunk_size));
+        trace_begin(trace::Phase::ReadBody);
+        while (left > 0) {
+            input().read(chunk.data(), std::min(left, chunk.size()));
+            size_t reads = static_cast<size_t>(input().gcount());
+            if (reads == 0 || !consumer(chunk.data(), reads)) break;
+            left -= reads;
+        }
+        trace_end(trace::Phase::ReadBody);
+        return left == 0;
+    }
+
 
     const std::string &version() {
         static std::string version(BUILD_VERSION);
@@ -9,8 +9,17 @@
 #include <string>
 #include <functional>
 #include <set>
+#include <chrono>
+#include <vector>
 #include "io/io.h"
 #include "http.h"
+#include "headers.h"
+#include "parser.h"
+#include "response.h"
+#include "file_cache.h"
+#include "router.h"
+#include "arena.h"
+#include "trace.h"
 
 namespace scgi {
 
@@ -83,10 +92,10 @@ namespace scgi {
 
         //Response headers which will be sent on `begin_response` function
         std::unordered_map<std::string, std::string> response_headers;
-        //Incoming request headers
-        std::unordered_map<std::string, std::string> headers;
-        //Parsed request query options from URI
-        std::unordered_map<std::string, std::string> query;
+        //Incoming request headers. Compatibility view: built from header block on first access
+        LazyMap<Headers> headers;
+        //Parsed request query options from URI. Parsed from QUERY_STRING on first access
+        LazyMap<std::unordered_map<std::string, std::string>> query;
 
         /**
          * Allocates I/O streams for `fd` descriptor. Automatically closes descriptor in destructor.
@@ -94,6 +103,79 @@ namespace scgi {
          */
         Request(int fd, uint64_t id = 0);
 
+        /**
+         * Wraps `fd` with headers (and body if buffered) already received by `parser`. Parser buffers are moved
+         * into request.
+         */
+        Request(int fd, uint64_t id, RequestParser &parser);
+
+        /**
+         * Request without own descriptor: headers and body are completely received by `parser`, whole response
+         * is collected in memory and passed to `sink` when request is destroyed
+         */
+        Request(uint64_t id, RequestParser &parser, const ResponseSink &sink);
+
+        /**
+         * Request without own descriptor and body which shares headers and route of `parent` (ex: entry of
+         * batch). Whole response is passed to `sink` when request is destroyed
+         */
+        Request(const Request &parent, uint64_t id, const ResponseSink &sink);
+
+        /**
+         * Parsed SCGI headers. Keys and values point to one request buffer
+         */
+        inline const HeaderBlock &header_block() const {
+            return header_block_;
+        }
+
+        /**
+         * Value of well-known header without copying. Empty if header not exists
+         */
+        inline StringRef header(header::Slot slot) const {
+            return header_block_.get(slot);
+        }
+
+        /**
+         * Value of any header without copying. Empty if header not exists
+         */
+        inline StringRef header(const std::string &name) const {
+            StringRef value;
+            header_block_.find(name, value);
+            return value;
+        }
+
+        /**
+         * Per-request monotonic memory (ex: for temporary data of handlers). Released all at once when request
+         * is finished; pooled requests keep arena blocks for next requests
+         */
+        inline Arena &arena() {
+            return arena_;
+        }
+
+        /**
+         * Segments captured by router (`:name` and `*name` parts of route) and rest of path below mounted prefix
+         */
+        inline const RouteParams &route() const {
+            return route_;
+        }
+
+        inline RouteParams &route() {
+            return route_;
+        }
+
+        /**
+         * Captured route segment without copying. Empty if segment not exists
+         */
+        inline StringRef param(const std::string &name) const {
+            return route_.get(name);
+        }
+
+        /**
+         * Find one decoded query option by scanning QUERY_STRING without building `query` map.
+         * Returns false if option not exists
+         */
+        bool find_query(const std::string &name, std::string &value) const;
+
         /**
          * Content length from request headers. Cached value.
          */
@@ -105,7 +187,7 @@ namespace scgi {
          * Status of request. Invalid state may be caused by wrong parsing of bad descriptor
          */
         inline bool is_valid() const {
-            return valid && has_valid_descriptor();
+            return valid && (writer_.has_sink() || own_fd_ >= 0 || has_valid_descriptor());
         }
 
         /**
@@ -116,28 +198,99 @@ namespace scgi {
         }
 
         /**
-         * Request path relative to bound script. Cached value. Starts from /
+         * Request path relative to bound script. Starts from /. Copied on each call, see `path_ref`
          */
         inline std::string path() const {
-            return path_;
+            return header(header::Slot::path).str();
+        }
+
+        /**
+         * Request path without copying (valid while request is alive)
+         */
+        inline StringRef path_ref() const {
+            return header(header::Slot::path);
         }
 
         /**
-         * Request HTTP method. Cached value
+         * Request HTTP method. Copied on each call, see `method_ref`
          */
         inline std::string method() const {
-            return method_;
+            return header(header::Slot::method).str();
+        }
+
+        /**
+         * Request HTTP method without copying (valid while request is alive)
+         */
+        inline StringRef method_ref() const {
+            return header(header::Slot::method);
+        }
+
+        /**
+         * Time when request was completely received (headers and buffered body)
+         */
+        inline std::chrono::steady_clock::time_point received() const {
+            return received_;
+        }
+
+        /**
+         * Mark beginning of phase in trace of request (if tracing was enabled when request was received)
+         */
+        inline void trace_begin(trace::Phase phase) {
+            if (tracing_) trace_.mark_begin(phase);
+        }
+
+        inline void trace_end(trace::Phase phase) {
+            if (tracing_) trace_.mark_end(phase);
+        }
+
+        /**
+         * Status code of response (zero if response is not started)
+         */
+        inline int status() const {
+            return status_;
+        }
+
+        /**
+         * Size of SCGI headers and body
+         */
+        inline size_t bytes_received() const {
+            return header_block_.buffer().size() + content_size_;
         }
 
         /**
-         * Send HTTP headers and status. Use it before writing any data
+         * Size of sent response
          */
-        void begin_response(int code = (int) http::Status::OK, const std::string &message = http::status_message::ok);
+        inline size_t bytes_sent() const {
+            return writer_.sent();
+        }
+
+        /**
+         * Call `callback` when request is released and its response is finished (ex: to count in-flight
+         * requests). Callbacks are called in thread which releases request
+         */
+        inline void on_complete(const std::function<void(const Request &)> &callback) {
+            completions_.push_back(callback);
+        }
+
+        /**
+         * Send HTTP headers and status. Use it before writing any data. Empty `message` means standard reason
+         * phrase. Status line and headers are buffered and sent together with body
+         */
+        void begin_response(int code = (int) http::Status::OK, const std::string &message = std::string());
 
         /**
          * Send HTTP headers and status with predefined status code. Use it before writing any data
          */
-        void begin_response(http::Status status, const std::string &message = http::status_message::ok);
+        void begin_response(http::Status status, const std::string &message = std::string());
+
+        /**
+         * Send pre-built response (status, headers and body) instead of `begin_response`
+         */
+        inline void write_response(const StringRef &response) {
+            static const size_t prefix = sizeof("Status: ") - 1;
+            if (response.size > prefix + 3) status_ = static_cast<int>(parse_size(StringRef(response.data + prefix, 3)));
+            writer_.head(response.data, response.size);
+        }
 
         /**
          * Set Content-Type header in response.
@@ -146,10 +299,73 @@ namespace scgi {
 
 
         /**
-         * Parse content into result.
+         * Send `size` bytes of file `fd` from `offset` as response body by sendfile, without copying through output
+         * stream. If response is not started yet, starts it with `code` and Content-Length, otherwise file is
+         * appended to body. Descriptor is not owned. Returns false if file is shorter than `size` or sending failed
+         */
+        bool send_file(int fd, off_t offset, size_t size, int code = (int) http::Status::OK);
+
+        /**
+         * Send whole regular file `path` (see `send_file` above). Descriptor and stat are taken from `cache` if it is
+         * set. Not started response is answered with 404 if file can't be opened
+         */
+        bool send_file(const std::string &path, FileCache *cache = nullptr, int code = (int) http::Status::OK);
+
+        /**
+         * Request body. If body is not buffered yet, reads `content_size()` bytes from input on first call
+         */
+        StringRef body();
+
+        /**
+         * Pass body to `consumer` by chunks not bigger than `chunk_size` as it is read from input, without buffering
+         * whole body (buffered body is passed at once). Returns false if consumer stopped or input failed.
+         * Not buffered body is not available by `body()` after this call
+         */
+        bool read_body(const std::function<bool(const char *, size_t)> &consumer, size_t chunk_size = 64 * 1024);
+
+        /**
+         * Parse content into result. Boundary of multipart form is taken from Content-Type. Values are kept in
+         * memory, so parsing fails if urlencoded body or total size of multipart values exceeds `max_size`
          */
         bool parse_data(std::unordered_map<std::string, std::string> &result,
-                        http::EncodingType encodingType = http::EncodingType::x_www_form_urlencoded);
+                        http::EncodingType encodingType = http::EncodingType::x_www_form_urlencoded,
+                        size_t max_size = 8 * 1024 * 1024);
+
+        /**
+         * Parse multipart form into `fields`. Parts bigger then `spill_threshold` are kept in anonymous files,
+         * so uploads are not limited by memory. Parsing fails if total size of parts exceeds `max_size`
+         */
+        bool parse_data(std::vector<http::FormField> &fields, size_t spill_threshold = 1024 * 1024,
+                        size_t max_size = std::string::npos, const std::string &temp_dir = "");
+
+        /**
+         * Stream multipart form body to `handler`. Not buffered body is read from input by chunks and is not
+         * available by `body()` after this call
+         */
+        bool parse_multipart(const http::MultipartParser::Handler &handler);
+
+        /**
+         * Buffered output stream to remote side. Response is sent once when request is destroyed (or earlier by
+         * parts for big responses), so flushing of this stream has no effect
+         */
+        inline std::ostream &output() {
+            return output_;
+        }
+
+        /**
+         * Send buffered part of response now (ex: for long responses produced slowly)
+         */
+        inline bool flush() {
+            return writer_.flush();
+        }
+
+        /**
+         * Sending of response failed (ex: client closed connection), rest of response is dropped. Producers of
+         * long responses may stop early
+         */
+        inline bool is_output_failed() const {
+            return writer_.is_failed();
+        }
 
         /**
          * Write data to remote side. Returns buffered output stream
@@ -175,10 +391,61 @@ namespace scgi {
         ~Request();
 
     private:
+        friend class RequestPool;
+
         uint64_t id_;
-        std::string path_, method_;
         bool valid = false;
-        size_t content_size_;
+        size_t content_size_ = 0;
+        HeaderBlock header_block_;
+        std::vector<char> body_;
+        bool body_buffered_ = false;
+        RouteParams route_;
+        Arena arena_;
+        // Descriptor of pooled request (base stream is not bound to it)
+        int own_fd_ = -1;
+        std::chrono::steady_clock::time_point received_;
+        int status_ = 0;
+        bool tracing_ = false;
+        trace::Record trace_;
+        std::vector<std::function<void(const Request &)>> completions_;
+        ResponseWriter writer_;
+        std::ostream output_;
+
+        /**
+         * Empty request for pool
+         */
+        Request();
+
+        /**
+         * Take completely received request from `parser` (buffers are exchanged, so parser keeps memory of
+         * previous request). Response goes to `sink` if it is set, otherwise to `fd` which is owned
+         */
+        void assign(int fd, uint64_t id, RequestParser &parser, const ResponseSink &sink);
+
+        /**
+         * Finish response, close descriptor and drop state but keep allocated memory
+         */
+        void recycle();
+
+        /**
+         * Commit trace, call and drop completion callbacks
+         */
+        void complete();
+
+        /**
+         * Read SCGI netstring (length, headers, comma) into header block
+         */
+        bool read_header_block();
+
+        /**
+         * Cache useful headers from header block
+         */
+        void init();
+
+        /**
+         * Parse QUERY_STRING into `map`
+         */
+        void parse_query(std::unordered_map<std::string, std::string> &map) const;
 
     };
 
@@ -3,61 +3,111 @@
 //
 
 #include <chrono>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
 #include <io/async.h>
 #include "service.h"
 
 namespace scgi {
     namespace service {
+        // Layout of JSON responses of dispatcher which processes request in current thread
+        static thread_local JsonStyle current_style = JsonStyle::Compact;
+        // Are methods counted by dispatcher which processes request in current thread
+        static thread_local bool current_stats = true;
+
         ServiceManager::ServiceManager(io::Epoll &epoll, io::ConnectionManager::Ptr connection_manager)
                 : io::AsyncSocketServer(epoll, connection_manager) {
         }
 
-        void ServiceManager::find_handler(scgi::RequestPtr request) {
-            std::string path = request->path();
-            if (path.empty()) path = "/";
-            auto handlerIter = handlers.find(path);
-            if (handlerIter != handlers.end()) {
-                if (request->query.find("info") != request->query.end()) {
-                    (*handlerIter).second->send_service_description(request, path);
-                } else
-                    process_request((*handlerIter).second, request);
-            } else if (request->query.find("info") != request->query.end()) {
-                send_service_description(request, request->query["info"] == "full");
+        void ServiceDispatcher::find_handler(scgi::RequestPtr request) {
+            static const StringRef root("/", 1);
+            StringRef path = request->header(header::Slot::path);
+            if (path.empty()) path = root;
+            std::string info, stats;
+            bool has_info = request->find_query("info", info);
+            bool has_stats = request->find_query("stats", stats);
+            const Mount *mount = router_.match(path, request->route());
+            if (mount != nullptr) {
+                if (has_info) {
+                    mount->handler->send_service_description(request, path.str());
+                } else if (has_stats) {
+                    send_stats(request, std::vector<const Mount *>(1, mount), stats == "prometheus");
+                } else {
+                    if (stats_enabled_) mount->stats->track(request);
+                    if (admission_ && !admission_->admit(request))
+                        mount->handler->send_overloaded(request);
+                    else
+                        process_request(mount->handler, request);
+                }
+            } else if (has_info) {
+                send_service_description(request, info == "full");
+            } else if (has_stats) {
+                send_stats(request, stats == "prometheus");
+            } else if (request->find_query("trace", info)) {
+                send_trace(request);
             } else {
-                send_error(request, "Service on " + path + " notfound", scgi::http::Status::NotFound,
+                send_error(request, "Service on " + path.str() + " notfound", scgi::http::Status::NotFound,
                            scgi::http::status_message::not_found);
             }
         }
 
-        void ServiceManager::send_error(scgi::RequestPtr request, const std::string &message,
-                                        scgi::http::Status code,
-                                        const std::string &code_message) const {
+        void ServiceDispatcher::send_error(scgi::RequestPtr request, const std::string &message,
+                                           scgi::http::Status code,
+                                           const std::string &code_message) const {
             request->begin_response((int) code, code_message);
             if (debug_) {
-                request->output() << message << std::endl;
-                request->output() << "Path : " << request->path() << std::endl;
-                request->output() << "Method : " << request->method() << std::endl;
-                request->output() << "Content-Size : " << request->content_size() << std::endl;
-                request->output() << "*****************************************" << std::endl;
+                request->output() << message << "\n";
+                request->output() << "Path : " << request->path_ref() << "\n";
+                request->output() << "Method : " << request->method_ref() << "\n";
+                request->output() << "Content-Size : " << request->content_size() << "\n";
+                request->output() << "*****************************************\n";
                 for (auto &kv:request->headers)
-                    request->output() << kv.first << " : " << kv.second << std::endl;
+                    request->output() << kv.first << " : " << kv.second << "\n";
 
             }
         }
 
-        void ServiceManager::process_request(ServiceHandler::Ref handler, scgi::RequestPtr request) {
+        void ServiceDispatcher::process_request(ServiceHandler::Ref handler, scgi::RequestPtr request) {
             Json::Value data;
+            // Arguments of typed method are decoded from JSON while it is parsed
+            ServiceHandler::CallReader reader(*handler, data);
             if (request->content_size() > 0) {
-                std::vector<char> buffer(request->content_size() + 1);
-                request->input().read(buffer.data(), buffer.size() - 1);
-                if (!reader.parse(&buffer.front(), &buffer.back(), data)) {
+                // Reject by declared size before anything is allocated for body
+                if (static_cast<size_t>(request->content_size()) > handler->max_body_size()) {
+                    send_error(request, "Request body is too large", scgi::http::Status::PayloadTooLarge,
+                               scgi::http::reason_phrase((int) scgi::http::Status::PayloadTooLarge));
+                    return;
+                }
+                Codec codec = request_codec(request->header(header::Slot::content_type));
+                bool parsed;
+                request->trace_begin(trace::Phase::ParseJson);
+                if (codec == Codec::Json) {
+                    // Values are built while body is read from socket, raw body is not kept
+                    JsonParser parser(reader, handler->max_depth());
+                    parsed = request->read_body([&parser](const char *chunk, size_t size) {
+                        return parser.feed(chunk, size);
+                    }) && parser.finish();
+                } else {
+                    StringRef body = request->body();
+                    parsed = read_binary(codec, body.data, body.size, data, handler->max_depth());
+                }
+                request->trace_end(trace::Phase::ParseJson);
+                if (!parsed) {
                     send_error(request, "Failed to parse message");
                     return;
                 }
             } else {
                 auto dataIter = request->query.find("payload");
                 if (dataIter != request->query.end()) {
-                    if (!reader.parse((*dataIter).second, data)) {
+                    const std::string &payload = (*dataIter).second;
+                    request->trace_begin(trace::Phase::ParseJson);
+                    JsonParser parser(reader, handler->max_depth());
+                    bool parsed = parser.feed(payload.data(), payload.size()) && parser.finish();
+                    request->trace_end(trace::Phase::ParseJson);
+                    if (!parsed) {
                         send_error(request, "Failed to parse message");
                         return;
                     }
@@ -67,31 +117,230 @@ namespace scgi {
                         data[kv.first] = kv.second;
                 }
             }
+            request->trace_begin(trace::Phase::Handler);
+            // Response may be already started by failed handler
             try {
-                if (!handler->process_request(request, data)) send_error(request, "Internal service error");
+                if (data.isArray())
+                    process_batch(handler, request, data);
+                else if (!handler->process_request(request, data, reader) && request->status() == 0)
+                    send_error(request, "Internal service error");
             } catch (std::exception &ex) {
-                send_error(request, ex.what());
+                if (request->status() == 0) send_error(request, ex.what());
             }
             catch (...) {
-                send_error(request, "Unknown error");
+                if (request->status() == 0) send_error(request, "Unknown error");
+            }
+            request->trace_end(trace::Phase::Handler);
+        }
+
+        struct ServiceDispatcher::Batch {
+            scgi::RequestPtr request;
+            // Format of calls responses (they share headers of batch request)
+            Codec codec = Codec::Json;
+            // Entries of JSON response are spliced as text, entries of binary response are decoded
+            std::vector<std::string> results;
+            std::vector<Json::Value> values;
+            std::atomic<size_t> remaining{0};
+
+            /**
+             * Store response of entry `index`. Last stored result sends whole batch
+             */
+            void complete(size_t index, const std::string &response) {
+                int status = 0;
+                bool is_json = false;
+                size_t offset = 0;
+                // Head of CGI-like response
+                while (offset < response.size()) {
+                    size_t end = response.find("\r\n", offset);
+                    if (end == std::string::npos) end = response.size();
+                    if (end == offset) {
+                        offset += 2;
+                        break;
+                    }
+                    if (response.compare(offset, 7, "Status:") == 0) {
+                        status = std::atoi(response.c_str() + offset + 7);
+                    } else if (strncasecmp(response.c_str() + offset, "Content-Type:", 13) == 0) {
+                        is_json = response.find("json", offset) < end;
+                    }
+                    offset = end + 2;
+                }
+                StringRef body;
+                if (offset < response.size()) body = StringRef(response.data() + offset, response.size() - offset);
+                if (codec == Codec::Json) results[index] = json_result(status, is_json, body);
+                else values[index] = value_result(status, body);
+                if (remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+                if (codec == Codec::Json) {
+                    request->set_response_type(scgi::http::content_type::application_json);
+                    request->begin_response();
+                    std::ostream &out = request->output();
+                    out << '[';
+                    for (size_t i = 0; i < results.size(); ++i) {
+                        if (i > 0) out << ',';
+                        out << results[i];
+                    }
+                    out << ']';
+                } else {
+                    Json::Value array(Json::arrayValue);
+                    array.resize(static_cast<Json::ArrayIndex>(values.size()));
+                    for (size_t i = 0; i < values.size(); ++i) array[static_cast<Json::ArrayIndex>(i)].swap(values[i]);
+                    send(request, array);
+                }
+                request.reset();
+            }
+
+            /**
+             * Entry of JSON batch response: `{"result": ...}` for 2xx status, otherwise
+             * `{"error": {"code": status, "message": ...}}`
+             */
+            std::string json_result(int status, bool is_json, const StringRef &body) const {
+                if (status >= 200 && status < 300) {
+                    if (body.empty()) return "{\"result\":null}";
+                    return "{\"result\":" + (is_json ? body.str() : to_json(Json::Value(body.begin(), body.end()))) +
+                           "}";
+                }
+                return to_json(value_result(status, body));
+            }
+
+            /**
+             * Entry of batch response in binary format. Result of call is decoded
+             */
+            Json::Value value_result(int status, const StringRef &body) const {
+                Json::Value entry(Json::objectValue);
+                if (status >= 200 && status < 300) {
+                    Json::Value &result = entry["result"];
+                    if (!body.empty() && !read_binary(codec, body.data, body.size, result))
+                        result = Json::Value(body.begin(), body.end());
+                    return entry;
+                }
+                if (status == 0) status = (int) scgi::http::Status::InternalError;
+                // Message of send_error without prefix and line end
+                std::string message = body.str();
+                if (message.compare(0, 7, "Error: ") == 0) message.erase(0, 7);
+                while (!message.empty() && std::isspace(static_cast<unsigned char>(message.back()))) message.pop_back();
+                if (message.empty() && scgi::http::reason_phrase(status) != nullptr)
+                    message = scgi::http::reason_phrase(status);
+                Json::Value &error = entry["error"];
+                error["code"] = status;
+                error["message"] = message;
+                return entry;
+            }
+        };
+
+        struct ServiceDispatcher::BatchEntry : public scgi::Request {
+            ServiceHandler::Ref handler;
+            Json::Value call;
+
+            BatchEntry(const scgi::Request &parent, const ResponseSink &sink) : scgi::Request(parent, parent.id(), sink) {
+            }
+        };
+
+        void ServiceDispatcher::process_batch(ServiceHandler::Ref handler, scgi::RequestPtr request,
+                                              Json::Value &calls) {
+            if (calls.empty()) {
+                send(request, Json::Value(Json::arrayValue));
+                return;
+            }
+            if (calls.size() > batch_limit_) {
+                send_error(request, "Too many calls in batch", scgi::http::Status::BadRequest,
+                           scgi::http::reason_phrase((int) scgi::http::Status::BadRequest));
+                return;
+            }
+            auto batch = std::make_shared<Batch>();
+            batch->request = request;
+            batch->codec = response_codec(request->header(header::Slot::http_accept));
+            if (batch->codec == Codec::Json) batch->results.resize(calls.size());
+            else batch->values.resize(calls.size());
+            batch->remaining = calls.size();
+            for (Json::ArrayIndex i = 0; i < calls.size(); ++i) {
+                auto entry = std::make_shared<BatchEntry>(*request, [batch, i](std::string &&response) {
+                    batch->complete(i, response);
+                });
+                entry->handler = handler;
+                entry->call.swap(calls[i]);
+                // Entry is released (and its result is stored) when call is complete
+                if (batch_strategy_) batch_strategy_->submit(std::move(entry));
+                else process_entry(std::move(entry));
             }
         }
 
+        void ServiceDispatcher::process_entry(scgi::RequestPtr request) {
+            auto entry = std::static_pointer_cast<BatchEntry>(request);
+            request.reset();
+            current_style = json_style_;
+            current_stats = stats_enabled_;
+            // Response may be already started by failed handler
+            try {
+                if (!entry->handler->process_request(entry, entry->call) && entry->status() == 0)
+                    service::send_error(entry, "Internal service error");
+            } catch (std::exception &ex) {
+                if (entry->status() == 0) service::send_error(entry, ex.what());
+            } catch (...) {
+                if (entry->status() == 0) service::send_error(entry, "Unknown error");
+            }
+        }
+
+        void ServiceDispatcher::set_batch_strategy(Strategy::Ptr strategy) {
+            if (batch_strategy_) batch_strategy_->stop();
+            batch_strategy_ = strategy;
+            if (batch_strategy_) batch_strategy_->start([this](scgi::RequestPtr entry) { process_entry(entry); });
+        }
+
         ServiceManager::~ServiceManager() {
+            strategy()->stop();
             stop();
         }
 
         void ServiceManager::on_client_connected(io::FileStream::Ptr client) {
             try {
-                scgi::RequestPtr request = std::make_shared<Request>(client->descriptor(), id_++);
+                dispatch(std::make_shared<Request>(client->descriptor(), id_++));
+            } catch (std::exception &ex) {
+                std::cerr << "STD exception: " << ex.what() << std::endl;
+            } catch (...) {
+                std::cerr << "Unknown exception" << std::endl;
+            }
+        }
+
+        ServiceDispatcher::ServiceDispatcher() {
+            set_strategy(std::make_shared<InlineStrategy>());
+        }
+
+        void ServiceDispatcher::set_strategy(Strategy::Ptr strategy) {
+            if (strategy_) strategy_->stop();
+            strategy_ = strategy ? strategy : std::make_shared<InlineStrategy>();
+            strategy_->start([this](scgi::RequestPtr request) { process(request); });
+        }
+
+        void ServiceDispatcher::dispatch(scgi::RequestPtr request) {
+            if (!request || !request->is_valid()) return;
+            if (admission_ && !admission_->enqueue(strategy_->pending())) {
+                send_overloaded(request);
+                return;
+            }
+            strategy_->submit(request);
+        }
+
+        void ServiceDispatcher::send_overloaded(scgi::RequestPtr request) {
+            StringRef path = request->header(header::Slot::path);
+            const Mount *mount = router_.match(path.empty() ? StringRef("/", 1) : path, request->route());
+            if (mount == nullptr) {
+                request->write_response(AdmissionControl::unavailable_response());
+                return;
+            }
+            if (stats_enabled_) mount->stats->track(request);
+            mount->handler->send_overloaded(request);
+        }
+
+        void ServiceDispatcher::process(scgi::RequestPtr request) {
+            try {
                 if (request && request->is_valid()) {
+                    current_style = json_style_;
+                    current_stats = stats_enabled_;
                     if (debug_) {
-                        std::clog << "Request to " << request->path() << " method " << request->method() <<
+                        std::clog << "Request to " << request->path_ref() << " method " << request->method_ref() <<
                         std::endl;
                     }
                     find_handler(request);
                 }
-                request = nullptr;
             } catch (std::exception &ex) {
                 std::cerr << "STD exception: " << ex.what() << std::endl;
             } catch (...) {
@@ -99,26 +348,134 @@ namespace scgi {
             }
         }
 
+        ServiceDispatcher::~ServiceDispatcher() {
+            strategy_->stop();
+            if (batch_strategy_) batch_strategy_->stop();
+        }
+
+        /**
+         * Order of names: by size, then by bytes. Cheap to compare for small tables
+         */
+        static inline int compare_names(const char *a, size_t a_size, const char *b, size_t b_size) {
+            if (a_size != b_size) return a_size < b_size ? -1 : 1;
+            return a_size == 0 ? 0 : std::memcmp(a, b, a_size);
+        }
+
+        struct ServiceHandler::DispatchTable {
+            struct Param {
+                std::string name;
+                Json::ValueType type;
+            };
+
+            struct Entry {
+                std::string name;
+                const MethodDescription *method;
+                // Required params sorted by `compare_names`
+                std::vector<Param> params;
+
+                /**
+                 * Check required params by one pass over object members without allocations. Params passed to
+                 * `arguments` are checked by their decoding
+                 */
+                bool validate(const Json::Value &value, const MethodArguments *arguments = nullptr) const {
+                    size_t matched = 0;
+                    if (arguments != nullptr)
+                        for (const Param &param:params) if (arguments->is_passed(param.name)) ++matched;
+                    for (auto iter = value.begin(); iter != value.end() && matched < params.size(); ++iter) {
+                        const char *end = nullptr;
+                        const char *member = iter.memberName(&end);
+                        const Param *param = find(params, member, static_cast<size_t>(end - member));
+                        if (param == nullptr || (arguments != nullptr && arguments->is_passed(param->name))) continue;
+                        if (!is_json_compatible(*iter, param->type)) return false;
+                        ++matched;
+                    }
+                    return matched == params.size();
+                }
+            };
+
+            // Sorted by `compare_names`
+            std::vector<Entry> entries;
+
+            /**
+             * Binary search of item with `name` in sorted vector
+             */
+            template<class Item>
+            static const Item *find(const std::vector<Item> &items, const char *name, size_t size) {
+                size_t low = 0, high = items.size();
+                while (low < high) {
+                    size_t middle = (low + high) / 2;
+                    const std::string &key = items[middle].name;
+                    int cmp = compare_names(key.data(), key.size(), name, size);
+                    if (cmp == 0) return &items[middle];
+                    if (cmp < 0) low = middle + 1; else high = middle;
+                }
+                return nullptr;
+            }
+        };
+
+        template<class Item>
+        static inline bool name_less(const Item &a, const Item &b) {
+            return compare_names(a.name.data(), a.name.size(), b.name.data(), b.name.size()) < 0;
+        }
+
+        const ServiceHandler::DispatchTable &ServiceHandler::table() {
+            const DispatchTable *compiled = compiled_.load(std::memory_order_acquire);
+            if (compiled != nullptr) return *compiled;
+            std::lock_guard<std::mutex> lock(compile_lock_);
+            compiled = compiled_.load(std::memory_order_relaxed);
+            if (compiled != nullptr) return *compiled;
+            std::unique_ptr<DispatchTable> table(new DispatchTable());
+            for (auto &kv:methods) {
+                DispatchTable::Entry entry{kv.first, &kv.second, {}};
+                for (auto &param:kv.second.required_params)
+                    entry.params.push_back(DispatchTable::Param{param.first, param.second});
+                std::sort(entry.params.begin(), entry.params.end(), name_less<DispatchTable::Param>);
+                table->entries.push_back(std::move(entry));
+            }
+            std::sort(table->entries.begin(), table->entries.end(), name_less<DispatchTable::Entry>);
+            table_ = std::move(table);
+            compiled_.store(table_.get(), std::memory_order_release);
+            return *table_;
+        }
+
         ServiceHandler::MethodDescription &ServiceHandler::register_method(const std::string &name) {
+            compiled_.store(nullptr, std::memory_order_release);
             methods[name] = MethodDescription{name};
+            methods[name].stats = std::make_shared<EndpointStats>();
             return methods[name];
         }
 
         bool ServiceHandler::process_request(scgi::RequestPtr request, const Json::Value &value) {
+            return process_call(request, value, nullptr);
+        }
+
+        bool ServiceHandler::process_request(scgi::RequestPtr request, const Json::Value &value, CallReader &reader) {
+            return process_call(request, value, &reader);
+        }
+
+        bool ServiceHandler::process_call(scgi::RequestPtr request, const Json::Value &value, CallReader *reader) {
             if (!value.isObject()) {
                 send_error(request, "Request data is not object");
                 std::clog << "Request data is not object" << std::endl;
                 return false;
             }
-            std::string method = value["method"].asString();
-            auto methodIter = methods.find(method);
-            if (methodIter == methods.end()) {
-                send_error(request, "Method [" + method + "] not found");
-                std::clog << "Method " << method << " not found" << std::endl;
+            const Json::Value &method = value["method"];
+            const char *begin = nullptr, *end = nullptr;
+            if (!method.isString() || !method.getString(&begin, &end)) begin = end = nullptr;
+            const DispatchTable::Entry *entry = DispatchTable::find(table().entries, begin,
+                                                                    static_cast<size_t>(end - begin));
+            if (entry == nullptr) {
+                std::string name = method.isString() ? method.asString() : std::string();
+                send_error(request, "Method [" + name + "] not found");
+                std::clog << "Method " << name << " not found" << std::endl;
                 return false;
             }
-            MethodDescription &mthd = (*methodIter).second;
-            if (!mthd.validate(value)) {
+            const MethodDescription &mthd = *entry->method;
+            if (current_stats && mthd.stats) mthd.stats->track(request);
+            // Arguments are decoded for method which is called
+            MethodArguments *arguments = reader != nullptr && reader->method_ == &mthd ? reader->arguments_.get()
+                                                                                       : nullptr;
+            if (!entry->validate(value, arguments)) {
                 send_error(request, "Invalid arguments");
                 std::clog << "Invalid arguments" << std::endl;
                 return false;
@@ -127,6 +484,7 @@ namespace scgi {
                 std::clog << "Check before failed" << std::endl;
                 return false;
             }
+            if (arguments != nullptr) return arguments->call(request, value);
             if (!mthd.processor) {
                 std::clog << "Processor not found" << std::endl;
                 return false;
@@ -134,19 +492,192 @@ namespace scgi {
             return mthd.processor(request, value);
         }
 
+        void ServiceHandler::CallReader::resolve(const char *name, size_t size) {
+            const DispatchTable::Entry *entry = DispatchTable::find(service_.table().entries, name, size);
+            method_ = nullptr;
+            arguments_.reset();
+            // Pre-processor takes whole value
+            if (entry == nullptr || !entry->method->arguments || entry->method->check_before) return;
+            method_ = entry->method;
+            arguments_ = method_->arguments();
+        }
+
+        bool ServiceHandler::CallReader::on_null() {
+            if (target_ != nullptr) return passed(target_->on_null());
+            is_method_ = false;
+            return builder_.on_null();
+        }
+
+        bool ServiceHandler::CallReader::on_bool(bool value) {
+            if (target_ != nullptr) return passed(target_->on_bool(value));
+            is_method_ = false;
+            return builder_.on_bool(value);
+        }
+
+        bool ServiceHandler::CallReader::on_int(int64_t value) {
+            if (target_ != nullptr) return passed(target_->on_int(value));
+            is_method_ = false;
+            return builder_.on_int(value);
+        }
+
+        bool ServiceHandler::CallReader::on_uint(uint64_t value) {
+            if (target_ != nullptr) return passed(target_->on_uint(value));
+            is_method_ = false;
+            return builder_.on_uint(value);
+        }
+
+        bool ServiceHandler::CallReader::on_double(double value) {
+            if (target_ != nullptr) return passed(target_->on_double(value));
+            is_method_ = false;
+            return builder_.on_double(value);
+        }
+
+        bool ServiceHandler::CallReader::on_string(const char *data, size_t size) {
+            if (target_ != nullptr) return passed(target_->on_string(data, size));
+            if (is_method_) resolve(data, size);
+            is_method_ = false;
+            return builder_.on_string(data, size);
+        }
+
+        bool ServiceHandler::CallReader::on_key(const char *data, size_t size) {
+            if (target_ != nullptr) return target_->on_key(data, size);
+            // Members of payload object
+            if (depth_ == 1) {
+                is_method_ = size == 6 && std::memcmp(data, "method", 6) == 0;
+                if (arguments_) {
+                    // Method can't be changed after some of its params are consumed
+                    target_ = is_method_ ? &skip_ : arguments_->reader(data, size);
+                    is_method_ = false;
+                    if (target_ != nullptr) return true;
+                }
+            }
+            return builder_.on_key(data, size);
+        }
+
+        bool ServiceHandler::CallReader::on_object_begin() {
+            if (target_ != nullptr) {
+                ++nested_;
+                return target_->on_object_begin();
+            }
+            is_method_ = false;
+            ++depth_;
+            return builder_.on_object_begin();
+        }
+
+        bool ServiceHandler::CallReader::on_object_end() {
+            if (target_ != nullptr) {
+                --nested_;
+                return passed(target_->on_object_end());
+            }
+            --depth_;
+            return builder_.on_object_end();
+        }
+
+        bool ServiceHandler::CallReader::on_array_begin() {
+            if (target_ != nullptr) {
+                ++nested_;
+                return target_->on_array_begin();
+            }
+            is_method_ = false;
+            ++depth_;
+            return builder_.on_array_begin();
+        }
+
+        bool ServiceHandler::CallReader::on_array_end() {
+            if (target_ != nullptr) {
+                --nested_;
+                return passed(target_->on_array_end());
+            }
+            --depth_;
+            return builder_.on_array_end();
+        }
+
         bool send_error(scgi::RequestPtr request, const std::string &message) {
             request->begin_response((int) scgi::http::Status::InternalError,
                                     scgi::http::status_message::internal_error);
-            request->output() << "Error: " << message << std::endl;
+            request->output() << "Error: " << message << "\n";
             return false;
         }
 
         void send(scgi::RequestPtr request, const Json::Value &value) {
+            send(request, value, current_style);
+        }
+
+        void send(scgi::RequestPtr request, const Json::Value &value, JsonStyle style) {
+            Codec codec = response_codec(request->header(header::Slot::http_accept));
+            request->set_response_type(content_type(codec));
+            request->begin_response();
+            write_value(*request->output().rdbuf(), value, codec, style);
+        }
+
+        JsonStream stream_json(scgi::RequestPtr request) {
+            return stream_json(request, current_style);
+        }
+
+        JsonStream stream_json(scgi::RequestPtr request, JsonStyle style) {
             request->set_response_type(scgi::http::content_type::application_json);
             request->begin_response();
-            request->output() << value.toStyledString();
+            return JsonStream(*request->output().rdbuf(), style);
         }
 
+        struct Deferred::State {
+            std::mutex lock;
+            scgi::RequestPtr request;
+            JsonStyle style;
+
+            /**
+             * Take request for completion only once
+             */
+            inline scgi::RequestPtr take() {
+                std::lock_guard<std::mutex> guard(lock);
+                scgi::RequestPtr result;
+                result.swap(request);
+                return result;
+            }
+
+            ~State() {
+                if (request) send_error(request, "Request was abandoned");
+            }
+        };
+
+        Deferred defer(scgi::RequestPtr request) {
+            Deferred deferred;
+            deferred.state_ = std::make_shared<Deferred::State>();
+            deferred.state_->request = request;
+            deferred.state_->style = current_style;
+            return deferred;
+        }
+
+        bool Deferred::resolve(const Json::Value &value) const {
+            scgi::RequestPtr request = state_ ? state_->take() : nullptr;
+            if (!request) return false;
+            send(request, value, state_->style);
+            return true;
+        }
+
+        bool Deferred::reject(const std::string &message) const {
+            scgi::RequestPtr request = state_ ? state_->take() : nullptr;
+            if (!request) return false;
+            send_error(request, message);
+            return true;
+        }
+
+        bool Deferred::is_done() const {
+            return !request();
+        }
+
+        scgi::RequestPtr Deferred::request() const {
+            if (!state_) return nullptr;
+            std::lock_guard<std::mutex> guard(state_->lock);
+            return state_->request;
+        }
+
+        void ServiceHandler::send_overloaded(scgi::RequestPtr request) const {
+            request->write_response(AdmissionControl::unavailable_response());
+        }
+
+        ServiceHandler::ServiceHandler() { }
+
         ServiceHandler::~ServiceHandler() { }
 
         bool ServiceHandler::MethodDescription::validate(const Json::Value &value) {
@@ -155,7 +686,7 @@ namespace scgi {
                 value["method"].asString() != name)
                 return false;
             for (auto &kv:required_params) {
-                if (!value.isMember(kv.first) || value[kv.first].type() != kv.second) return false;
+                if (!value.isMember(kv.first) || !is_json_compatible(value[kv.first], kv.second)) return false;
             }
             return true;
         }
@@ -209,7 +740,7 @@ namespace scgi {
 
         void ServiceHandler::get_methods_description(Json::Value &mthds) const {
             for (auto &kv: methods) {
-                Json::Value desc;
+                Json::Value desc(Json::objectValue);
                 if (kv.second.serialize(desc))
                     mthds.append(desc);
                 else
@@ -227,16 +758,91 @@ namespace scgi {
             send(request, info);
         }
 
-        void ServiceManager::send_service_description(scgi::RequestPtr request, bool full) {
+        /**
+         * Counters and latency percentiles (in microseconds) of endpoint
+         */
+        static Json::Value stats_to_json(const EndpointStats &stats) {
+            static const char *classes[] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+            Json::Value result(Json::objectValue);
+            result["requests"] = static_cast<Json::UInt64>(stats.requests.load());
+            result["bytes_in"] = static_cast<Json::UInt64>(stats.bytes_in.load());
+            result["bytes_out"] = static_cast<Json::UInt64>(stats.bytes_out.load());
+            Json::Value &responses = result["responses"] = Json::Value(Json::objectValue);
+            for (size_t i = 0; i < 5; ++i) responses[classes[i]] = static_cast<Json::UInt64>(stats.responses[i].load());
+            Histogram::Snapshot snapshot = stats.latency.snapshot();
+            Json::Value &latency = result["latency_us"] = Json::Value(Json::objectValue);
+            latency["count"] = static_cast<Json::UInt64>(snapshot.count);
+            latency["mean"] = snapshot.mean();
+            latency["p50"] = static_cast<Json::UInt64>(snapshot.percentile(0.5));
+            latency["p90"] = static_cast<Json::UInt64>(snapshot.percentile(0.9));
+            latency["p99"] = static_cast<Json::UInt64>(snapshot.percentile(0.99));
+            latency["p999"] = static_cast<Json::UInt64>(snapshot.percentile(0.999));
+            latency["max"] = static_cast<Json::UInt64>(snapshot.max);
+            return result;
+        }
+
+        void ServiceHandler::get_methods_stats(Json::Value &result) const {
+            for (auto &kv:methods) {
+                if (kv.second.stats) result[kv.first] = stats_to_json(*kv.second.stats);
+            }
+        }
+
+        void ServiceHandler::get_methods_stats(const std::string &labels, std::vector<LabeledStats> &result) const {
+            for (auto &kv:methods) {
+                if (kv.second.stats)
+                    result.emplace_back(labels + ",method=\"" + prometheus_label(kv.first) + "\"",
+                                        kv.second.stats.get());
+            }
+        }
+
+        void ServiceDispatcher::send_stats(scgi::RequestPtr request, bool prometheus) const {
+            std::vector<const Mount *> mounts;
+            for (auto &kv:mounts_) mounts.push_back(&kv.second);
+            send_stats(request, mounts, prometheus);
+        }
+
+        void ServiceDispatcher::send_stats(scgi::RequestPtr request, const std::vector<const Mount *> &mounts,
+                                           bool prometheus) const {
+            if (prometheus) {
+                std::vector<LabeledStats> endpoints;
+                for (auto mount:mounts) {
+                    std::string labels = "path=\"" + prometheus_label(mount->path) + "\"";
+                    endpoints.emplace_back(labels, mount->stats.get());
+                    mount->handler->get_methods_stats(labels, endpoints);
+                }
+                request->set_response_type("text/plain; version=0.0.4");
+                request->begin_response();
+                write_prometheus(request->output(), endpoints);
+                return;
+            }
+            Json::Value info;
+            info["time"] = format_time(std::chrono::system_clock::now());
+            Json::Value &services = info["services"] = Json::Value(Json::objectValue);
+            for (auto mount:mounts) {
+                Json::Value service = stats_to_json(*mount->stats);
+                Json::Value &methods = service["methods"] = Json::Value(Json::objectValue);
+                mount->handler->get_methods_stats(methods);
+                services[mount->path] = service;
+            }
+            send(request, info);
+        }
+
+        void ServiceDispatcher::send_trace(scgi::RequestPtr request) const {
+            request->set_response_type(scgi::http::content_type::application_json);
+            request->begin_response();
+            trace::dump(request->output());
+        }
+
+        void ServiceDispatcher::send_service_description(scgi::RequestPtr request, bool full) {
             Json::Value info;
             Json::Value services_data;
             info["time"] = format_time(std::chrono::system_clock::now());
             if (!full)
-                for (auto &kv:handlers) services_data.append(kv.first);
+                for (auto &kv:mounts_) services_data.append(kv.first);
             else {
-                for (auto &kv:handlers) {
+                for (auto &kv:mounts_) {
                     Json::Value methods;
-                    kv.second->get_methods_description(methods);
+                    kv.second.handler->get_methods_description(methods);
                     info[kv.first] = methods;
                 }
             }
@@ -244,12 +850,22 @@ namespace scgi {
             send(request, info);
         }
 
-        bool ServiceManager::add_handler(const std::string &path, ServiceHandler::Ref service) {
+        bool ServiceDispatcher::add_handler(const std::string &path, ServiceHandler::Ref service) {
             if (path.empty() || path == "/")return false;
-            handlers[path] = service;
+            // Prefix `/data/` is same as `/data`
+            std::string prefix = path.back() == '/' ? path.substr(0, path.size() - 1) : path;
+            Mount mount{service, prefix, std::make_shared<EndpointStats>()};
+            if (!service || !router_.mount(prefix, mount)) return false;
+            mounts_[prefix] = mount;
             return true;
         }
 
+        ServiceHandler::Ref ServiceDispatcher::handler(const std::string &path) const {
+            std::string prefix = !path.empty() && path.back() == '/' ? path.substr(0, path.size() - 1) : path;
+            auto iter = mounts_.find(prefix);
+            return iter != mounts_.end() ? (*iter).second.handler : nullptr;
+        }
+
 
     }
 }
\ No newline at end of file
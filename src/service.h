@@ -7,10 +7,23 @@
 
 #include <functional>
 #include "scgi.h"
+#include "strategy.h"
+#include "json_writer.h"
+#include "codec.h"
+#include "json_parser.h"
+#include "json_traits.h"
+#include "admission.h"
+#include "stats.h"
 #include <jsoncpp/json/reader.h>
 #include <jsoncpp/json/value.h>
 #include <unordered_map>
+#include <map>
 #include <chrono>
+#include <tuple>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
 #include <io/async.h>
 
 namespace scgi {
@@ -27,13 +40,203 @@ namespace scgi {
             return std::string(buf, count);
         }
 
+        /**
+         * Send error message (500) with specified message.
+         * Always returns false
+         */
+        bool send_error(scgi::RequestPtr request, const std::string &message);
+
+        /**
+         * Send JSON reponse. Layout is taken from dispatcher which processes request (compact by default).
+         * Response is MessagePack or CBOR if client accepts it (see `response_codec`)
+         */
+        void send(scgi::RequestPtr request, const Json::Value &value);
+
+        /**
+         * Send JSON reponse with specified layout
+         */
+        void send(scgi::RequestPtr request, const Json::Value &value, JsonStyle style);
+
+        /**
+         * Begin streamed JSON response (layout is taken from dispatcher). Items written to returned stream are sent
+         * by parts as response buffer fills, so memory doesn't depend on size of result; writing blocks while
+         * socket is full. Stream must not outlive request. Response is JSON regardless of HTTP_ACCEPT
+         */
+        JsonStream stream_json(scgi::RequestPtr request);
+
+        JsonStream stream_json(scgi::RequestPtr request, JsonStyle style);
+
+        /**
+         * Completion of request which outlives its handler. Handler takes it by `defer`, returns true immediately
+         * and resolves it later from any thread (ex: when downstream database or child process answers).
+         * Copies share one completion: only first `resolve` or `reject` is sent, others return false.
+         * If all copies are destroyed without completion, error is sent
+         */
+        class Deferred {
+        public:
+            Deferred() { }
+
+            /**
+             * Send JSON result. Layout is taken from dispatcher which called `defer`
+             */
+            bool resolve(const Json::Value &value) const;
+
+            /**
+             * Send error message (500)
+             */
+            bool reject(const std::string &message) const;
+
+            /**
+             * Is result already sent
+             */
+            bool is_done() const;
+
+            /**
+             * Deferred request (nullptr after completion)
+             */
+            scgi::RequestPtr request() const;
+
+            inline bool is_valid() const {
+                return static_cast<bool>(state_);
+            }
+
+        private:
+            struct State;
+
+            std::shared_ptr<State> state_;
+
+            friend Deferred defer(scgi::RequestPtr request);
+        };
+
+        /**
+         * Take ownership of request response. Must be called in handler (in thread of dispatcher)
+         */
+        Deferred defer(scgi::RequestPtr request);
+
+        /**
+         * Typed arguments of one call decoded straight from parser events of request object. Member which is
+         * param of method is passed to its reader, params not passed that way are decoded from other members
+         */
+        class MethodArguments {
+        public:
+            /**
+             * Reader of param `name` or nullptr if method has no such param
+             */
+            virtual JsonParser::Handler *reader(const char *name, size_t size) = 0;
+
+            /**
+             * Was param `name` passed to its reader
+             */
+            virtual bool is_passed(const std::string &name) const = 0;
+
+            /**
+             * Call method and send result. Params which were not passed to readers are taken from `rest`
+             */
+            virtual bool call(scgi::RequestPtr request, const Json::Value &rest) = 0;
+
+            virtual ~MethodArguments() { }
+        };
+
+        /**
+         * Processor of typed method: decodes named arguments from request object (or from parser events, see
+         * `MethodArguments`), calls function and sends encoded result (null for void functions)
+         */
+        template<class Result, class ...Args>
+        struct TypedMethod {
+            std::function<Result(scgi::RequestPtr, Args...)> function;
+            std::vector<std::string> names;
+
+            /**
+             * Arguments of one call. Decoded values are passed to function as lvalues of declared types (moved
+             * for arguments by value)
+             */
+            class Arguments : public MethodArguments {
+            public:
+                explicit Arguments(const TypedMethod &method)
+                        : Arguments(method, typename MakeIndices<sizeof...(Args)>::type()) { }
+
+                JsonParser::Handler *reader(const char *name, size_t size) override {
+                    for (size_t i = 0; i < readers_.size(); ++i) {
+                        const std::string &param = method_.names[i];
+                        if (param.size() == size && param.compare(0, size, name, size) == 0) return readers_[i];
+                    }
+                    return nullptr;
+                }
+
+                bool is_passed(const std::string &name) const override {
+                    for (size_t i = 0; i < readers_.size(); ++i)
+                        if (method_.names[i] == name) return readers_[i]->is_passed();
+                    return false;
+                }
+
+                bool call(scgi::RequestPtr request, const Json::Value &rest) override {
+                    return call(request, rest, typename MakeIndices<sizeof...(Args)>::type());
+                }
+
+                /**
+                 * Decode arguments from request object
+                 */
+                template<size_t ...I>
+                bool decode(const Json::Value &value, Indices<I...>) {
+                    bool decoded = true;
+                    int expand[] = {0, (decoded = decoded && (std::get<I>(typed_).is_passed() ?
+                            std::get<I>(typed_).is_valid() : JsonTraits<typename std::decay<Args>::type>::decode(
+                                    value[method_.names[I]], std::get<I>(values_))), 0)...};
+                    (void) expand;
+                    return decoded;
+                }
+
+                template<size_t ...I>
+                bool call(scgi::RequestPtr request, const Json::Value &rest, Indices<I...> indices) {
+                    if (!decode(rest, indices)) return send_error(request, "Invalid arguments");
+                    method_.respond(request, std::is_void<Result>(), std::forward<Args>(std::get<I>(values_))...);
+                    return true;
+                }
+
+            private:
+                const TypedMethod &method_;
+                std::tuple<typename std::decay<Args>::type...> values_;
+                std::tuple<TypedArgumentReader<typename std::decay<Args>::type>...> typed_;
+                std::array<ArgumentReader *, sizeof...(Args)> readers_;
+
+                template<size_t ...I>
+                Arguments(const TypedMethod &method, Indices<I...>)
+                        : method_(method), typed_(std::get<I>(values_)...), readers_{{&std::get<I>(typed_)...}} { }
+
+                Arguments(const Arguments &) = delete;
+
+                Arguments &operator=(const Arguments &) = delete;
+            };
+
+            bool operator()(scgi::RequestPtr request, const Json::Value &value) const {
+                Arguments arguments(*this);
+                return arguments.call(request, value);
+            }
+
+        private:
+            template<class ...Values>
+            void respond(scgi::RequestPtr request, std::true_type, Values &&...values) const {
+                function(request, std::forward<Values>(values)...);
+                send(request, Json::Value());
+            }
+
+            template<class ...Values>
+            void respond(scgi::RequestPtr request, std::false_type, Values &&...values) const {
+                Json::Value result;
+                JsonTraits<typename std::decay<Result>::type>::encode(function(request, std::forward<Values>(values)...),
+                                                                      result);
+                send(request, result);
+            }
+        };
+
         /**
          * Base class of service processor
          */
         struct ServiceHandler {
 
             /**
-             * Functor type of processor and preprocessor. Return false will be interpreted as internal error
+             * Functor type of processor and preprocessor. Return false will be interpreted as internal error.
+             * Processor may return before response is complete, see `defer`
              */
             typedef std::function<bool(scgi::RequestPtr, const Json::Value &)> MethodType;
 
@@ -46,8 +249,7 @@ namespace scgi {
                  */
                 std::string name;
                 /**
-                 * Type of method response.
-                 * TODO: Validate it on server side
+                 * Type of method response. Enforced at compile time for typed methods (see `register_method`)
                  */
                 Json::ValueType returnType;
                 /**
@@ -58,6 +260,14 @@ namespace scgi {
                  * Processor and pre-processor. If pre-processor return false, returns internal error
                  */
                 MethodType processor, check_before;
+                /**
+                 * Factory of arguments decoded from parser events (typed methods only)
+                 */
+                std::function<std::unique_ptr<MethodArguments>()> arguments;
+                /**
+                 * Counters of method calls
+                 */
+                std::shared_ptr<EndpointStats> stats;
 
                 /**
                  * Validate incoming message for value type, method name, required params.
@@ -71,7 +281,8 @@ namespace scgi {
                 MethodDescription &set_return_type(Json::ValueType retype);
 
                 /**
-                 * Add required param in request
+                 * Add required param in request. Numbers are accepted for compatible types (integer for real,
+                 * non-negative integer for uint), null type accepts any value.
                  * Returns self instance
                  */
                 MethodDescription &set_param(const std::string &name, Json::ValueType pType);
@@ -120,11 +331,80 @@ namespace scgi {
              */
             typedef std::shared_ptr<ServiceHandler> Ref;
 
+            /**
+             * Handler of parser events of request payload. Builds `Json::Value` of payload, but once member
+             * `method` names typed method without pre-processor, its params which follow are decoded straight
+             * into typed arguments and are not added to value. Repeated members `method` which follow are dropped,
+             * so decoded arguments always belong to called method
+             */
+            class CallReader : public JsonParser::Handler {
+            public:
+                CallReader(ServiceHandler &service, Json::Value &root) : service_(service), builder_(root) { }
+
+                bool on_null() override;
+
+                bool on_bool(bool value) override;
+
+                bool on_int(int64_t value) override;
+
+                bool on_uint(uint64_t value) override;
+
+                bool on_double(double value) override;
+
+                bool on_string(const char *data, size_t size) override;
+
+                bool on_key(const char *data, size_t size) override;
+
+                bool on_object_begin() override;
+
+                bool on_object_end() override;
+
+                bool on_array_begin() override;
+
+                bool on_array_end() override;
+
+            private:
+                ServiceHandler &service_;
+                JsonBuilder builder_;
+                // Typed method named by payload and its arguments
+                const MethodDescription *method_ = nullptr;
+                std::unique_ptr<MethodArguments> arguments_;
+                // Reader of current param and depth of open containers in its value
+                JsonParser::Handler *target_ = nullptr;
+                size_t nested_ = 0;
+                // Consumer of dropped values
+                JsonParser::Handler skip_;
+                // Depth of open containers of payload
+                size_t depth_ = 0;
+                // Current value is member `method` of payload
+                bool is_method_ = false;
+
+                /**
+                 * Take arguments of typed method `name`
+                 */
+                void resolve(const char *name, size_t size);
+
+                /**
+                 * Value event is passed to param reader
+                 */
+                inline bool passed(bool accepted) {
+                    if (nested_ == 0) target_ = nullptr;
+                    return accepted;
+                }
+
+                friend struct ServiceHandler;
+            };
+
             /**
              * Process incoming request and tries to call required method handler
              */
             bool process_request(scgi::RequestPtr request, const Json::Value &value);
 
+            /**
+             * Process request which payload was parsed by `reader` into `value`
+             */
+            bool process_request(scgi::RequestPtr request, const Json::Value &value, CallReader &reader);
+
             /**
              * Send JSON description of service
              */
@@ -135,6 +415,46 @@ namespace scgi {
              */
             void get_methods_description(Json::Value &result) const;
 
+            /**
+             * Serialize counters of methods to JSON object
+             */
+            void get_methods_stats(Json::Value &result) const;
+
+            /**
+             * Prometheus labels and counters of methods. Labels start with `labels` (ex: `path="/data"`)
+             */
+            void get_methods_stats(const std::string &labels, std::vector<LabeledStats> &result) const;
+
+            /**
+             * Answer request rejected by admission control. Pre-built 503 response by default
+             */
+            virtual void send_overloaded(scgi::RequestPtr request) const;
+
+            /**
+             * Maximum size of request body (16 MiB by default). Bigger requests are rejected with 413 by
+             * CONTENT_LENGTH before body is read
+             */
+            inline void set_max_body_size(size_t size) {
+                max_body_size_ = size;
+            }
+
+            inline size_t max_body_size() const {
+                return max_body_size_;
+            }
+
+            /**
+             * Maximum nesting of arrays and objects in payload (256 by default)
+             */
+            inline void set_max_depth(size_t depth) {
+                max_depth_ = depth;
+            }
+
+            inline size_t max_depth() const {
+                return max_depth_;
+            }
+
+            ServiceHandler();
+
             /**
              * Just stub for inheritance
              */
@@ -142,26 +462,116 @@ namespace scgi {
 
         protected:
             /**
-             * Register new method of service with specified `name`
+             * Register new method of service with specified `name`. Methods are registered before service
+             * starts processing requests: registration is not synchronized with processing
              */
             MethodDescription &register_method(const std::string &name);
 
+            /**
+             * Register method `name` bound to member `method` of this service. Params schema is deduced from
+             * argument types and `names` (in order of arguments), return type - from result type.
+             * Arguments are decoded to typed values and result is sent as JSON automatically.
+             * Member may take scgi::RequestPtr as first argument. Throws std::invalid_argument if count of
+             * names doesn't match arguments
+             */
+            template<class Class, class Result, class ...Args>
+            MethodDescription &register_method(const std::string &name, Result (Class::*method)(Args...),
+                                               const std::vector<std::string> &names) {
+                Class *self = static_cast<Class *>(this);
+                return register_typed<Result, Args...>(name, names, [self, method](scgi::RequestPtr, Args ...args) {
+                    return (self->*method)(std::forward<Args>(args)...);
+                });
+            }
+
+            template<class Class, class Result, class ...Args>
+            MethodDescription &register_method(const std::string &name, Result (Class::*method)(Args...) const,
+                                               const std::vector<std::string> &names) {
+                const Class *self = static_cast<const Class *>(this);
+                return register_typed<Result, Args...>(name, names, [self, method](scgi::RequestPtr, Args ...args) {
+                    return (self->*method)(std::forward<Args>(args)...);
+                });
+            }
+
+            template<class Class, class Result, class ...Args>
+            MethodDescription &register_method(const std::string &name,
+                                               Result (Class::*method)(scgi::RequestPtr, Args...),
+                                               const std::vector<std::string> &names) {
+                Class *self = static_cast<Class *>(this);
+                return register_typed<Result, Args...>(name, names, [self, method](scgi::RequestPtr request,
+                                                                                   Args ...args) {
+                    return (self->*method)(request, std::forward<Args>(args)...);
+                });
+            }
+
+            template<class Class, class Result, class ...Args>
+            MethodDescription &register_method(const std::string &name,
+                                               Result (Class::*method)(scgi::RequestPtr, Args...) const,
+                                               const std::vector<std::string> &names) {
+                const Class *self = static_cast<const Class *>(this);
+                return register_typed<Result, Args...>(name, names, [self, method](scgi::RequestPtr request,
+                                                                                   Args ...args) {
+                    return (self->*method)(request, std::forward<Args>(args)...);
+                });
+            }
+
 
         private:
+            /**
+             * Immutable lookup table of registered methods with flat validation programs
+             */
+            struct DispatchTable;
+
             std::unordered_map<std::string, MethodDescription> methods;
-        };
+            // Compiled on first request after registration of methods
+            std::unique_ptr<DispatchTable> table_;
+            std::atomic<const DispatchTable *> compiled_{nullptr};
+            size_t max_body_size_ = 16 * 1024 * 1024;
+            size_t max_depth_ = 256;
+            std::mutex compile_lock_;
 
+            /**
+             * Compiled table of current methods
+             */
+            const DispatchTable &table();
 
-        /**
-         * Send error message (500) with specified message.
-         * Always returns false
-         */
-        bool send_error(scgi::RequestPtr request, const std::string &message);
+            /**
+             * Find, validate and call method of `value`. Arguments of typed method may be decoded by `reader`
+             */
+            bool process_call(scgi::RequestPtr request, const Json::Value &value, CallReader *reader);
+
+            template<class Result>
+            static constexpr Json::ValueType result_type(std::true_type) {
+                return Json::nullValue;
+            }
+
+            template<class Result>
+            static constexpr Json::ValueType result_type(std::false_type) {
+                return JsonTraits<typename std::decay<Result>::type>::type;
+            }
+
+            template<class Result, class ...Args>
+            MethodDescription &register_typed(const std::string &name, const std::vector<std::string> &names,
+                                              const typename std::common_type<
+                                                      std::function<Result(scgi::RequestPtr, Args...)>>::type &function) {
+                if (names.size() != sizeof...(Args))
+                    throw std::invalid_argument("Count of params names of method " + name + " doesn't match arguments");
+                MethodDescription &description = register_method(name);
+                Json::ValueType types[] = {Json::nullValue, JsonTraits<typename std::decay<Args>::type>::type...};
+                for (size_t i = 0; i < names.size(); ++i) description.set_param(names[i], types[i + 1]);
+                description.set_return_type(result_type<Result>(std::is_void<Result>()));
+                typedef TypedMethod<Result, Args...> Method;
+                std::shared_ptr<const Method> method = std::make_shared<Method>(Method{function, names});
+                description.set_processor([method](scgi::RequestPtr request, const Json::Value &value) {
+                    return (*method)(request, value);
+                });
+                // Arguments refer to method owned by description, which outlives its calls
+                description.arguments = [method]() {
+                    return std::unique_ptr<MethodArguments>(new typename Method::Arguments(*method));
+                };
+                return description;
+            }
+        };
 
-        /**
-         * Send JSON reponse
-         */
-        void send(scgi::RequestPtr request, const Json::Value &value);
 
         /**
          * Serialize obj to JSON by method `.serialize(Json::Value &v)`
@@ -183,23 +593,12 @@ namespace scgi {
         }
 
         /**
-         * Manage services. Connection managing is based on scgi::SimpleAcceptor. Single threaded
-         * TODO: Add different strategies (and way for adding new) for multithreading
+         * Route requests to services by path. Does not depend on transport: requests may come from
+         * io::AsyncSocketServer (see ServiceManager), scgi::AsyncAcceptor or any other source.
          */
-        struct ServiceManager : public io::AsyncSocketServer {
-
-            /**
-             * Container for services on each prefix. Prefix '/' or '' is highly NOT RECOMMENDED because of
-             * publishing common info
-             */
-            std::unordered_map<std::string, ServiceHandler::Ref> handlers;
+        struct ServiceDispatcher {
 
-            /**
-             * Initialize service manager based on provided connection manager.
-             * Highly recommended use non-blocking mode (ex: accept timeout sets to 1 second) otherwise
-             * you can not use idle function (for example: catch SIGINT signal)
-             */
-            ServiceManager(io::Epoll &epoll, io::ConnectionManager::Ptr connection_manager);
+            ServiceDispatcher();
 
             /**
              * Create new service shared pointer and register it to provided prefix `path`.
@@ -207,18 +606,23 @@ namespace scgi {
              */
             template<class ClassType, class ...Args>
             std::shared_ptr<ClassType> add_handler(const std::string &path, const Args &...args) {
-                if (path.empty() || path == "/")return nullptr;
                 auto ptr = std::make_shared<ClassType>(args...);
-                handlers[path] = ptr;
-                return ptr;
+                return add_handler(path, ptr) ? ptr : nullptr;
             }
 
             /**
-             * Adds new service to specified `prefix`.
-             * Returns false if prefix is '/' or ''
+             * Adds new service to specified `prefix`. Service receives requests to prefix and all paths below it
+             * (longest prefix wins). Prefix may contain `:name` segments and `*name` tail, captured values are
+             * available by `Request::param`, rest of path below prefix - by `Request::route().tail`.
+             * Returns false if prefix is '/', '' or malformed
              */
             bool add_handler(const std::string &path, ServiceHandler::Ref service);
 
+            /**
+             * Service added on prefix `path` (nullptr if there is no such prefix)
+             */
+            ServiceHandler::Ref handler(const std::string &path) const;
+
             /**
              * Set verbose output on error
              */
@@ -234,22 +638,117 @@ namespace scgi {
             }
 
             /**
-             * Stop service manager.
-             * Used virtual for future inheritance
+             * Set layout of JSON responses sent by `send` from handlers of this dispatcher
              */
-            virtual  ~ServiceManager();
+            inline void set_json_style(JsonStyle style) {
+                json_style_ = style;
+            }
 
-        protected:
+            inline JsonStyle json_style() const {
+                return json_style_;
+            }
+
+            /**
+             * Limit outstanding requests (nullptr - no limits). Requests over limits are answered at once by
+             * `ServiceHandler::send_overloaded` of target service. Set it before processing requests
+             */
+            inline void set_admission(AdmissionControl::Ptr admission) {
+                admission_ = admission;
+            }
 
+            inline AdmissionControl::Ptr admission() const {
+                return admission_;
+            }
 
-            virtual void on_client_connected(io::FileStream::Ptr client) override;
+            /**
+             * Count requests, responses and latency of services and methods (enabled by default). Counters are
+             * shown by `?stats` query (`?stats=prometheus` for Prometheus text format) on service path or root
+             */
+            inline void set_stats_enabled(bool enable) {
+                stats_enabled_ = enable;
+            }
+
+            inline bool is_stats_enabled() const {
+                return stats_enabled_;
+            }
+
+            /**
+             * Send counters of all services as JSON or in Prometheus text format
+             */
+            void send_stats(scgi::RequestPtr request, bool prometheus = false) const;
+
+            /**
+             * Send traces of requests in Chrome trace JSON format (see `trace::enable`). Shown by `?trace` query on
+             * root path
+             */
+            void send_trace(scgi::RequestPtr request) const;
+
+            /**
+             * Set strategy of request processing (InlineStrategy by default) and start it.
+             * Previous strategy is stopped
+             */
+            void set_strategy(Strategy::Ptr strategy);
+
+            /**
+             * Active strategy of request processing
+             */
+            inline Strategy::Ptr strategy() const {
+                return strategy_;
+            }
+
+            /**
+             * Process entries of batch requests (JSON array payload) by `strategy` (ex: WorkerPoolStrategy), so
+             * independent calls run in parallel. Without strategy (default) entries are processed one by one in
+             * thread of request. Strategy should not be shared with `set_strategy`. Previous strategy is stopped
+             */
+            void set_batch_strategy(Strategy::Ptr strategy);
+
+            inline Strategy::Ptr batch_strategy() const {
+                return batch_strategy_;
+            }
+
+            /**
+             * Maximum count of calls in one batch (256 by default). Bigger batches are rejected
+             */
+            inline void set_batch_limit(size_t limit) {
+                batch_limit_ = limit;
+            }
+
+            inline size_t batch_limit() const {
+                return batch_limit_;
+            }
+
+            /**
+             * Pass parsed request to strategy which will process it. Request is rejected if queue of strategy
+             * is over admission limit
+             */
+            void dispatch(scgi::RequestPtr request);
+
+            /**
+             * Find handler for parsed request and process it in caller thread. Catches all exceptions
+             */
+            void process(scgi::RequestPtr request);
+
+            /**
+             * Used virtual for future inheritance
+             */
+            virtual ~ServiceDispatcher();
+
+        protected:
 
-/**
+            /**
              * Process request. Tries find payload (from body, payload param or query params) and call handler.
              * Otherwise send error.
              */
             virtual void process_request(ServiceHandler::Ref handler, scgi::RequestPtr request);
 
+            /**
+             * Process array of calls: each call is processed by `handler` as separate request which shares
+             * headers with `request`. Results (or errors) are sent as one array in order of calls when all calls
+             * are complete. Calls are moved out of array
+             */
+            virtual void process_batch(ServiceHandler::Ref handler, scgi::RequestPtr request, Json::Value &calls);
+
             /**
              * Send error message with details (if debug enabled)
              */
@@ -263,27 +762,97 @@ namespace scgi {
             void send_service_description(scgi::RequestPtr request, bool full = false);
 
         private:
-            uint64_t id_ = 1;
+            /**
+             * Service mounted on path
+             */
+            struct Mount {
+                ServiceHandler::Ref handler;
+                std::string path;
+                std::shared_ptr<EndpointStats> stats;
+            };
+
+            /**
+             * Send counters of `mounts` as JSON or in Prometheus text format
+             */
+            void send_stats(scgi::RequestPtr request, const std::vector<const Mount *> &mounts, bool prometheus) const;
+
+            /**
+             * Collected results of one batch
+             */
+            struct Batch;
+
+            /**
+             * One call of batch
+             */
+            struct BatchEntry;
+
+            /**
+             * Call method of batch entry in current thread
+             */
+            void process_entry(scgi::RequestPtr entry);
 
             /**
              * Find handler (and process request) or show service info
              */
             void find_handler(scgi::RequestPtr request);
 
+            /**
+             * Reject request by service of its path
+             */
+            void send_overloaded(scgi::RequestPtr request);
+
             /**
              * Disable coping.
              */
-            ServiceManager(const ServiceManager &) = delete;
+            ServiceDispatcher(const ServiceDispatcher &) = delete;
+
+            ServiceDispatcher &operator=(const ServiceDispatcher &) = delete;
+
+            Strategy::Ptr strategy_;
+
+            // Routes of `mounts_`
+            Router<Mount> router_;
+            // Mounts by prefix
+            std::map<std::string, Mount> mounts_;
+
+            bool debug_ = false;
+
+            JsonStyle json_style_ = JsonStyle::Compact;
+
+            AdmissionControl::Ptr admission_;
+
+            bool stats_enabled_ = true;
+
+            Strategy::Ptr batch_strategy_;
+
+            size_t batch_limit_ = 256;
+        };
+
+        /**
+         * Manage services. Connection managing is based on io::AsyncSocketServer. Requests are processed
+         * by strategy (see `set_strategy`), single threaded by default
+         */
+        struct ServiceManager : public io::AsyncSocketServer, public ServiceDispatcher {
 
-            ServiceManager &operator=(const ServiceManager &) = delete;
+            /**
+             * Initialize service manager based on provided connection manager.
+             * Highly recommended use non-blocking mode (ex: accept timeout sets to 1 second) otherwise
+             * you can not use idle function (for example: catch SIGINT signal)
+             */
+            ServiceManager(io::Epoll &epoll, io::ConnectionManager::Ptr connection_manager);
 
             /**
-             * Internal JSON parser
-             * FIXME: Make this thread-local
+             * Stop service manager.
+             * Used virtual for future inheritance
              */
-            Json::Reader reader;
+            virtual  ~ServiceManager();
 
-            bool debug_ = false;
+        protected:
+
+            virtual void on_client_connected(io::FileStream::Ptr client) override;
+
+        private:
+            uint64_t id_ = 1;
         };
     }
 }
@@ -0,0 +1,88 @@
+#include "sharded.h"
+#include "net.h"
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace scgi {
+
+    ShardedServer::ShardedServer(const ListenerFactory &listener, const AsyncAcceptor::Handler &handler,
+                                 size_t shards)
+            : listener_(listener), handler_(handler), shards_(shards) {
+        if (shards_ == 0) shards_ = std::thread::hardware_concurrency();
+        if (shards_ == 0) shards_ = 1;
+    }
+
+    ShardedServer::ListenerFactory ShardedServer::tcp(const std::string &host, const std::string &service,
+                                                      int backlog) {
+        return [host, service, backlog](size_t) { return net::listen_tcp(host, service, backlog, true); };
+    }
+
+    ShardedServer::ListenerFactory ShardedServer::unix_socket(const std::string &path, int backlog) {
+        auto shared = std::make_shared<int>(-1);
+        return [path, backlog, shared](size_t shard) {
+            if (shard == 0 || *shared < 0) *shared = net::listen_unix(path, backlog);
+            // Each acceptor owns (and closes) its descriptor
+            return *shared < 0 ? -1 : (shard == 0 ? *shared : dup(*shared));
+        };
+    }
+
+    bool ShardedServer::start() {
+        std::lock_guard<std::mutex> lock(lock_);
+        return launch();
+    }
+
+    bool ShardedServer::launch() {
+        shutdown();
+        for (size_t i = 0; i < shards_; ++i) {
+            int fd = listener_(i);
+            if (fd < 0) {
+                running_.clear();
+                return false;
+            }
+            std::unique_ptr<Shard> shard(new Shard());
+            shard->acceptor.reset(new AsyncAcceptor(shard->reactor, fd, handler_));
+            shard->acceptor->set_body_limit(body_limit_);
+            running_.push_back(std::move(shard));
+        }
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        for (size_t i = 0; i < running_.size(); ++i) {
+            Shard *shard = running_[i].get();
+            shard->thread = std::thread([shard]() { shard->reactor.run(); });
+            if (pinning_ && cpus > 0) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(i % cpus, &set);
+                pthread_setaffinity_np(shard->thread.native_handle(), sizeof(set), &set);
+            }
+        }
+        return true;
+    }
+
+    void ShardedServer::stop() {
+        std::lock_guard<std::mutex> lock(lock_);
+        shutdown();
+    }
+
+    void ShardedServer::shutdown() {
+        if (running_.empty()) return;
+        // Stop of reactor is kept, so shard which has not entered loop yet exits at once
+        for (auto &shard:running_) shard->reactor.stop();
+        for (auto &shard:running_) if (shard->thread.joinable()) shard->thread.join();
+        running_.clear();
+        ++generation_;
+        stopped_.notify_all();
+    }
+
+    bool ShardedServer::run() {
+        std::unique_lock<std::mutex> lock(lock_);
+        if (!launch()) return false;
+        uint64_t generation = generation_;
+        stopped_.wait(lock, [this, generation]() { return generation_ != generation; });
+        return true;
+    }
+
+    ShardedServer::~ShardedServer() {
+        stop();
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef SCGI_SHARDED_H
+#define SCGI_SHARDED_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <string>
+#include "acceptor.h"
+
+namespace scgi {
+
+    /**
+     * N independent reactors (shards), each in own thread with own epoll instance and own listening socket.
+     * Kernel balances connections between SO_REUSEPORT sockets, so there is no shared accept lock and no
+     * cross-thread handoff: request is accepted, parsed and handled by one thread.
+     * Handler is called from shard threads, so it must be thread-safe.
+     */
+    struct ShardedServer {
+
+        /**
+         * Creates listening socket for shard with specified index. Returns descriptor or -1 on error
+         */
+        typedef std::function<int(size_t)> ListenerFactory;
+
+        /**
+         * Prepare `shards` reactors (zero means count of hardware threads)
+         */
+        ShardedServer(const ListenerFactory &listener, const AsyncAcceptor::Handler &handler, size_t shards = 0);
+
+        /**
+         * TCP listener: each shard gets own socket with SO_REUSEPORT
+         */
+        static ListenerFactory tcp(const std::string &host, const std::string &service, int backlog = 1024);
+
+        /**
+         * UNIX listener: SO_REUSEPORT does not balance UNIX sockets, so shards share one socket
+         * (woken exclusively by EPOLLEXCLUSIVE)
+         */
+        static ListenerFactory unix_socket(const std::string &path, int backlog = 1024);
+
+        /**
+         * Pin shard threads to CPU (shard index modulo count of CPU). Should be set before `start`
+         */
+        inline void set_cpu_pinning(bool enable) {
+            pinning_ = enable;
+        }
+
+        /**
+         * Body limit of each shard acceptor. Should be set before `start`
+         */
+        inline void set_body_limit(size_t limit) {
+            body_limit_ = limit;
+        }
+
+        inline size_t shards() const {
+            return shards_;
+        }
+
+        /**
+         * Create listeners and start shard threads. Returns false if any listener can not be created
+         */
+        bool start();
+
+        /**
+         * Stop all shards and wait for threads. Thread-safe (should not be called from shard threads)
+         */
+        void stop();
+
+        /**
+         * Start and wait till `stop` is called from other thread
+         */
+        bool run();
+
+        ~ShardedServer();
+
+    private:
+        struct Shard {
+            Reactor reactor;
+            std::unique_ptr<AsyncAcceptor> acceptor;
+            std::thread thread;
+        };
+
+        ListenerFactory listener_;
+        AsyncAcceptor::Handler handler_;
+        size_t shards_;
+        bool pinning_ = false;
+        size_t body_limit_ = 1024 * 1024;
+        // Guards `running_` against concurrent start and stop
+        std::mutex lock_;
+        std::condition_variable stopped_;
+        std::vector<std::unique_ptr<Shard>> running_;
+        // Incremented when running shards are stopped
+        uint64_t generation_ = 0;
+
+        /**
+         * Create listeners and start shard threads. Lock is held by caller
+         */
+        bool launch();
+
+        /**
+         * Stop reactors and join shard threads. Lock is held by caller
+         */
+        void shutdown();
+
+        ShardedServer(const ShardedServer &) = delete;
+
+        ShardedServer &operator=(const ShardedServer &) = delete;
+    };
+}
+#endif //SCGI_SHARDED_H
@@ -0,0 +1,147 @@
+#include "stats.h"
+#include <algorithm>
+
+namespace scgi {
+
+    static const char *status_classes[] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+
+    // Bounds (in seconds) of Prometheus latency buckets
+    static const double latency_bounds[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+                                            0.25, 0.5, 1, 2.5, 5, 10};
+
+    Histogram::Histogram() : shards_(new Shard[shard_count]) {
+        for (size_t i = 0; i < shard_count; ++i) {
+            for (auto &count:shards_[i].counts) count.store(0, std::memory_order_relaxed);
+            shards_[i].sum.store(0, std::memory_order_relaxed);
+            shards_[i].max.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    size_t Histogram::shard_index() {
+        static std::atomic<size_t> threads{0};
+        static thread_local size_t index = threads.fetch_add(1, std::memory_order_relaxed) % shard_count;
+        return index;
+    }
+
+    uint64_t Histogram::upper_bound(size_t index) {
+        if (index < sub_buckets) return index;
+        size_t shift = index / sub_buckets - 1;
+        uint64_t sub = index % sub_buckets + sub_buckets;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    Histogram::Snapshot Histogram::snapshot() const {
+        Snapshot result;
+        result.counts.assign(bucket_count, 0);
+        for (size_t i = 0; i < shard_count; ++i) {
+            const Shard &shard = shards_[i];
+            for (size_t j = 0; j < bucket_count; ++j) {
+                uint64_t count = shard.counts[j].load(std::memory_order_relaxed);
+                result.counts[j] += count;
+                result.count += count;
+            }
+            result.sum += shard.sum.load(std::memory_order_relaxed);
+            result.max = std::max(result.max, shard.max.load(std::memory_order_relaxed));
+        }
+        return result;
+    }
+
+    uint64_t Histogram::Snapshot::percentile(double q) const {
+        if (count == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count) + 0.5);
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank) return std::min(upper_bound(i), max);
+        }
+        return max;
+    }
+
+    uint64_t Histogram::Snapshot::count_below(uint64_t value) const {
+        uint64_t result = 0;
+        for (size_t i = 0; i < counts.size() && upper_bound(i) <= value; ++i) result += counts[i];
+        return result;
+    }
+
+    EndpointStats::EndpointStats() {
+        for (auto &count:responses) count.store(0, std::memory_order_relaxed);
+    }
+
+    void EndpointStats::track(scgi::RequestPtr request) {
+        // Raw pointer keeps callback in place inside std::function (no allocation per request)
+        EndpointStats *self = this;
+        request->on_complete([self](const Request &done) {
+            self->record(done.status(), done.bytes_received(), done.bytes_sent(),
+                         std::chrono::steady_clock::now() - done.received());
+        });
+    }
+
+    void EndpointStats::record(int status, uint64_t in, uint64_t out, std::chrono::steady_clock::duration duration) {
+        requests.fetch_add(1, std::memory_order_relaxed);
+        bytes_in.fetch_add(in, std::memory_order_relaxed);
+        bytes_out.fetch_add(out, std::memory_order_relaxed);
+        size_t status_class = status >= 100 && status < 600 ? static_cast<size_t>(status / 100 - 1) : 4;
+        responses[status_class].fetch_add(1, std::memory_order_relaxed);
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        latency.record(micros > 0 ? static_cast<uint64_t>(micros) : 0);
+    }
+
+    std::string prometheus_label(const std::string &value) {
+        std::string result;
+        result.reserve(value.size());
+        for (char c:value) {
+            if (c == '\\' || c == '"') result.push_back('\\');
+            if (c == '\n') {
+                result += "\\n";
+                continue;
+            }
+            result.push_back(c);
+        }
+        return result;
+    }
+
+    /**
+     * Write one counter family
+     */
+    template<class Getter>
+    static void write_counter(std::ostream &out, const char *name, const char *help,
+                              const std::vector<LabeledStats> &endpoints, const Getter &getter) {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n";
+        for (auto &endpoint:endpoints)
+            out << name << "{" << endpoint.first << "} " << getter(*endpoint.second) << "\n";
+    }
+
+    void write_prometheus(std::ostream &out, const std::vector<LabeledStats> &endpoints) {
+        write_counter(out, "scgi_requests_total", "Finished requests", endpoints, [](const EndpointStats &stats) {
+            return stats.requests.load(std::memory_order_relaxed);
+        });
+        write_counter(out, "scgi_request_bytes_total", "Received bytes", endpoints, [](const EndpointStats &stats) {
+            return stats.bytes_in.load(std::memory_order_relaxed);
+        });
+        write_counter(out, "scgi_response_bytes_total", "Sent bytes", endpoints, [](const EndpointStats &stats) {
+            return stats.bytes_out.load(std::memory_order_relaxed);
+        });
+        out << "# HELP scgi_responses_total Responses by status class\n# TYPE scgi_responses_total counter\n";
+        for (auto &endpoint:endpoints) {
+            for (size_t i = 0; i < 5; ++i) {
+                out << "scgi_responses_total{" << endpoint.first << ",code=\"" << status_classes[i] << "\"} "
+                << endpoint.second->responses[i].load(std::memory_order_relaxed) << "\n";
+            }
+        }
+        out << "# HELP scgi_request_duration_seconds Time from receiving of request till end of response\n"
+                "# TYPE scgi_request_duration_seconds histogram\n";
+        for (auto &endpoint:endpoints) {
+            Histogram::Snapshot snapshot = endpoint.second->latency.snapshot();
+            for (double bound:latency_bounds) {
+                out << "scgi_request_duration_seconds_bucket{" << endpoint.first << ",le=\"" << bound << "\"} "
+                << snapshot.count_below(static_cast<uint64_t>(bound * 1e6)) << "\n";
+            }
+            out << "scgi_request_duration_seconds_bucket{" << endpoint.first << ",le=\"+Inf\"} " << snapshot.count
+            << "\n";
+            out << "scgi_request_duration_seconds_sum{" << endpoint.first << "} "
+            << static_cast<double>(snapshot.sum) / 1e6 << "\n";
+            out << "scgi_request_duration_seconds_count{" << endpoint.first << "} " << snapshot.count << "\n";
+        }
+    }
+}
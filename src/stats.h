@@ -0,0 +1,138 @@
+#ifndef SCGI_STATS_H
+#define SCGI_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "scgi.h"
+
+namespace scgi {
+
+    /**
+     * HDR-style histogram of non-negative integers (ex: latency in microseconds) with ~6% precision. Values
+     * are counted in log-linear buckets: 16 linear sub-buckets per power of two. Recording is lock-free:
+     * each thread writes relaxed counters of own shard, shards are merged by `snapshot`
+     */
+    class Histogram {
+    public:
+        static const size_t sub_bucket_bits = 4;
+        static const size_t sub_buckets = 1 << sub_bucket_bits;
+        // Values are tracked up to 2^40 (about 12 days in microseconds), bigger values are counted as maximal
+        static const size_t max_bits = 40;
+        static const size_t bucket_count = (max_bits - sub_bucket_bits + 1) * sub_buckets;
+        static const size_t shard_count = 8;
+
+        /**
+         * Merged counters
+         */
+        struct Snapshot {
+            std::vector<uint64_t> counts;
+            uint64_t count = 0, sum = 0, max = 0;
+
+            /**
+             * Value at quantile `q` (0..1), upper bound of bucket
+             */
+            uint64_t percentile(double q) const;
+
+            /**
+             * Count of values not bigger than `value` (by upper bounds of buckets)
+             */
+            uint64_t count_below(uint64_t value) const;
+
+            inline double mean() const {
+                return count > 0 ? static_cast<double>(sum) / static_cast<double>(count) : 0.0;
+            }
+        };
+
+        Histogram();
+
+        inline void record(uint64_t value) {
+            Shard &shard = shards_[shard_index()];
+            shard.counts[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+            shard.sum.fetch_add(value, std::memory_order_relaxed);
+            uint64_t max = shard.max.load(std::memory_order_relaxed);
+            while (value > max && !shard.max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+        }
+
+        Snapshot snapshot() const;
+
+        /**
+         * Bucket of value
+         */
+        static inline size_t bucket(uint64_t value) {
+            if (value < sub_buckets) return static_cast<size_t>(value);
+            size_t msb = 63 - static_cast<size_t>(__builtin_clzll(value));
+            if (msb >= max_bits) return bucket_count - 1;
+            size_t shift = msb - sub_bucket_bits;
+            return (shift + 1) * sub_buckets + static_cast<size_t>((value >> shift) - sub_buckets);
+        }
+
+        /**
+         * Maximal value of bucket
+         */
+        static uint64_t upper_bound(size_t index);
+
+    private:
+        struct Shard {
+            std::atomic<uint64_t> counts[bucket_count];
+            std::atomic<uint64_t> sum, max;
+            // Separates shards of different threads
+            char pad[64];
+        };
+
+        std::unique_ptr<Shard[]> shards_;
+
+        /**
+         * Shard of current thread
+         */
+        static size_t shard_index();
+
+        Histogram(const Histogram &) = delete;
+
+        Histogram &operator=(const Histogram &) = delete;
+    };
+
+    /**
+     * Counters of one endpoint (mount path or method). Updated when request is released, so latency covers
+     * time from receiving of request till end of response without network time of frontend
+     */
+    struct EndpointStats {
+        std::atomic<uint64_t> requests{0}, bytes_in{0}, bytes_out{0};
+        // Responses by status class: 1xx..5xx, unknown status counted as 5xx
+        std::atomic<uint64_t> responses[5];
+        // Latency in microseconds
+        Histogram latency;
+
+        EndpointStats();
+
+        /**
+         * Count `request` when it is released. Stats must outlive tracked requests
+         */
+        void track(scgi::RequestPtr request);
+
+        /**
+         * Count finished request
+         */
+        void record(int status, uint64_t bytes_in, uint64_t bytes_out, std::chrono::steady_clock::duration duration);
+    };
+
+    /**
+     * Stats with Prometheus labels rendered inside braces (ex: `path="/data",method="get"`)
+     */
+    typedef std::pair<std::string, const EndpointStats *> LabeledStats;
+
+    /**
+     * Write stats of endpoints in Prometheus text format (each metric family is one group)
+     */
+    void write_prometheus(std::ostream &out, const std::vector<LabeledStats> &endpoints);
+
+    /**
+     * Escape label value for Prometheus text format
+     */
+    std::string prometheus_label(const std::string &value);
+}
+#endif //SCGI_STATS_H
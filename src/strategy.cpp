@@ -0,0 +1,157 @@
+#include "strategy.h"
+#include <iostream>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+namespace scgi {
+    namespace service {
+
+        static size_t default_workers(size_t workers) {
+            if (workers > 0) return workers;
+            size_t hardware = std::thread::hardware_concurrency();
+            return hardware > 0 ? hardware : 1;
+        }
+
+        size_t Strategy::pending() const {
+            return 0;
+        }
+
+        Strategy::~Strategy() { }
+
+        void InlineStrategy::start(const Processor &processor) {
+            processor_ = processor;
+        }
+
+        void InlineStrategy::submit(scgi::RequestPtr request) {
+            if (processor_) processor_(request);
+        }
+
+        void InlineStrategy::stop() { }
+
+        WorkerPoolStrategy::WorkerPoolStrategy(size_t workers, size_t capacity)
+                : workers_(default_workers(workers)), capacity_(capacity) { }
+
+        void WorkerPoolStrategy::start(const Processor &processor) {
+            stop();
+            queue_.reset(new patterns::BoundedQueue<scgi::RequestPtr>(capacity_));
+            auto queue = queue_.get();
+            for (size_t i = 0; i < workers_; ++i) {
+                threads_.emplace_back([queue, processor]() {
+                    scgi::RequestPtr request;
+                    while (queue->pop(request)) {
+                        processor(request);
+                        // Release (flush and close) request before waiting next one
+                        request = nullptr;
+                    }
+                });
+            }
+        }
+
+        void WorkerPoolStrategy::submit(scgi::RequestPtr request) {
+            if (queue_) queue_->push(request);
+        }
+
+        void WorkerPoolStrategy::stop() {
+            if (queue_) queue_->kill();
+            for (auto &thread:threads_) thread.join();
+            threads_.clear();
+            queue_.reset();
+        }
+
+        size_t WorkerPoolStrategy::pending() const {
+            return queue_ ? queue_->size() : 0;
+        }
+
+        WorkerPoolStrategy::~WorkerPoolStrategy() {
+            stop();
+        }
+
+        LeaderFollowerStrategy::LeaderFollowerStrategy(const Source &source, size_t workers)
+                : source_(source), workers_(default_workers(workers)), stopped_(true) { }
+
+        LeaderFollowerStrategy::LeaderFollowerStrategy(std::shared_ptr<io::ConnectionManager> connection_manager,
+                                                       size_t workers)
+                : workers_(default_workers(workers)), stopped_(true) {
+            // Accept is called only by leader, so connection manager is never used concurrently
+            accept_ = [connection_manager]() { return connection_manager->next_descriptor(); };
+        }
+
+        LeaderFollowerStrategy::LeaderFollowerStrategy(int listen_fd, size_t workers)
+                : workers_(default_workers(workers)), stopped_(true), listen_fd_(listen_fd) {
+            wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            accept_ = [this]() { return accept_client(); };
+        }
+
+        void LeaderFollowerStrategy::start(const Processor &processor) {
+            stop();
+            processor_ = processor;
+            if (wake_fd_ >= 0) {
+                // Drop wake up of previous stop
+                uint64_t value;
+                while (read(wake_fd_, &value, sizeof(value)) > 0) { }
+            }
+            stopped_ = false;
+            for (size_t i = 0; i < workers_; ++i)
+                threads_.emplace_back(&LeaderFollowerStrategy::follow, this);
+        }
+
+        void LeaderFollowerStrategy::submit(scgi::RequestPtr request) {
+            if (processor_) processor_(request);
+        }
+
+        void LeaderFollowerStrategy::stop() {
+            stopped_ = true;
+            if (wake_fd_ >= 0) {
+                uint64_t value = 1;
+                if (write(wake_fd_, &value, sizeof(value)) < 0) { }
+            }
+            for (auto &thread:threads_) thread.join();
+            threads_.clear();
+        }
+
+        int LeaderFollowerStrategy::accept_client() {
+            pollfd wait[2] = {{listen_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+            while (!stopped_) {
+                if (poll(wait, 2, -1) < 0) {
+                    if (errno == EINTR) continue;
+                    return -1;
+                }
+                if (wait[1].revents != 0) return -1;
+                // Client socket is blocking: request is read by stream
+                int client = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client >= 0) return client;
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) return -1;
+            }
+            return -1;
+        }
+
+        void LeaderFollowerStrategy::follow() {
+            while (!stopped_) {
+                scgi::RequestPtr request;
+                int client = -1;
+                {
+                    // Become leader: only one thread waits on source
+                    std::unique_lock<std::mutex> lock(leader_);
+                    if (stopped_) break;
+                    try {
+                        if (accept_) client = accept_(); else request = source_();
+                    } catch (std::exception &ex) {
+                        std::cerr << "STD exception: " << ex.what() << std::endl;
+                    }
+                }
+                // Lock is released: next follower is promoted to leader while this thread reads request
+                if (client >= 0) request = std::make_shared<scgi::Request>(client, request_id_++);
+                if (request) processor_(request);
+            }
+        }
+
+        LeaderFollowerStrategy::~LeaderFollowerStrategy() {
+            stop();
+            if (listen_fd_ >= 0) close(listen_fd_);
+            if (wake_fd_ >= 0) close(wake_fd_);
+        }
+    }
+}
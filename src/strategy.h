@@ -0,0 +1,171 @@
+#ifndef SCGI_STRATEGY_H
+#define SCGI_STRATEGY_H
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include "scgi.h"
+#include "patterns.h"
+
+namespace scgi {
+    namespace service {
+
+        /**
+         * Strategy of processing accepted requests: where (in which thread) request handler is called.
+         * With any strategy except InlineStrategy service handlers must be thread-safe.
+         */
+        struct Strategy {
+
+            /**
+             * Functor which really processes request
+             */
+            typedef std::function<void(scgi::RequestPtr)> Processor;
+
+            typedef std::shared_ptr<Strategy> Ptr;
+
+            /**
+             * Start strategy (threads and etc) with specified processor
+             */
+            virtual void start(const Processor &processor) = 0;
+
+            /**
+             * Process request pushed by accept loop
+             */
+            virtual void submit(scgi::RequestPtr request) = 0;
+
+            /**
+             * Stop strategy and release all threads
+             */
+            virtual void stop() = 0;
+
+            /**
+             * Count of submitted requests waiting for processing
+             */
+            virtual size_t pending() const;
+
+            virtual ~Strategy();
+        };
+
+        /**
+         * Process request in caller thread (accept loop). Default behaviour
+         */
+        struct InlineStrategy : public Strategy {
+
+            virtual void start(const Processor &processor) override;
+
+            virtual void submit(scgi::RequestPtr request) override;
+
+            virtual void stop() override;
+
+        private:
+            Processor processor_;
+        };
+
+        /**
+         * Fixed pool of worker threads fed from accept loop by lock-free bounded queue. When queue is full,
+         * accept loop waits (backpressure)
+         */
+        struct WorkerPoolStrategy : public Strategy {
+
+            /**
+             * Create pool with `workers` threads (zero means count of hardware threads) and queue of
+             * `capacity` requests
+             */
+            explicit WorkerPoolStrategy(size_t workers = 0, size_t capacity = 4096);
+
+            virtual void start(const Processor &processor) override;
+
+            virtual void submit(scgi::RequestPtr request) override;
+
+            virtual void stop() override;
+
+            virtual size_t pending() const override;
+
+            inline size_t workers() const {
+                return workers_;
+            }
+
+            virtual ~WorkerPoolStrategy();
+
+        private:
+            size_t workers_, capacity_;
+            std::unique_ptr<patterns::BoundedQueue<scgi::RequestPtr>> queue_;
+            std::vector<std::thread> threads_;
+        };
+
+        /**
+         * Leader/follower pool: threads take turns to wait on shared request source (leader). When leader gets
+         * connection, it promotes next follower and reads, processes and flushes request itself, so there is no
+         * cross-thread handoff. Only accept is done by leader: slow client delays its own thread only.
+         */
+        struct LeaderFollowerStrategy : public Strategy {
+
+            /**
+             * Blocking source of requests. Called by leader, so it should not read from clients. Should return
+             * nullptr periodically (ex: on accept timeout), otherwise strategy can not be stopped
+             */
+            typedef std::function<scgi::RequestPtr()> Source;
+
+            /**
+             * Create pool with `workers` threads (zero means count of hardware threads) over `source`
+             */
+            LeaderFollowerStrategy(const Source &source, size_t workers = 0);
+
+            /**
+             * Create pool with `workers` threads over connection manager. Leader takes only descriptor, request
+             * headers are read after promotion of next leader. Use accept timeout in connection manager: `stop`
+             * waits till leader returns from accept
+             */
+            LeaderFollowerStrategy(std::shared_ptr<io::ConnectionManager> connection_manager, size_t workers = 0);
+
+            /**
+             * Create pool with `workers` threads accepting on listening socket `listen_fd` (see net::listen_tcp).
+             * Waiting leader is woken by `stop` at once. Strategy owns listening descriptor
+             */
+            LeaderFollowerStrategy(int listen_fd, size_t workers = 0);
+
+            virtual void start(const Processor &processor) override;
+
+            /**
+             * Requests pushed from outside are processed in caller thread
+             */
+            virtual void submit(scgi::RequestPtr request) override;
+
+            virtual void stop() override;
+
+            inline size_t workers() const {
+                return workers_;
+            }
+
+            virtual ~LeaderFollowerStrategy();
+
+        private:
+            Source source_;
+            // Source of client descriptors (-1 if there is no client yet)
+            std::function<int()> accept_;
+            size_t workers_;
+            Processor processor_;
+            std::mutex leader_;
+            std::atomic<bool> stopped_;
+            std::atomic<uint64_t> request_id_{0};
+            std::vector<std::thread> threads_;
+            int listen_fd_ = -1;
+            // Wakes leader waiting on `listen_fd_`
+            int wake_fd_ = -1;
+
+            /**
+             * Worker thread loop
+             */
+            void follow();
+
+            /**
+             * Wait for client on listening socket or for stop
+             */
+            int accept_client();
+        };
+    }
+}
+#endif //SCGI_STRATEGY_H
@@ -0,0 +1,187 @@
+#include "trace.h"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+namespace scgi {
+    namespace trace {
+
+        std::atomic<bool> is_enabled{false};
+
+        static const char *phase_names[] = {"accept", "read_headers", "read_body", "parse_json", "handler", "flush"};
+
+        /**
+         * Ring buffer of one thread. Lock is taken only by owner thread and by dump
+         */
+        struct Ring {
+            std::mutex lock;
+            std::vector<Record> records;
+            size_t next = 0;
+            bool full = false;
+            uint32_t thread = 0;
+        };
+
+        static std::atomic<uint64_t> sample_every{0};
+        static std::atomic<int64_t> threshold{0};
+        static std::atomic<size_t> buffer_size{1};
+        // Protects rings list and dump path
+        static std::mutex config_lock;
+        // Rings of all threads (rings of finished threads are kept for dump)
+        static std::vector<std::shared_ptr<Ring>> rings;
+        static std::atomic<bool> dump_requested{false};
+        static std::string dump_path;
+
+        const char *phase_name(Phase phase) {
+            return phase_names[static_cast<int>(phase)];
+        }
+
+        int64_t Record::duration() const {
+            int64_t first = 0, last = 0;
+            for (size_t i = 0; i < static_cast<size_t>(Phase::count); ++i) {
+                if (begin[i] != 0 && (first == 0 || begin[i] < first)) first = begin[i];
+                last = std::max(last, end[i]);
+            }
+            return first != 0 && last > first ? last - first : 0;
+        }
+
+        void Record::clear() {
+            id = 0;
+            std::memset(begin, 0, sizeof(begin));
+            std::memset(end, 0, sizeof(end));
+            path[0] = '\0';
+        }
+
+        void enable(const Config &config) {
+            sample_every = config.sample_every;
+            threshold = std::chrono::duration_cast<std::chrono::nanoseconds>(config.threshold).count();
+            buffer_size = std::max<size_t>(config.buffer_size, 1);
+            is_enabled = true;
+        }
+
+        void disable() {
+            is_enabled = false;
+        }
+
+        /**
+         * Ring of current thread
+         */
+        static Ring &thread_ring() {
+            static thread_local std::shared_ptr<Ring> ring;
+            if (!ring) {
+                ring = std::make_shared<Ring>();
+                std::lock_guard<std::mutex> lock(config_lock);
+                ring->thread = static_cast<uint32_t>(rings.size() + 1);
+                rings.push_back(ring);
+            }
+            return *ring;
+        }
+
+        void commit(const Record &record) {
+            if (dump_requested.exchange(false, std::memory_order_relaxed)) {
+                std::string path;
+                {
+                    std::lock_guard<std::mutex> lock(config_lock);
+                    path = dump_path;
+                }
+                dump(path);
+            }
+            uint64_t every = sample_every.load(std::memory_order_relaxed);
+            int64_t slow = threshold.load(std::memory_order_relaxed);
+            bool sampled = every > 0 && record.id % every == 0;
+            if (!sampled && (slow <= 0 || record.duration() < slow)) return;
+            size_t capacity = buffer_size.load(std::memory_order_relaxed);
+            Ring &ring = thread_ring();
+            std::lock_guard<std::mutex> lock(ring.lock);
+            if (ring.records.size() != capacity) {
+                ring.records.resize(capacity);
+                ring.next = 0;
+                ring.full = false;
+            }
+            ring.records[ring.next] = record;
+            if (++ring.next == ring.records.size()) {
+                ring.next = 0;
+                ring.full = true;
+            }
+        }
+
+        /**
+         * Write JSON string without special chars
+         */
+        static void write_string(std::ostream &out, const char *value) {
+            out << '"';
+            for (; *value != '\0'; ++value) {
+                char c = *value;
+                if (c == '"' || c == '\\') out << '\\' << c;
+                else if (static_cast<unsigned char>(c) >= 0x20) out << c;
+            }
+            out << '"';
+        }
+
+        static void write_event(std::ostream &out, bool &first, const char *name, const Record &record, uint32_t thread,
+                                int64_t begin, int64_t end) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"" << name << "\",\"cat\":\"scgi\",\"ph\":\"X\",\"ts\":"
+            << begin / 1000 << '.' << (begin % 1000) / 100 << ",\"dur\":" << (end - begin) / 1000 << '.'
+            << ((end - begin) % 1000) / 100 << ",\"pid\":" << getpid() << ",\"tid\":" << thread
+            << ",\"args\":{\"id\":" << record.id << ",\"path\":";
+            write_string(out, record.path);
+            out << "}}";
+            first = false;
+        }
+
+        void dump(std::ostream &out) {
+            std::vector<std::shared_ptr<Ring>> all;
+            {
+                std::lock_guard<std::mutex> lock(config_lock);
+                all = rings;
+            }
+            bool first = true;
+            out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            for (auto &ring:all) {
+                std::lock_guard<std::mutex> lock(ring->lock);
+                // Oldest records first
+                size_t count = ring->full ? ring->records.size() : ring->next;
+                size_t start = ring->full ? ring->next : 0;
+                for (size_t i = 0; i < count; ++i) {
+                    const Record &record = ring->records[(start + i) % ring->records.size()];
+                    int64_t first_time = 0, last_time = 0;
+                    for (size_t p = 0; p < static_cast<size_t>(Phase::count); ++p) {
+                        if (record.begin[p] == 0 || record.end[p] < record.begin[p]) continue;
+                        if (first_time == 0 || record.begin[p] < first_time) first_time = record.begin[p];
+                        last_time = std::max(last_time, record.end[p]);
+                    }
+                    if (first_time == 0) continue;
+                    write_event(out, first, "request", record, ring->thread, first_time, last_time);
+                    for (size_t p = 0; p < static_cast<size_t>(Phase::count); ++p) {
+                        if (record.begin[p] == 0 || record.end[p] < record.begin[p]) continue;
+                        write_event(out, first, phase_names[p], record, ring->thread, record.begin[p], record.end[p]);
+                    }
+                }
+            }
+            out << "\n]}\n";
+        }
+
+        bool dump(const std::string &path) {
+            std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc);
+            if (!file) return false;
+            dump(file);
+            return static_cast<bool>(file);
+        }
+
+        static void on_signal(int) {
+            dump_requested.store(true, std::memory_order_relaxed);
+        }
+
+        void dump_on_signal(int signo, const std::string &path) {
+            {
+                std::lock_guard<std::mutex> lock(config_lock);
+                dump_path = path;
+            }
+            std::signal(signo, on_signal);
+        }
+    }
+}
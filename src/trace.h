@@ -0,0 +1,122 @@
+#ifndef SCGI_TRACE_H
+#define SCGI_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace scgi {
+    namespace trace {
+
+        /**
+         * Phases of request life. Accept lasts till first byte of request, Flush - till response is sent
+         */
+        enum class Phase {
+            Accept,
+            ReadHeaders,
+            ReadBody,
+            ParseJson,
+            Handler,
+            Flush,
+            count
+        };
+
+        /**
+         * Phase name in traces
+         */
+        const char *phase_name(Phase phase);
+
+        /**
+         * Monotonic time in nanoseconds
+         */
+        inline int64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        /**
+         * Timestamps of request phases (zero - phase not passed)
+         */
+        struct Record {
+            static const size_t path_size = 48;
+
+            uint64_t id = 0;
+            int64_t begin[static_cast<int>(Phase::count)] = {};
+            int64_t end[static_cast<int>(Phase::count)] = {};
+            // Truncated request path
+            char path[path_size] = {};
+
+            inline void mark_begin(Phase phase, int64_t time = now()) {
+                begin[static_cast<int>(phase)] = time;
+            }
+
+            inline void mark_end(Phase phase, int64_t time = now()) {
+                end[static_cast<int>(phase)] = time;
+            }
+
+            /**
+             * Time from first to last timestamp
+             */
+            int64_t duration() const;
+
+            void clear();
+        };
+
+        struct Config {
+            /**
+             * Keep each N-th request (by id). Zero keeps only slow requests
+             */
+            uint64_t sample_every = 100;
+            /**
+             * Keep requests not faster than threshold. Zero disables
+             */
+            std::chrono::microseconds threshold{0};
+            /**
+             * Capacity of ring buffer of each thread: oldest records are overwritten
+             */
+            size_t buffer_size = 4096;
+        };
+
+        /**
+         * Start recording of phases with `config`. Tracing is disabled by default: disabled tracer costs one
+         * relaxed load per request
+         */
+        void enable(const Config &config = Config());
+
+        void disable();
+
+        // State of `enabled` (use `enable` and `disable` to change it)
+        extern std::atomic<bool> is_enabled;
+
+        /**
+         * Is tracing enabled
+         */
+        inline bool enabled() {
+            return is_enabled.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Keep record of finished request if it is sampled. Record is written to ring buffer of current thread
+         */
+        void commit(const Record &record);
+
+        /**
+         * Write kept records of all threads in Chrome `trace_event` JSON format (chrome://tracing, Perfetto)
+         */
+        void dump(std::ostream &out);
+
+        /**
+         * Write records to file. Returns false on error
+         */
+        bool dump(const std::string &path);
+
+        /**
+         * Dump records to `path` after signal `signo` (ex: SIGUSR1). File is written by thread which commits
+         * next record (signal handler only sets flag)
+         */
+        void dump_on_signal(int signo, const std::string &path);
+    }
+}
+#endif //SCGI_TRACE_H
@@ -0,0 +1,404 @@
+#include "uring.h"
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+
+namespace scgi {
+
+    // Group of provided receive buffers
+    static const uint16_t buffer_group = 0;
+
+    static const std::string payload_too_large = http::status_line((int) http::Status::PayloadTooLarge).str() + "\r\n";
+
+    static inline uint64_t pack(uint32_t operation, int fd) {
+        return (static_cast<uint64_t>(operation) << 32) | static_cast<uint32_t>(fd);
+    }
+
+    /**
+     * Raw io_uring: mapped submission and completion queues plus provided buffer ring
+     */
+    struct UringServer::Ring {
+        int fd = -1;
+        unsigned entries = 0, pending = 0;
+        unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr;
+        unsigned *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+        io_uring_sqe *sqes = nullptr;
+        io_uring_cqe *cqes = nullptr;
+        void *sq_ptr = MAP_FAILED, *cq_ptr = MAP_FAILED;
+        size_t sq_size = 0, cq_size = 0, sqes_size = 0;
+        // Provided buffers. Ring is accessed as plain array: in C++ flexible array of io_uring_buf_ring is not at
+        // offset 0. Tail of ring overlays `resv` field of first entry
+        io_uring_buf *buffers = nullptr;
+        size_t buffers_ring_size = 0;
+        unsigned buffers_count = 0, buffer_size = 0;
+        std::vector<char> memory;
+        bool valid = false;
+
+        bool setup(unsigned entries_, unsigned count, unsigned size) {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            fd = static_cast<int>(syscall(__NR_io_uring_setup, entries_, &params));
+            if (fd < 0) return false;
+            entries = params.sq_entries;
+            sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single) sq_size = cq_size = std::max(sq_size, cq_size);
+            sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                          IORING_OFF_SQ_RING);
+            if (sq_ptr == MAP_FAILED) return false;
+            cq_ptr = single ? sq_ptr : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                            fd, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED) return false;
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+            void *sqes_ptr = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                  IORING_OFF_SQES);
+            if (sqes_ptr == MAP_FAILED) return false;
+            sqes = static_cast<io_uring_sqe *>(sqes_ptr);
+            char *sq = static_cast<char *>(sq_ptr), *cq = static_cast<char *>(cq_ptr);
+            sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+            cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+            valid = setup_buffers(count, size);
+            return valid;
+        }
+
+        bool setup_buffers(unsigned count, unsigned size) {
+            if (count == 0 || (count & (count - 1)) != 0 || count > 32768) return false;
+            buffers_count = count;
+            buffer_size = size;
+            buffers_ring_size = count * sizeof(io_uring_buf);
+            void *ptr = mmap(nullptr, buffers_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+            if (ptr == MAP_FAILED) return false;
+            buffers = static_cast<io_uring_buf *>(ptr);
+            io_uring_buf_reg reg;
+            std::memset(&reg, 0, sizeof(reg));
+            reg.ring_addr = reinterpret_cast<uint64_t>(ptr);
+            reg.ring_entries = count;
+            reg.bgid = buffer_group;
+            if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) return false;
+            memory.resize(static_cast<size_t>(count) * size);
+            for (unsigned i = 0; i < count; ++i) recycle(static_cast<uint16_t>(i), false);
+            publish();
+            return true;
+        }
+
+        /**
+         * Return buffer to kernel
+         */
+        inline void recycle(uint16_t id, bool now = true) {
+            io_uring_buf &buffer = buffers[buffers_tail & (buffers_count - 1)];
+            buffer.addr = reinterpret_cast<uint64_t>(&memory[static_cast<size_t>(id) * buffer_size]);
+            buffer.len = buffer_size;
+            buffer.bid = id;
+            ++buffers_tail;
+            if (now) publish();
+        }
+
+        inline void publish() {
+            __atomic_store_n(&buffers[0].resv, buffers_tail, __ATOMIC_RELEASE);
+        }
+
+        inline const char *buffer(uint16_t id) const {
+            return &memory[static_cast<size_t>(id) * buffer_size];
+        }
+
+        /**
+         * Get free submission entry. Submits pending entries if queue is full
+         */
+        io_uring_sqe *next() {
+            unsigned tail = *sq_tail;
+            while (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= entries) {
+                if (submit(0) < 0 && errno != EINTR && errno != EBUSY) return nullptr;
+            }
+            unsigned index = tail & *sq_mask;
+            io_uring_sqe *sqe = &sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sq_array[index] = index;
+            __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+            ++pending;
+            return sqe;
+        }
+
+        /**
+         * Submit pending entries and wait at least `wait` completions
+         */
+        int submit(unsigned wait) {
+            int result = static_cast<int>(syscall(__NR_io_uring_enter, fd, pending, wait,
+                                                  wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+            if (result >= 0) pending -= std::min(pending, static_cast<unsigned>(result));
+            return result;
+        }
+
+        ~Ring() {
+            if (buffers != nullptr) munmap(buffers, buffers_ring_size);
+            if (sqes != nullptr) munmap(sqes, sqes_size);
+            if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+            if (sq_ptr != MAP_FAILED) munmap(sq_ptr, sq_size);
+            if (fd >= 0) close(fd);
+        }
+
+    private:
+        uint16_t buffers_tail = 0;
+    };
+
+    /**
+     * Responses completed by handlers (possibly in other threads). Outlives server: if server is already
+     * destroyed, response is written synchronously
+     */
+    struct UringServer::Outbox {
+        std::mutex mutex;
+        std::vector<std::pair<int, std::string>> responses;
+        int event_fd = -1;
+        bool closed = false;
+        std::thread::id loop_thread;
+
+        void push(int fd, std::string &&data) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (closed) {
+                lock.unlock();
+                const char *ptr = data.data();
+                size_t left = data.size();
+                while (left > 0) {
+                    ssize_t sent = send(fd, ptr, left, MSG_NOSIGNAL);
+                    if (sent < 0 && errno == EINTR) continue;
+                    if (sent <= 0) break;
+                    ptr += sent;
+                    left -= static_cast<size_t>(sent);
+                }
+                ::close(fd);
+                return;
+            }
+            responses.emplace_back(fd, std::move(data));
+            // Loop thread flushes outbox after each batch of completions by itself
+            if (std::this_thread::get_id() == loop_thread) return;
+            uint64_t value = 1;
+            if (write(event_fd, &value, sizeof(value)) < 0) return;
+        }
+    };
+
+    UringServer::UringServer(int listen_fd, const Handler &handler, unsigned entries, unsigned buffers,
+                             unsigned buffer_size)
+            : ring_(new Ring()), outbox_(std::make_shared<Outbox>()), listen_fd_(listen_fd), handler_(handler),
+              stopped_(false) {
+        outbox_->event_fd = eventfd(0, EFD_CLOEXEC);
+        if (outbox_->event_fd < 0 || !ring_->setup(entries, buffers, buffer_size)) return;
+        submit_accept();
+        submit_wake();
+    }
+
+    bool UringServer::is_valid() const {
+        return ring_->valid && outbox_->event_fd >= 0;
+    }
+
+    void UringServer::submit_accept() {
+        io_uring_sqe *sqe = ring_->next();
+        if (sqe == nullptr) return;
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd_;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = pack(static_cast<uint32_t>(Operation::Accept), listen_fd_);
+    }
+
+    void UringServer::submit_receive(int fd) {
+        io_uring_sqe *sqe = ring_->next();
+        if (sqe == nullptr) return;
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = buffer_group;
+        sqe->user_data = pack(static_cast<uint32_t>(Operation::Receive), fd);
+    }
+
+    void UringServer::submit_wake() {
+        io_uring_sqe *sqe = ring_->next();
+        if (sqe == nullptr) return;
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = outbox_->event_fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&wake_value_);
+        sqe->len = sizeof(wake_value_);
+        sqe->user_data = pack(static_cast<uint32_t>(Operation::Wake), outbox_->event_fd);
+    }
+
+    void UringServer::submit_response(int fd, std::string &&data) {
+        if (data.empty()) {
+            // Nothing to send: only close
+            io_uring_sqe *sqe = ring_->next();
+            if (sqe == nullptr) return;
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = fd;
+            sqe->user_data = pack(static_cast<uint32_t>(Operation::Close), fd);
+            return;
+        }
+        std::string &buffer = sending_[fd];
+        buffer = std::move(data);
+        io_uring_sqe *sqe = ring_->next();
+        if (sqe == nullptr) return;
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer.data());
+        sqe->len = static_cast<uint32_t>(buffer.size());
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = pack(static_cast<uint32_t>(Operation::Send), fd);
+        sqe = ring_->next();
+        if (sqe == nullptr) return;
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fd;
+        sqe->user_data = pack(static_cast<uint32_t>(Operation::Close), fd);
+    }
+
+    void UringServer::on_accept(int res, uint32_t flags) {
+        if (res >= 0) {
+            connections_[res] = parsers_.take(body_limit_);
+            connections_[res]->mark_accepted();
+            submit_receive(res);
+        }
+        // Multishot accept is terminated (ex: on error): arm it again
+        if (!(flags & IORING_CQE_F_MORE) && !stopped_) submit_accept();
+    }
+
+    void UringServer::on_receive(int fd, int res, uint32_t flags) {
+        auto iter = connections_.find(fd);
+        if (res == -ENOBUFS) {
+            // All buffers are busy: try again
+            if (iter != connections_.end()) submit_receive(fd);
+            return;
+        }
+        if (flags & IORING_CQE_F_BUFFER) {
+            uint16_t id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+            if (res > 0 && iter != connections_.end())
+                (*iter).second->feed(ring_->buffer(id), static_cast<size_t>(res));
+            ring_->recycle(id);
+        }
+        if (iter == connections_.end()) return;
+        RequestParser &parser = *(*iter).second;
+        if (res <= 0 || parser.is_failed()) {
+            drop(fd);
+            return;
+        }
+        if (!parser.is_done()) {
+            submit_receive(fd);
+            return;
+        }
+        if (!parser.is_body_buffered()) {
+            release(iter);
+            submit_response(fd, std::string(payload_too_large));
+            return;
+        }
+        std::weak_ptr<Outbox> outbox = outbox_;
+        auto request = pool_->acquire(request_id_++, parser, [fd, outbox](std::string &&data) {
+            auto box = outbox.lock();
+            if (box) {
+                box->push(fd, std::move(data));
+            } else {
+                ::close(fd);
+            }
+        });
+        release(iter);
+        if (request->is_valid() && handler_) handler_(request);
+    }
+
+    void UringServer::flush_outbox() {
+        std::vector<std::pair<int, std::string>> responses;
+        {
+            std::unique_lock<std::mutex> lock(outbox_->mutex);
+            responses.swap(outbox_->responses);
+        }
+        for (auto &response:responses) submit_response(response.first, std::move(response.second));
+    }
+
+    void UringServer::release(std::unordered_map<int, std::unique_ptr<RequestParser>>::iterator iter) {
+        parsers_.give(std::move((*iter).second));
+        connections_.erase(iter);
+    }
+
+    void UringServer::drop(int fd) {
+        auto iter = connections_.find(fd);
+        if (iter != connections_.end()) release(iter);
+        io_uring_sqe *sqe = ring_->next();
+        if (sqe == nullptr) {
+            ::close(fd);
+            return;
+        }
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fd;
+        sqe->user_data = pack(static_cast<uint32_t>(Operation::Close), fd);
+    }
+
+    void UringServer::run() {
+        if (!is_valid()) return;
+        stopped_ = false;
+        {
+            std::unique_lock<std::mutex> lock(outbox_->mutex);
+            outbox_->loop_thread = std::this_thread::get_id();
+        }
+        while (!stopped_) {
+            if (ring_->submit(1) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) break;
+            unsigned head = *ring_->cq_head;
+            unsigned tail = __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                io_uring_cqe &cqe = ring_->cqes[head & *ring_->cq_mask];
+                auto operation = static_cast<Operation>(cqe.user_data >> 32);
+                int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+                int res = cqe.res;
+                uint32_t flags = cqe.flags;
+                // Release entry before handling: handlers may submit new entries
+                __atomic_store_n(ring_->cq_head, head + 1, __ATOMIC_RELEASE);
+                switch (operation) {
+                    case Operation::Accept:
+                        on_accept(res, flags);
+                        break;
+                    case Operation::Receive:
+                        on_receive(fd, res, flags);
+                        break;
+                    case Operation::Send:
+                        sending_.erase(fd);
+                        break;
+                    case Operation::Close:
+                        // Close is canceled if linked send failed
+                        if (res == -ECANCELED) ::close(fd);
+                        break;
+                    case Operation::Wake:
+                        if (!stopped_) submit_wake();
+                        break;
+                }
+            }
+            flush_outbox();
+        }
+    }
+
+    void UringServer::stop() {
+        stopped_ = true;
+        uint64_t value = 1;
+        if (outbox_->event_fd >= 0 && write(outbox_->event_fd, &value, sizeof(value)) < 0) return;
+    }
+
+    UringServer::~UringServer() {
+        {
+            std::unique_lock<std::mutex> lock(outbox_->mutex);
+            outbox_->closed = true;
+        }
+        // Closing ring cancels all in-flight operations
+        ring_.reset();
+        for (auto &response:outbox_->responses) ::close(response.first);
+        for (auto &kv:sending_) ::close(kv.first);
+        for (auto &kv:connections_) ::close(kv.first);
+        if (outbox_->event_fd >= 0) close(outbox_->event_fd);
+        close(listen_fd_);
+    }
+}
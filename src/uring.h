@@ -0,0 +1,119 @@
+#ifndef SCGI_URING_H
+#define SCGI_URING_H
+
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <string>
+#include "scgi.h"
+#include "pool.h"
+
+namespace scgi {
+
+    /**
+     * Server loop based on io_uring (Linux 6.0+). Alternative to epoll based acceptors:
+     * - connections are accepted by one multishot accept;
+     * - requests are received into provided buffer ring (no per-connection read buffers);
+     * - response is sent with linked send+close, so one submission finishes request.
+     * Requests are completely buffered (headers and body) before handler call and response is collected
+     * in memory (see ResponseSink), so handlers work unchanged and may finish request in any thread.
+     * Server must outlive requests which it dispatched.
+     */
+    class UringServer {
+    public:
+        typedef std::function<void(RequestPtr)> Handler;
+
+        /**
+         * Prepare ring with `entries` submission entries and `buffers` receive buffers (power of two) of
+         * `buffer_size` bytes over listening socket `listen_fd`. Server owns listening descriptor
+         */
+        UringServer(int listen_fd, const Handler &handler, unsigned entries = 1024, unsigned buffers = 256,
+                    unsigned buffer_size = 16384);
+
+        /**
+         * Ring is set up and buffers are registered
+         */
+        bool is_valid() const;
+
+        /**
+         * Requests with bodies bigger then `limit` are rejected (413)
+         */
+        inline void set_body_limit(size_t limit) {
+            body_limit_ = limit;
+        }
+
+        /**
+         * Process completions till `stop`
+         */
+        void run();
+
+        /**
+         * Break `run` loop. Thread-safe
+         */
+        void stop();
+
+        /**
+         * Close ring and all pending connections
+         */
+        ~UringServer();
+
+    private:
+        struct Ring;
+        struct Outbox;
+
+        enum class Operation : uint32_t {
+            Accept = 1,
+            Receive,
+            Send,
+            Close,
+            Wake
+        };
+
+        std::unique_ptr<Ring> ring_;
+        std::shared_ptr<Outbox> outbox_;
+        int listen_fd_;
+        Handler handler_;
+        size_t body_limit_ = 1024 * 1024;
+        uint64_t request_id_ = 0;
+        uint64_t wake_value_ = 0;
+        std::atomic<bool> stopped_;
+        std::unordered_map<int, std::unique_ptr<RequestParser>> connections_;
+        std::unordered_map<int, std::string> sending_;
+        RequestPool::Ptr pool_ = RequestPool::create();
+        ParserCache parsers_;
+
+        void submit_accept();
+
+        void submit_receive(int fd);
+
+        void submit_wake();
+
+        /**
+         * Send response and close connection by linked submissions
+         */
+        void submit_response(int fd, std::string &&data);
+
+        void on_accept(int res, uint32_t flags);
+
+        /**
+         * Forget connection and keep its parser for next connections
+         */
+        void release(std::unordered_map<int, std::unique_ptr<RequestParser>>::iterator iter);
+
+        void on_receive(int fd, int res, uint32_t flags);
+
+        /**
+         * Send responses completed by handlers
+         */
+        void flush_outbox();
+
+        void drop(int fd);
+
+        UringServer(const UringServer &) = delete;
+
+        UringServer &operator=(const UringServer &) = delete;
+    };
+}
+#endif //SCGI_URING_H
@@ -0,0 +1,137 @@
+/**
+ * Sample service for load tests (see scgi-load): README `DataKeeper` served by `AsyncAcceptor` and
+ * `ServiceDispatcher` in one process, so changes of threads, allocator or I/O can be compared on one machine.
+ *
+ *   scgi-sample -a unix:/tmp/scgi-sample.sock -w 4
+ *   scgi-load -a unix:/tmp/scgi-sample.sock -p /data -b '{"method":"get","key":"key1"}'
+ */
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <getopt.h>
+#include "acceptor.h"
+#include "net.h"
+#include "service.h"
+
+/**
+ * In-memory key-value storage. Unlike README example it is guarded by mutex: requests may be processed by
+ * worker threads
+ */
+class DataKeeper : public scgi::service::ServiceHandler {
+public:
+    DataKeeper() : scgi::service::ServiceHandler() {
+        register_method("update")
+                .set_param("key", Json::stringValue)
+                .set_param("value", Json::stringValue)
+                .set_return_type(Json::nullValue)
+                .set_processor(&DataKeeper::update, this);
+        register_method("get")
+                .set_param("key", Json::stringValue)
+                .set_return_type(Json::stringValue)
+                .set_processor(&DataKeeper::get, this);
+        register_method("get_keys")
+                .set_return_type(Json::arrayValue)
+                .set_processor(&DataKeeper::get_keys, this);
+        register_method("size", &DataKeeper::size, {"prefix"});
+    }
+
+    void put(const std::string &key, const std::string &value) {
+        std::lock_guard<std::mutex> lock(lock_);
+        content_[key] = value;
+    }
+
+protected:
+
+    bool update(scgi::RequestPtr request, const Json::Value &query) {
+        put(query["key"].asString(), query["value"].asString());
+        request->begin_response();
+        return true;
+    }
+
+    bool get(scgi::RequestPtr request, const Json::Value &query) {
+        std::string value;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            auto key_iter = content_.find(query["key"].asString());
+            if (key_iter == content_.end()) return scgi::service::send_error(request, "Key not found");
+            value = (*key_iter).second;
+        }
+        scgi::service::send(request, Json::Value(value));
+        return true;
+    }
+
+    bool get_keys(scgi::RequestPtr request, const Json::Value &) {
+        Json::Value response(Json::arrayValue);
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            for (auto &kv:content_) response.append(kv.first);
+        }
+        scgi::service::send(request, response);
+        return true;
+    }
+
+    size_t size(const std::string &prefix) {
+        std::lock_guard<std::mutex> lock(lock_);
+        size_t count = 0;
+        for (auto &kv:content_) count += kv.first.compare(0, prefix.size(), prefix) == 0;
+        return count;
+    }
+
+    std::mutex lock_;
+    std::unordered_map<std::string, std::string> content_;
+};
+
+static scgi::Reactor *running_reactor = nullptr;
+
+static void stop_reactor(int) {
+    if (running_reactor != nullptr) running_reactor->stop();
+}
+
+int main(int argc, char **argv) {
+    std::string address = "unix:/tmp/scgi-sample.sock";
+    size_t workers = 0, keys = 1000;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:w:k:h")) != -1) {
+        switch (opt) {
+            case 'a': address = optarg; break;
+            case 'w': workers = std::strtoul(optarg, nullptr, 10); break;
+            case 'k': keys = std::strtoul(optarg, nullptr, 10); break;
+            default:
+                std::fprintf(stderr, "Usage: %s [options]\n"
+                        "  -a ADDRESS   listen address: unix:/path or host:port (default unix:/tmp/scgi-sample.sock)\n"
+                        "  -w N         worker threads (default 0 - process in accept loop)\n"
+                        "  -k N         keys `key0`..`keyN` filled at start (default 1000)\n", argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    int listen_fd;
+    if (address.compare(0, 5, "unix:") == 0) {
+        listen_fd = scgi::net::listen_unix(address.substr(5));
+    } else {
+        size_t colon = address.rfind(':');
+        listen_fd = colon == std::string::npos ? -1 : scgi::net::listen_tcp(address.substr(0, colon),
+                                                                             address.substr(colon + 1));
+    }
+    if (listen_fd < 0) {
+        std::fprintf(stderr, "can't listen %s\n", address.c_str());
+        return 1;
+    }
+
+    scgi::Reactor reactor;
+    scgi::service::ServiceDispatcher dispatcher;
+    auto keeper = dispatcher.add_handler<DataKeeper>("/data");
+    for (size_t i = 0; i < keys; ++i) keeper->put("key" + std::to_string(i), "value" + std::to_string(i));
+    if (workers > 0) dispatcher.set_strategy(std::make_shared<scgi::service::WorkerPoolStrategy>(workers));
+    scgi::AsyncAcceptor acceptor(reactor, listen_fd,
+                                 [&dispatcher](scgi::RequestPtr request) { dispatcher.dispatch(request); });
+    running_reactor = &reactor;
+    std::signal(SIGINT, stop_reactor);
+    std::signal(SIGTERM, stop_reactor);
+    std::signal(SIGPIPE, SIG_IGN);
+    std::printf("listening %s, %zu workers\n", address.c_str(), workers);
+    reactor.run();
+    return 0;
+}
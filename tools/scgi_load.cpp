@@ -0,0 +1,418 @@
+/**
+ * SCGI load generator. Sends requests directly to SCGI service over UNIX or TCP socket (one request per
+ * connection, as frontend does) and reports throughput and latency percentiles.
+ *
+ * Closed loop (default): each of `-c` clients sends next request when previous is answered.
+ * Open loop (`-r rate`): requests are issued at fixed rate; latency is counted from scheduled time, so queueing
+ * behind slow responses is not hidden (coordinated omission).
+ */
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "net.h"
+#include "reactor.h"
+#include "stats.h"
+
+using namespace scgi;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+    std::string address = "unix:/tmp/scgi-sample.sock";
+    size_t concurrency = 16, threads = 1;
+    double duration = 10, rate = 0;
+    uint64_t requests = 0;
+    // Template built from command line
+    std::string method, path = "/", query, body, content_type = "application/json";
+    std::vector<std::string> headers;
+    // File of templates: `METHOD PATH[?QUERY] [BODY]` per line
+    std::string templates_file;
+    bool distribution = false;
+};
+
+/**
+ * Counters of all workers
+ */
+struct Totals {
+    // Latency in microseconds
+    Histogram latency;
+    std::atomic<uint64_t> responses[5], errors{0}, bytes_in{0}, bytes_out{0};
+    // Issued requests (limited by `-n`)
+    std::atomic<uint64_t> issued{0};
+
+    Totals() {
+        for (auto &counter:responses) counter.store(0);
+    }
+};
+
+/**
+ * SCGI netstring with CGI-like headers and body
+ */
+static std::string make_request(const Options &options, const std::string &method, const std::string &path,
+                                const std::string &query, const std::string &body) {
+    std::vector<std::pair<std::string, std::string>> pairs = {
+            {"CONTENT_LENGTH",  std::to_string(body.size())},
+            {"SCGI",            "1"},
+            {"REQUEST_METHOD",  method.empty() ? (body.empty() ? "GET" : "POST") : method},
+            {"REQUEST_URI",     query.empty() ? path : path + "?" + query},
+            {"PATH_INFO",       path},
+            {"QUERY_STRING",    query},
+            {"SERVER_PROTOCOL", "HTTP/1.1"},
+            {"REMOTE_ADDR",     "127.0.0.1"},
+    };
+    if (!body.empty()) pairs.emplace_back("CONTENT_TYPE", options.content_type);
+    for (auto &header:options.headers) {
+        size_t colon = header.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = "HTTP_";
+        for (size_t i = 0; i < colon; ++i) name.push_back(header[i] == '-' ? '_' : (char) std::toupper(header[i]));
+        size_t value = header.find_first_not_of(' ', colon + 1);
+        pairs.emplace_back(name, value == std::string::npos ? "" : header.substr(value));
+    }
+    std::string block;
+    for (auto &pair:pairs) {
+        block += pair.first;
+        block.push_back('\0');
+        block += pair.second;
+        block.push_back('\0');
+    }
+    return std::to_string(block.size()) + ":" + block + "," + body;
+}
+
+/**
+ * Requests of templates file or of command line
+ */
+static bool load_templates(const Options &options, std::vector<std::string> &templates) {
+    if (options.templates_file.empty()) {
+        templates.push_back(make_request(options, options.method, options.path, options.query, options.body));
+        return true;
+    }
+    std::ifstream file(options.templates_file);
+    if (!file) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream in(line);
+        std::string method, uri, body;
+        in >> method >> uri;
+        std::getline(in >> std::ws, body);
+        size_t question = uri.find('?');
+        templates.push_back(make_request(options, method, uri.substr(0, question),
+                                         question == std::string::npos ? "" : uri.substr(question + 1), body));
+    }
+    return !templates.empty();
+}
+
+/**
+ * Status of CGI-like response: `Status: 200 OK` or `HTTP/1.1 200 OK`, 200 if status line is missed.
+ * Returns 0 for empty response
+ */
+static int parse_status(const std::string &head) {
+    if (head.empty()) return 0;
+    const char *value = nullptr;
+    if (head.compare(0, 7, "Status:") == 0) value = head.c_str() + 7;
+    else if (head.compare(0, 5, "HTTP/") == 0 && head.find(' ') != std::string::npos)
+        value = head.c_str() + head.find(' ');
+    else return 200;
+    return std::atoi(value);
+}
+
+/**
+ * Event loop with part of clients
+ */
+class Worker {
+public:
+    Worker(const Options &options, const net::Address &address, const std::vector<std::string> &templates,
+           Totals &totals, size_t clients, double rate, size_t offset)
+            : options_(options), address_(address), templates_(templates), totals_(totals), clients_(clients),
+              template_index_(offset), buffer_(64 * 1024) {
+        for (size_t i = 0; i < clients_.size(); ++i) free_.push_back(i);
+        if (rate > 0) interval_ = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / rate));
+    }
+
+    void run(Clock::time_point start, Clock::time_point deadline) {
+        deadline_ = deadline;
+        next_ = start;
+        while (true) {
+            Clock::time_point now = Clock::now();
+            if (now >= deadline_ || (options_.requests > 0 && totals_.issued.load() >= options_.requests))
+                issuing_ = false;
+            issue(now);
+            if (!issuing_ && waiting_.empty() && free_.size() == clients_.size()) break;
+            // Responses are waited for some time after deadline
+            if (!issuing_ && now >= deadline_ + std::chrono::seconds(10)) {
+                totals_.errors += clients_.size() - free_.size() + waiting_.size();
+                break;
+            }
+            int timeout = 100;
+            if (issuing_ && interval_.count() > 0) {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_ - Clock::now()).count();
+                timeout = wait < 0 ? 0 : (wait > 100 ? 100 : static_cast<int>(wait));
+            }
+            reactor_.run_once(timeout);
+        }
+        for (auto &client:clients_) {
+            if (client.fd < 0) continue;
+            reactor_.remove(client.fd);
+            ::close(client.fd);
+        }
+    }
+
+private:
+    struct Client {
+        int fd = -1;
+        size_t written = 0;
+        const std::string *request = nullptr;
+        // Beginning of response for status
+        std::string head;
+        Clock::time_point intended;
+    };
+
+    const Options &options_;
+    const net::Address &address_;
+    const std::vector<std::string> &templates_;
+    Totals &totals_;
+    std::vector<Client> clients_;
+    std::vector<size_t> free_;
+    // Scheduled times of open loop requests which wait for free client
+    std::deque<Clock::time_point> waiting_;
+    Clock::duration interval_ = Clock::duration::zero();
+    Clock::time_point next_, deadline_;
+    size_t template_index_;
+    bool issuing_ = true;
+    std::vector<char> buffer_;
+    Reactor reactor_;
+
+    /**
+     * Start requests: all free clients in closed loop or all scheduled till `now` in open loop. Already scheduled
+     * requests are started after deadline too
+     */
+    void issue(Clock::time_point now) {
+        if (interval_.count() == 0) {
+            for (size_t count = free_.size(); issuing_ && count > 0 && acquire(); --count) start(now);
+            return;
+        }
+        while (issuing_ && next_ <= now && acquire()) {
+            waiting_.push_back(next_);
+            next_ += interval_;
+        }
+        for (size_t count = free_.size(); count > 0 && !waiting_.empty(); --count) {
+            start(waiting_.front());
+            waiting_.pop_front();
+        }
+    }
+
+    /**
+     * Reserve one request of `-n` limit
+     */
+    inline bool acquire() {
+        if (options_.requests == 0) return true;
+        if (totals_.issued.fetch_add(1) < options_.requests) return true;
+        issuing_ = false;
+        return false;
+    }
+
+    /**
+     * Connect free client. Failed connection is counted as error and client stays free
+     */
+    void start(Clock::time_point intended) {
+        size_t index = free_.back();
+        free_.pop_back();
+        Client &client = clients_[index];
+        client.written = 0;
+        client.head.clear();
+        client.intended = intended;
+        client.request = &templates_[template_index_++ % templates_.size()];
+        client.fd = net::connect(address_);
+        if (client.fd >= 0 && reactor_.add(client.fd, EPOLLOUT, [this, index](uint32_t events) {
+            on_event(index, events);
+        })) {
+            return;
+        }
+        if (client.fd >= 0) ::close(client.fd);
+        client.fd = -1;
+        totals_.errors++;
+        free_.push_back(index);
+    }
+
+    void on_event(size_t index, uint32_t events) {
+        Client &client = clients_[index];
+        const std::string &request = *client.request;
+        if (client.written < request.size()) {
+            if (events & EPOLLERR) return finish(index, false);
+            while (client.written < request.size()) {
+                ssize_t sent = ::send(client.fd, request.data() + client.written, request.size() - client.written,
+                                      MSG_NOSIGNAL);
+                if (sent < 0) {
+                    if (errno == EAGAIN || errno == EINTR) return;
+                    return finish(index, false);
+                }
+                client.written += static_cast<size_t>(sent);
+            }
+            totals_.bytes_out += request.size();
+            if (!reactor_.modify(client.fd, EPOLLIN | EPOLLRDHUP)) finish(index, false);
+            return;
+        }
+        while (true) {
+            ssize_t reads = ::read(client.fd, buffer_.data(), buffer_.size());
+            if (reads > 0) {
+                totals_.bytes_in += static_cast<uint64_t>(reads);
+                if (client.head.size() < 64)
+                    client.head.append(buffer_.data(), std::min<size_t>(64 - client.head.size(), reads));
+                continue;
+            }
+            if (reads < 0 && (errno == EAGAIN || errno == EINTR)) return;
+            return finish(index, reads == 0);
+        }
+    }
+
+    /**
+     * Count finished request and start next one
+     */
+    void finish(size_t index, bool success) {
+        Client &client = clients_[index];
+        if (client.fd >= 0) {
+            reactor_.remove(client.fd);
+            ::close(client.fd);
+            client.fd = -1;
+        }
+        int status = success ? parse_status(client.head) : 0;
+        if (status >= 100 && status < 600) {
+            totals_.responses[status / 100 - 1]++;
+            totals_.latency.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - client.intended).count()));
+        } else {
+            totals_.errors++;
+        }
+        free_.push_back(index);
+        issue(Clock::now());
+    }
+};
+
+static void usage(const char *name) {
+    std::fprintf(stderr, "Usage: %s [options]\n"
+            "  -a ADDRESS   service address: unix:/path or host:port (default unix:/tmp/scgi-sample.sock)\n"
+            "  -c N         concurrent connections (default 16)\n"
+            "  -t N         threads (default 1)\n"
+            "  -d SECONDS   duration (default 10)\n"
+            "  -n N         stop after N requests\n"
+            "  -r RATE      open loop with RATE requests per second (default closed loop)\n"
+            "  -m METHOD    request method (default GET, POST with body)\n"
+            "  -p PATH      request path (default /)\n"
+            "  -q QUERY     query string\n"
+            "  -b BODY      request body (JSON)\n"
+            "  -B FILE      request body from file\n"
+            "  -T TYPE      content type of body (default application/json)\n"
+            "  -H HEADER    extra header 'Name: value' (repeatable)\n"
+            "  -f FILE      templates, one per line: METHOD PATH[?QUERY] [BODY]\n"
+            "  -D           print latency distribution\n", name);
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:c:t:d:n:r:m:p:q:b:B:T:H:f:Dh")) != -1) {
+        switch (opt) {
+            case 'a': options.address = optarg; break;
+            case 'c': options.concurrency = std::strtoul(optarg, nullptr, 10); break;
+            case 't': options.threads = std::strtoul(optarg, nullptr, 10); break;
+            case 'd': options.duration = std::atof(optarg); break;
+            case 'n': options.requests = std::strtoull(optarg, nullptr, 10); break;
+            case 'r': options.rate = std::atof(optarg); break;
+            case 'm': options.method = optarg; break;
+            case 'p': options.path = optarg; break;
+            case 'q': options.query = optarg; break;
+            case 'b': options.body = optarg; break;
+            case 'B': {
+                std::ifstream file(optarg, std::ios::binary);
+                if (!file) {
+                    std::fprintf(stderr, "can't read %s\n", optarg);
+                    return 1;
+                }
+                options.body.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                break;
+            }
+            case 'T': options.content_type = optarg; break;
+            case 'H': options.headers.push_back(optarg); break;
+            case 'f': options.templates_file = optarg; break;
+            case 'D': options.distribution = true; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (options.threads == 0 || options.concurrency < options.threads) {
+        std::fprintf(stderr, "concurrency must be not less than threads\n");
+        return 1;
+    }
+    net::Address address;
+    if (!net::resolve(options.address, address)) {
+        std::fprintf(stderr, "bad address %s\n", options.address.c_str());
+        return 1;
+    }
+    std::vector<std::string> templates;
+    if (!load_templates(options, templates)) {
+        std::fprintf(stderr, "no request templates\n");
+        return 1;
+    }
+
+    Totals totals;
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t i = 0; i < options.threads; ++i) {
+        size_t clients = options.concurrency / options.threads + (i < options.concurrency % options.threads);
+        workers.emplace_back(new Worker(options, address, templates, totals, clients,
+                                        options.rate / static_cast<double>(options.threads), i));
+    }
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(options.duration));
+    std::vector<std::thread> threads;
+    for (auto &worker:workers) threads.emplace_back([&worker, start, deadline]() { worker->run(start, deadline); });
+    for (auto &thread:threads) thread.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    Histogram::Snapshot latency = totals.latency.snapshot();
+    std::printf("%s, %s loop, %zu connections, %zu threads\n", options.address.c_str(),
+                options.rate > 0 ? "open" : "closed", options.concurrency, options.threads);
+    std::printf("requests:   %llu in %.2f s, %llu errors\n", (unsigned long long) latency.count, elapsed,
+                (unsigned long long) totals.errors.load());
+    std::printf("throughput: %.1f req/s, in %.2f MB/s, out %.2f MB/s\n", latency.count / elapsed,
+                totals.bytes_in.load() / elapsed / 1e6, totals.bytes_out.load() / elapsed / 1e6);
+    std::printf("responses:  1xx %llu, 2xx %llu, 3xx %llu, 4xx %llu, 5xx %llu\n",
+                (unsigned long long) totals.responses[0].load(), (unsigned long long) totals.responses[1].load(),
+                (unsigned long long) totals.responses[2].load(), (unsigned long long) totals.responses[3].load(),
+                (unsigned long long) totals.responses[4].load());
+    std::printf("latency us: mean %.1f, p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, p99.99 %llu, max %llu\n",
+                latency.mean(), (unsigned long long) latency.percentile(0.5),
+                (unsigned long long) latency.percentile(0.9), (unsigned long long) latency.percentile(0.99),
+                (unsigned long long) latency.percentile(0.999), (unsigned long long) latency.percentile(0.9999),
+                (unsigned long long) latency.max);
+    if (options.distribution && latency.count > 0) {
+        // HDR-like percentile distribution: value, percentile, total count
+        std::printf("%12s %12s %12s\n", "value_us", "percentile", "count");
+        uint64_t total = 0;
+        for (size_t i = 0; i < latency.counts.size(); ++i) {
+            if (latency.counts[i] == 0) continue;
+            total += latency.counts[i];
+            std::printf("%12llu %12.6f %12llu\n", (unsigned long long) Histogram::upper_bound(i),
+                        static_cast<double>(total) / static_cast<double>(latency.count), (unsigned long long) total);
+        }
+    }
+    return totals.errors.load() > 0 && latency.count == 0 ? 1 : 0;
+}